@@ -0,0 +1,529 @@
+// Scene data and ray queries shared by fragment.glsl and wavefront.glsl. Included with #include "common.glsl", which
+// Renderer::ReadShaderSource expands before compiling.
+
+#define BVH_STACK_SIZE 64 // Must be at least Bvh::MaxDepth
+
+#define RENDER_DISTANCE 10000
+#define EPSILON 0.0001
+#define PI 3.1415926538
+#define PLANE_HIT -2 // Returned by closestHit() for the ground plane
+#define TILE_SIZE 16 // Must match Adaptive::TileSize
+
+struct Ray {
+	vec3 origin;
+	vec3 direction;
+};
+
+// Material, Object and PointLight are ordered to pack tightly under std430 and match Scene::Material,
+// Scene::Object and Scene::PointLight byte for byte.
+struct Material {
+	vec3 albedo;
+	float roughness;
+	vec3 specular;
+	float specularHighlight;
+	vec3 emission;
+	float emissionStrength;
+	float specularExponent;
+};
+
+struct SurfacePoint {
+	vec3 position;
+	vec3 normal;
+	Material material;
+};
+
+// Only what the intersection tests need, so traversal touches two vec4s per object. The material is fetched from
+// u_materials once the closest hit is known.
+struct Object {
+	vec3 position;
+	uint type;
+	vec3 scale;
+	uint materialIndex;
+};
+
+// Built by Bvh::Build. Inner nodes have count == 0 and their children at leftFirst and leftFirst + 1, leaves hold
+// count entries of u_bvhObjectIndices starting at leftFirst.
+struct BvhNode {
+	vec3 boundsMin;
+	int leftFirst;
+	vec3 boundsMax;
+	int count;
+};
+
+struct PointLight {
+	vec3 position;
+	float radius;
+	vec3 color;
+	float power;
+	float reach; // Only points within this distance of the light will be affected
+};
+
+uniform sampler2D u_skyboxTexture;
+
+// Written by Scene::FlushChanges, see Scene::SettingsBlock
+layout(std140, binding = 0) uniform SceneSettings {
+	Material u_planeMaterial;
+	int u_shadowResolution;
+	int u_lightBounces;
+	int u_framePasses;
+	float u_blur;
+	float u_bloomRadius;
+	float u_bloomIntensity;
+	float u_skyboxStrength;
+	float u_skyboxGamma;
+	float u_skyboxCeiling;
+	bool u_planeVisible;
+	int u_selectedSphereIndex;
+	int u_objectCount;
+	int u_lightCount;
+};
+
+// Variants of fragment.glsl specialized for one scene define these as constants, see ShaderVariants::SceneDefines.
+// Everything else reads the settings they stand for.
+#ifndef SPECIALIZED
+#define OBJECT_COUNT u_objectCount
+#define LIGHT_COUNT u_lightCount
+#define LIGHT_BOUNCES u_lightBounces
+#define PLANE_VISIBLE u_planeVisible
+#define SKYBOX_VISIBLE (u_skyboxStrength != 0.0)
+#define HAS_SPHERES true
+#define HAS_BOXES true
+#endif
+
+layout(std430, binding = 0) readonly buffer BvhNodes {
+	BvhNode u_bvhNodes[];
+};
+
+layout(std430, binding = 1) readonly buffer BvhObjectIndices {
+	int u_bvhObjectIndices[];
+};
+
+layout(std430, binding = 2) readonly buffer SceneObjects {
+	Object u_objects[];
+};
+
+layout(std430, binding = 3) readonly buffer SceneLights {
+	PointLight u_lights[];
+};
+
+layout(std430, binding = 4) readonly buffer SceneMaterials {
+	Material u_materials[];
+};
+
+// One entry per TILE_SIZE x TILE_SIZE tile of the accumulation target, row by row. Written by convergence.glsl after
+// every pass, see Adaptive::UpdateMask.
+layout(std430, binding = 8) buffer ConvergenceMask {
+	uint u_convergedTiles[];
+};
+
+// Piecewise constant distribution over the skybox texels for explicit skybox samples, built by Environment::Update
+layout(std430, binding = 9) readonly buffer EnvironmentDistribution {
+	int u_environmentWidth;
+	int u_environmentHeight;
+	int u_environmentSampling; // 0 if disabled or the skybox is black
+	int u_environmentPadding;
+	float u_environmentCdf[]; // Marginal CDF of the rows (height + 1 entries), then the conditional CDF of every row (width + 1 entries each)
+};
+
+// Uniform grid of the lights whose reach overlaps each cell, built by LightGrid::Build
+layout(std430, binding = 10) readonly buffer LightGrid {
+	vec3 u_lightGridMin;
+	int u_lightGridCellCount; // 0 without lights
+	vec3 u_lightGridInverseCellSize;
+	int u_lightGridPadding0;
+	ivec3 u_lightGridResolution; // Cells along each axis
+	int u_lightGridPadding1;
+	uint u_lightGridCells[]; // u_lightGridCellCount + 1 offsets into u_lightGridCells, then the light indices of every cell
+};
+
+uniform bool u_adaptiveSampling; // Skip the pixels of converged tiles
+
+#include "sampler.glsl"
+
+// The lights that can reach position are u_lightGridCells[i] for first <= i < last
+void lightsAt(vec3 position, out uint first, out uint last) {
+	first = last = 0;
+	if (LIGHT_COUNT == 0 || u_lightGridCellCount == 0) return;
+
+	ivec3 cell = ivec3(floor((position - u_lightGridMin) * u_lightGridInverseCellSize));
+	if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, u_lightGridResolution))) return;
+
+	int cellIndex = (cell.z * u_lightGridResolution.y + cell.y) * u_lightGridResolution.x + cell.x;
+	first = u_lightGridCells[cellIndex];
+	last = u_lightGridCells[cellIndex + 1];
+}
+
+bool sphereIntersection(vec3 position, float radius, Ray ray, out float hitDistance){
+    float t = dot(position - ray.origin, ray.direction);
+	vec3 p = ray.origin + ray.direction * t;
+
+	float y = length(position - p);
+	if (y < radius) { 
+		float x =  sqrt(radius*radius - y*y);
+		float t1 = t-x;
+		if (t1 >  0) {
+			hitDistance = t1;
+			return true;
+		}
+
+	}
+	
+	return false;
+}
+
+bool boxIntersection(vec3 position, vec3 size, Ray ray, out float hitDistance) {
+	float t1 = -1000000000000.0;
+    float t2 = 1000000000000.0;
+
+	vec3 boxMin = position - size / 2.0;
+	vec3 boxMax = position + size / 2.0;
+
+    vec3 t0s = (boxMin - ray.origin) / ray.direction;
+    vec3 t1s = (boxMax - ray.origin) / ray.direction;
+
+    vec3 tsmaller = min(t0s, t1s);
+    vec3 tbigger = max(t0s, t1s);
+
+    t1 = max(t1, max(tsmaller.x, max(tsmaller.y, tsmaller.z)));
+    t2 = min(t2, min(tbigger.x, min(tbigger.y, tbigger.z)));
+
+	hitDistance = t1;
+
+    return t1 >= 0 && t1 <= t2;
+}
+
+vec3 boxNormal(vec3 cubePosition, vec3 size, vec3 surfacePosition)
+{
+    // Source: https://gist.github.com/Shtille/1f98c649abeeb7a18c5a56696546d3cf
+    // step(edge,x) : x < edge ? 0 : 1
+
+	vec3 boxMin = cubePosition - size / 2.0;
+	vec3 boxMax = cubePosition + size / 2.0;
+
+	vec3 center = (boxMax + boxMin) * 0.5;
+	vec3 boxSize = (boxMax - boxMin) * 0.5;
+	vec3 pc = surfacePosition - center;
+	// step(edge,x) : x < edge ? 0 : 1
+	vec3 normal = vec3(0.0);
+	normal += vec3(sign(pc.x), 0.0, 0.0) * step(abs(abs(pc.x) - boxSize.x), EPSILON);
+	normal += vec3(0.0, sign(pc.y), 0.0) * step(abs(abs(pc.y) - boxSize.y), EPSILON);
+	normal += vec3(0.0, 0.0, sign(pc.z)) * step(abs(abs(pc.z) - boxSize.z), EPSILON);
+	return normalize(normal);
+}
+
+bool planeIntersection(vec3 planeNormal, vec3 planePoint, Ray ray, out float hitDistance) 
+{ 
+    float denom = dot(planeNormal, ray.direction); 
+    if (abs(denom) > EPSILON) { 
+        vec3 d = planePoint - ray.origin; 
+        hitDistance = dot(d, planeNormal) / denom; 
+        return (hitDistance >= EPSILON); 
+    } 
+ 
+    return false; 
+} 
+
+// Distance at which the ray enters the box, or RENDER_DISTANCE if it misses it
+float boundsDistance(vec3 boundsMin, vec3 boundsMax, Ray ray, vec3 inverseDirection) {
+	vec3 t0s = (boundsMin - ray.origin) * inverseDirection;
+	vec3 t1s = (boundsMax - ray.origin) * inverseDirection;
+
+	vec3 tsmaller = min(t0s, t1s);
+	vec3 tbigger = max(t0s, t1s);
+
+	float tNear = max(0.0, max(tsmaller.x, max(tsmaller.y, tsmaller.z)));
+	float tFar = min(tbigger.x, min(tbigger.y, tbigger.z));
+
+	return tNear <= tFar ? tNear : RENDER_DISTANCE;
+}
+
+void objectIntersection(int i, Ray ray, inout float minHitDist, inout int hitObject) {
+	if (i >= OBJECT_COUNT) return;
+
+	float hitDist;
+	Object object = u_objects[i];
+	if ((HAS_SPHERES && object.type == 1 && sphereIntersection(object.position, object.scale.x, ray, hitDist)) ||
+		(HAS_BOXES && object.type == 2 && boxIntersection(object.position, object.scale, ray, hitDist))) {
+		if (hitDist < minHitDist) {
+			minHitDist = hitDist;
+			hitObject = i;
+		}
+	}
+}
+
+// Index of the closest object hit by the ray, PLANE_HIT for the ground plane or -1 if it hits nothing
+int closestHit(Ray ray, out float hitDistance) {
+	float minHitDist = RENDER_DISTANCE;
+	int hitObject = -1;
+	vec3 inverseDirection = 1.0 / ray.direction;
+
+	// Front-to-back BVH traversal: descend into the nearer child first and keep the farther one on the stack
+	int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	int nodeIndex = 0;
+	BvhNode root = u_bvhNodes[0];
+	bool emptyScene = OBJECT_COUNT == 0 || (root.count == 0 && root.leftFirst == 0);
+	if (emptyScene || boundsDistance(root.boundsMin, root.boundsMax, ray, inverseDirection) == RENDER_DISTANCE) nodeIndex = -1;
+
+	while (nodeIndex >= 0) {
+		BvhNode node = u_bvhNodes[nodeIndex];
+		if (node.count > 0) {
+			for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+				objectIntersection(u_bvhObjectIndices[i], ray, minHitDist, hitObject);
+			}
+			nodeIndex = stackSize > 0 ? stack[--stackSize] : -1;
+			continue;
+		}
+
+		int nearChild = node.leftFirst;
+		int farChild = node.leftFirst + 1;
+		float nearDist = boundsDistance(u_bvhNodes[nearChild].boundsMin, u_bvhNodes[nearChild].boundsMax, ray, inverseDirection);
+		float farDist = boundsDistance(u_bvhNodes[farChild].boundsMin, u_bvhNodes[farChild].boundsMax, ray, inverseDirection);
+		if (farDist < nearDist) {
+			int swapChild = nearChild; nearChild = farChild; farChild = swapChild;
+			float swapDist = nearDist; nearDist = farDist; farDist = swapDist;
+		}
+
+		if (nearDist >= minHitDist) {
+			// Both children are behind the closest hit so far (or missed)
+			nodeIndex = stackSize > 0 ? stack[--stackSize] : -1;
+		} else {
+			nodeIndex = nearChild;
+			if (farDist < minHitDist) stack[stackSize++] = farChild;
+		}
+	}
+
+	float planeDist;
+	if (PLANE_VISIBLE && planeIntersection(vec3(0,1,0), vec3(0, 0, 0), ray, planeDist) && planeDist < minHitDist) {
+		minHitDist = planeDist;
+		hitObject = PLANE_HIT;
+	}
+
+	hitDistance = minHitDist;
+	return hitObject;
+}
+
+// Whether anything is hit closer than maxDistance along the ray. Unlike closestHit(), the traversal stops at the first
+// blocker it finds, so shadow rays never look for the closest one and never touch normals or materials.
+bool occluded(Ray ray, float maxDistance) {
+	float planeDist;
+	if (PLANE_VISIBLE && planeIntersection(vec3(0,1,0), vec3(0, 0, 0), ray, planeDist) && planeDist < maxDistance) return true;
+
+	BvhNode root = u_bvhNodes[0];
+	if (OBJECT_COUNT == 0 || (root.count == 0 && root.leftFirst == 0)) return false;
+
+	vec3 inverseDirection = 1.0 / ray.direction;
+	int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	int nodeIndex = boundsDistance(root.boundsMin, root.boundsMax, ray, inverseDirection) < maxDistance ? 0 : -1;
+
+	while (nodeIndex >= 0) {
+		BvhNode node = u_bvhNodes[nodeIndex];
+		if (node.count > 0) {
+			for (int i = node.leftFirst; i < node.leftFirst + node.count; i++) {
+				int objectIndex = u_bvhObjectIndices[i];
+				if (objectIndex >= OBJECT_COUNT) continue;
+
+				float hitDist;
+				Object object = u_objects[objectIndex];
+				if (((HAS_SPHERES && object.type == 1 && sphereIntersection(object.position, object.scale.x, ray, hitDist)) ||
+					(HAS_BOXES && object.type == 2 && boxIntersection(object.position, object.scale, ray, hitDist))) && hitDist < maxDistance) return true;
+			}
+			nodeIndex = stackSize > 0 ? stack[--stackSize] : -1;
+			continue;
+		}
+
+		// Still nearer child first, since a blocker there ends the search sooner
+		int nearChild = node.leftFirst;
+		int farChild = node.leftFirst + 1;
+		float nearDist = boundsDistance(u_bvhNodes[nearChild].boundsMin, u_bvhNodes[nearChild].boundsMax, ray, inverseDirection);
+		float farDist = boundsDistance(u_bvhNodes[farChild].boundsMin, u_bvhNodes[farChild].boundsMax, ray, inverseDirection);
+		if (farDist < nearDist) {
+			int swapChild = nearChild; nearChild = farChild; farChild = swapChild;
+			float swapDist = nearDist; nearDist = farDist; farDist = swapDist;
+		}
+
+		if (nearDist >= maxDistance) {
+			nodeIndex = stackSize > 0 ? stack[--stackSize] : -1;
+		} else {
+			nodeIndex = nearChild;
+			if (farDist < maxDistance) stack[stackSize++] = farChild;
+		}
+	}
+
+	return false;
+}
+
+// Fills in the surface of a hit found by closestHit(). Only done for the closest hit, so the material is fetched once.
+SurfacePoint surfaceAt(Ray ray, int hit, float hitDistance) {
+	SurfacePoint point;
+	point.position = ray.origin + ray.direction * hitDistance;
+	if (hit == PLANE_HIT) {
+		point.normal = vec3(0,1,0);
+		point.material = u_planeMaterial;
+	} else {
+		Object object = u_objects[hit];
+		point.normal = !HAS_BOXES || object.type == 1 ? normalize(point.position - object.position) : boxNormal(object.position, object.scale, point.position);
+		point.material = u_materials[object.materialIndex];
+	}
+	return point;
+}
+
+bool raycast(Ray ray, out SurfacePoint hitPoint) {
+	float hitDistance;
+	int hit = closestHit(ray, hitDistance);
+	if (hit == -1) return false;
+
+	hitPoint = surfaceAt(ray, hit, hitDistance);
+	return true;
+}
+
+// Adapted from https://bitbucket.org/Daerst/gpu-ray-tracing-in-unity/src/Tutorial_Pt2/Assets/RayTracingShader.compute
+mat3x3 getTangentSpace(vec3 normal)
+{
+    // Choose a helper vector for the cross product
+    vec3 helper = vec3(1, 0, 0);
+    if (abs(normal.x) > 0.99)
+        helper = vec3(0, 0, 1);
+
+    // Generate vectors
+    vec3 tangent = normalize(cross(normal, helper));
+    vec3 binormal = normalize(cross(normal, tangent));
+    return mat3x3(tangent, binormal, normal);
+}
+
+// Adapted from https://bitbucket.org/Daerst/gpu-ray-tracing-in-unity/src/Tutorial_Pt2/Assets/RayTracingShader.compute
+// xi holds two random numbers.
+vec3 sampleHemisphere(vec3 normal, float alpha, vec2 xi)
+{
+    // Sample the hemisphere, where alpha determines the kind of the sampling
+    float cosTheta = pow(xi.x, 1.0 / (alpha + 1.0));
+    float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+    float phi = 2 * PI * xi.y;
+    vec3 tangentSpaceDir = vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+
+    // Transform direction to world space
+    return getTangentSpace(normal) * tangentSpaceDir;
+}
+
+vec3 sampleSkybox(vec3 dir) {
+	if (!SKYBOX_VISIBLE) return vec3(0.0);
+	
+	return min(vec3(u_skyboxCeiling), u_skyboxStrength*pow(texture(u_skyboxTexture, vec2(0.5 + atan(dir.x, dir.z)/(2*PI), 0.5 + asin(-dir.y)/PI)).xyz, vec3(1.0/u_skyboxGamma)));
+}
+
+vec2 skyboxUV(vec3 dir) {
+	return vec2(0.5 + atan(dir.x, dir.z)/(2*PI), 0.5 + asin(-dir.y)/PI);
+}
+
+// Index i of the interval [cdf[i], cdf[i+1]) that contains value, for a CDF of count intervals starting at offset.
+// Intervals of zero width are never returned for values below 1.
+int findCdfInterval(int offset, int count, float value) {
+	int low = 0;
+	int high = count - 1;
+	while (low < high) {
+		int middle = (low + high + 1) / 2;
+		if (u_environmentCdf[offset + middle] <= value) low = middle;
+		else high = middle - 1;
+	}
+	return low;
+}
+
+// Probability density (per solid angle) of environmentDirection returning dir
+float environmentPdf(vec3 dir) {
+	vec2 uv = skyboxUV(dir);
+	int row = clamp(int(uv.y * u_environmentHeight), 0, u_environmentHeight - 1);
+	int column = clamp(int(uv.x * u_environmentWidth), 0, u_environmentWidth - 1);
+	int rowOffset = u_environmentHeight + 1 + row * (u_environmentWidth + 1);
+	float probability = (u_environmentCdf[row + 1] - u_environmentCdf[row]) *
+		(u_environmentCdf[rowOffset + column + 1] - u_environmentCdf[rowOffset + column]);
+	// Texels of an equirectangular map cover 2*PI*PI*cos(latitude) / (width*height) steradians
+	float cosLatitude = cos((uv.y - 0.5) * PI);
+	return probability * u_environmentWidth * u_environmentHeight / (2 * PI * PI * max(cosLatitude, EPSILON));
+}
+
+// Picks a direction towards the skybox with a probability proportional to its brightness. xi holds two random numbers.
+vec3 environmentDirection(vec2 xi, out float pdf) {
+	xi = min(xi, vec2(0.99999994));
+	int row = findCdfInterval(0, u_environmentHeight, xi.y);
+	float rowStart = u_environmentCdf[row];
+	float v = (row + (xi.y - rowStart) / (u_environmentCdf[row + 1] - rowStart)) / u_environmentHeight;
+
+	int rowOffset = u_environmentHeight + 1 + row * (u_environmentWidth + 1);
+	int column = findCdfInterval(rowOffset, u_environmentWidth, xi.x);
+	float columnStart = u_environmentCdf[rowOffset + column];
+	float u = (column + (xi.x - columnStart) / (u_environmentCdf[rowOffset + column + 1] - columnStart)) / u_environmentWidth;
+
+	// Inverse of skyboxUV
+	float latitude = (v - 0.5) * PI;
+	float phi = (u - 0.5) * 2 * PI;
+	vec3 dir = vec3(cos(latitude) * sin(phi), -sin(latitude), cos(latitude) * cos(phi));
+	pdf = environmentPdf(dir);
+	return dir;
+}
+
+// Chance that the roulette in computeSceneColor() (and the shade stage) picks the diffuse bounce
+float diffuseChance(Material material) {
+	float specChance = dot(material.specular, vec3(1.0/3.0));
+	float diffChance = dot(material.albedo, vec3(1.0/3.0));
+	return specChance + diffChance > 0.0 ? diffChance / (specChance + diffChance) : 0.0;
+}
+
+// Explicit skybox sample for the diffuse bounce at point, to be added if a shadow ray along direction escapes.
+// Diffuse bounces that escape to the sky get environmentMisWeight() instead of their full value, so together the
+// two estimate what the diffuse bounce alone did (balance heuristic). sampleChance is the chance this sample is taken
+// at all. Returns false if there is nothing to sample.
+bool sampleEnvironment(SurfacePoint point, float sampleChance, vec2 xi, out vec3 direction, out vec3 contribution) {
+	float diffChance = diffuseChance(point.material);
+	if (!SKYBOX_VISIBLE || u_environmentSampling == 0 || diffChance == 0.0) return false;
+
+	float pdf;
+	direction = environmentDirection(xi, pdf);
+	float cosTheta = dot(point.normal, direction);
+	if (cosTheta <= 0.0 || pdf <= 0.0) return false;
+
+	// The diffuse bounce multiplies by albedo * cosTheta and is taken in this direction with density bouncePdf
+	float bouncePdf = diffChance * cosTheta / PI;
+	contribution = point.material.albedo * cosTheta * sampleSkybox(direction) * bouncePdf / (bouncePdf + sampleChance * pdf);
+	return true;
+}
+
+// Weight of the skybox seen by a diffuse bounce ray that escaped, where bouncePdf is diffuseChance() * cosTheta / PI
+// of that bounce (0 after other bounces, which keep their full value)
+float environmentMisWeight(vec3 dir, float bouncePdf, float sampleChance) {
+	if (bouncePdf == 0.0 || u_environmentSampling == 0) return 1.0;
+	return bouncePdf / (bouncePdf + sampleChance * environmentPdf(dir));
+}
+
+// Folds the color of pass number passes (counting from 0) into the running mean of the previous passes. Adding a
+// small increment to a large mean loses its low bits, so they are kept in compensation (Kahan summation) and added
+// back on the next pass.
+void addToRunningMean(vec3 color, int passes, inout vec3 mean, inout vec3 compensation) {
+	if (passes == 0) {
+		mean = color;
+		compensation = vec3(0.0);
+		return;
+	}
+
+	precise vec3 increment = (color - mean) / float(passes + 1) - compensation;
+	precise vec3 sum = mean + increment;
+	compensation = (sum - mean) - increment;
+	mean = sum;
+}
+
+float luminance(vec3 color) {
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+bool tileConverged(ivec2 pixel, ivec2 resolution) {
+	int tilesPerRow = (resolution.x + TILE_SIZE - 1) / TILE_SIZE;
+	ivec2 tile = pixel / TILE_SIZE;
+	return u_convergedTiles[tile.y * tilesPerRow + tile.x] != 0;
+}
+
+// The moments of a pixel are the mean of the squared luminance of its passes (x) and the number of passes
+// accumulated into it (y), which differs between pixels once converged tiles stop accumulating.
+vec4 addToMoments(vec3 color, vec4 moments) {
+	float squaredLuminance = luminance(color) * luminance(color);
+	return vec4(moments.x + (squaredLuminance - moments.x) / (moments.y + 1.0), moments.y + 1.0, 0.0, 0.0);
+}
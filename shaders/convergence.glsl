@@ -0,0 +1,45 @@
+#version 430 core
+
+// Adaptive sampling: decides after every pass which tiles of the accumulation target have converged. A tile has
+// converged once its noisiest pixel's standard error (estimated from the moments of its passes) is below u_threshold,
+// relative to the pixel's brightness. One workgroup per tile, see Adaptive::UpdateMask.
+
+#include "common.glsl"
+
+#define MIN_LUMINANCE 0.05 // Keeps the relative error of (nearly) black pixels from exploding
+
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+layout(rgba32f, binding = 0) readonly uniform image2D u_accumulation;
+layout(rgba32f, binding = 2) readonly uniform image2D u_moments;
+
+uniform float u_threshold;
+uniform int u_minPasses; // Tiles with fewer passes than this never count as converged
+
+// Largest relative error in the tile. The errors are positive, so their bit patterns sort like the floats themselves.
+shared uint tileError;
+
+void main() {
+	if (gl_LocalInvocationIndex == 0) tileError = 0;
+	barrier();
+
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 resolution = imageSize(u_accumulation);
+	if (all(lessThan(pixel, resolution))) {
+		float mean = luminance(imageLoad(u_accumulation, pixel).rgb);
+		vec4 moments = imageLoad(u_moments, pixel);
+
+		float error = 1e30;
+		if (moments.y >= float(u_minPasses)) {
+			float variance = max(moments.x - mean * mean, 0.0);
+			error = sqrt(variance / moments.y) / max(mean, MIN_LUMINANCE);
+		}
+		atomicMax(tileError, floatBitsToUint(error));
+	}
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0) {
+		uint tileIndex = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+		u_convergedTiles[tileIndex] = uintBitsToFloat(tileError) < u_threshold ? 1 : 0;
+	}
+}
@@ -0,0 +1,79 @@
+#version 430 core
+
+// One iteration of the edge-avoiding A-Trous wavelet filter (Dammertz et al. 2010). Every iteration applies the same
+// 5x5 B3 spline kernel with its taps u_stepWidth pixels apart, so five iterations cover a 125 pixel wide footprint at
+// the cost of 125 taps. A tap's weight drops where its color, normal, depth or albedo differ from the center pixel's,
+// which keeps the filter from blurring across edges. Denoiser::FilterCpu does the same on the CPU.
+
+#define EPSILON 0.001 // Relative depth difference tolerated even where the gradient is flat
+
+in vec2 fragUV;
+layout(location = 0) out vec4 fragColor;
+
+uniform sampler2D u_colorTexture;
+uniform sampler2D u_normalDepthTexture;
+uniform sampler2D u_albedoTexture;
+
+uniform int u_stepWidth;
+uniform float u_colorPhi; // Scaled by the noise left in the image and halved every iteration, see Denoiser::Apply
+uniform float u_normalPhi;
+uniform float u_depthPhi; // In units of the depth change the center pixel's depth gradient predicts for the tap
+uniform float u_albedoPhi;
+
+const float kernel[3] = float[](3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+
+// Change in depth per pixel along x and y. Of the two one-sided differences the flatter one is used, so pixels on a
+// silhouette don't get the depth jump to the background as their gradient.
+vec2 depthGradient(ivec2 pixel, ivec2 lastPixel, float depth) {
+	float left = texelFetch(u_normalDepthTexture, max(pixel - ivec2(1, 0), ivec2(0)), 0).w;
+	float right = texelFetch(u_normalDepthTexture, min(pixel + ivec2(1, 0), lastPixel), 0).w;
+	float down = texelFetch(u_normalDepthTexture, max(pixel - ivec2(0, 1), ivec2(0)), 0).w;
+	float up = texelFetch(u_normalDepthTexture, min(pixel + ivec2(0, 1), lastPixel), 0).w;
+	float dx = abs(right - depth) < abs(depth - left) ? right - depth : depth - left;
+	float dy = abs(up - depth) < abs(depth - down) ? up - depth : depth - down;
+	return vec2(dx, dy);
+}
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	ivec2 lastPixel = textureSize(u_colorTexture, 0) - ivec2(1);
+
+	vec4 center = texelFetch(u_colorTexture, pixel, 0);
+	vec4 centerNormalDepth = texelFetch(u_normalDepthTexture, pixel, 0);
+	vec3 centerAlbedo = texelFetch(u_albedoTexture, pixel, 0).rgb;
+
+	// Sky pixels have no noise to remove
+	if (centerNormalDepth.w == 0.0) {
+		fragColor = center;
+		return;
+	}
+
+	vec2 gradient = depthGradient(pixel, lastPixel, centerNormalDepth.w);
+
+	vec3 colorSum = vec3(0.0);
+	float weightSum = 0.0;
+	for (int y = -2; y <= 2; y++) {
+		for (int x = -2; x <= 2; x++) {
+			ivec2 tap = clamp(pixel + ivec2(x, y) * u_stepWidth, ivec2(0), lastPixel);
+			vec3 color = texelFetch(u_colorTexture, tap, 0).rgb;
+			vec4 normalDepth = texelFetch(u_normalDepthTexture, tap, 0);
+			vec3 albedo = texelFetch(u_albedoTexture, tap, 0).rgb;
+
+			vec3 colorDifference = color - center.rgb;
+			vec3 albedoDifference = albedo - centerAlbedo;
+			// Sky taps have a zero normal and drop out here
+			float weight = kernel[abs(x)] * kernel[abs(y)];
+			weight *= pow(max(dot(normalDepth.xyz, centerNormalDepth.xyz), 0.0), u_normalPhi);
+			float expectedDepthChange = abs(dot(gradient, vec2(x, y) * float(u_stepWidth)));
+			weight *= exp(-abs(normalDepth.w - centerNormalDepth.w) / (u_depthPhi * expectedDepthChange + EPSILON * centerNormalDepth.w));
+			weight *= exp(-dot(colorDifference, colorDifference) / u_colorPhi);
+			weight *= exp(-dot(albedoDifference, albedoDifference) / u_albedoPhi);
+
+			colorSum += color * weight;
+			weightSum += weight;
+		}
+	}
+
+	// The center tap always has a positive weight
+	fragColor = vec4(colorSum / weightSum, 1.0);
+}
@@ -1,242 +1,44 @@
 #version 430 core
 
-#define MAX_OBJECT_COUNT 64
-#define MAX_LIGHT_COUNT 4
-
-#define RENDER_DISTANCE 10000
-#define EPSILON 0.0001
-#define PI 3.1415926538
-#define OUTLINE_WIDTH 0.004
+#define OUTLINE_WIDTH 2 // In pixels
 #define OUTLINE_COLOR vec4(1.0, 0.0, 1.0, 1.0)
 
-in vec2 fragUV;
-out vec4 fragColor;
-
-struct Ray {
-	vec3 origin;
-	vec3 direction;
-};
-
-struct Material {
-	vec3 albedo;
-	vec3 specular;
-	vec3 emission;
-	float emissionStrength;
-	float roughness;
-	float specularHighlight;
-	float specularExponent;
-};
-
-struct SurfacePoint {
-	vec3 position;
-	vec3 normal;
-	Material material;
-};
+#include "common.glsl"
 
-struct Object {
-	uint type;
-	vec3 position;
-	vec3 scale;
-	Material material;
-};
-
-struct PointLight {
-	vec3 position;
-	float radius;
-	vec3 color;
-	float power;
-	float reach; // Only points within this distance of the light will be affected
-};
-
-uniform sampler2D u_screenTexture;
-uniform sampler2D u_skyboxTexture;
+in vec2 fragUV;
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec4 fragCompensation; // Only written by the accumulation pass, see addToRunningMean
+layout(location = 2) out vec4 fragMoments; // Only written by the accumulation pass, see addToMoments
+
+uniform sampler2D u_screenTexture; // Running mean of the accumulated passes
+uniform sampler2D u_compensationTexture;
+uniform sampler2D u_momentsTexture;
+uniform isampler2D u_objectIndexTexture; // Renderer::GBuffer's object indices, for the selection outline
 uniform int u_accumulatedPasses; // How many passes have been added to the texture
 uniform bool u_directOutputPass; // If this is true, the shader will draw the input texture directly to the screen. (Used to draw the contents of the FBO to the screen)
-uniform float u_time;
+uniform uint u_firstSample; // Sample index of this pass' first sample, see Renderer::SampleCount
 uniform vec3 u_cameraPosition;
 uniform mat4 u_rotationMatrix;
 uniform float u_aspectRatio;
 uniform bool u_debugKeyPressed;
+uniform bool u_showSampleCount; // Display pass: show how many passes each pixel received instead of the image
 
-uniform int u_shadowResolution;
-uniform int u_lightBounces;
-uniform int u_framePasses;
-uniform float u_blur;
-uniform float u_bloomRadius;
-uniform float u_bloomIntensity;
-uniform float u_skyboxStrength;
-uniform float u_skyboxGamma;
-uniform float u_skyboxCeiling;
-uniform Object u_objects[MAX_OBJECT_COUNT];
-uniform PointLight u_lights[MAX_LIGHT_COUNT];
-uniform bool u_planeVisible;
-uniform Material u_planeMaterial;
-
-uniform int u_selectedSphereIndex;
-
-float rand(vec2 co){
-    return fract(sin(dot(co, vec2(12.9898, 78.233))) * 43758.5453);
-}
-
-bool sphereIntersection(vec3 position, float radius, Ray ray, out float hitDistance){
-    float t = dot(position - ray.origin, ray.direction);
-	vec3 p = ray.origin + ray.direction * t;
-
-	float y = length(position - p);
-	if (y < radius) { 
-		float x =  sqrt(radius*radius - y*y);
-		float t1 = t-x;
-		if (t1 >  0) {
-			hitDistance = t1;
-			return true;
-		}
-
-	}
-	
-	return false;
-}
-
-bool boxIntersection(vec3 position, vec3 size, Ray ray, out float hitDistance) {
-	float t1 = -1000000000000.0;
-    float t2 = 1000000000000.0;
-
-	vec3 boxMin = position - size / 2.0;
-	vec3 boxMax = position + size / 2.0;
-
-    vec3 t0s = (boxMin - ray.origin) / ray.direction;
-    vec3 t1s = (boxMax - ray.origin) / ray.direction;
-
-    vec3 tsmaller = min(t0s, t1s);
-    vec3 tbigger = max(t0s, t1s);
-
-    t1 = max(t1, max(tsmaller.x, max(tsmaller.y, tsmaller.z)));
-    t2 = min(t2, min(tbigger.x, min(tbigger.y, tbigger.z)));
-
-	hitDistance = t1;
-
-    return t1 >= 0 && t1 <= t2;
-}
-
-vec3 boxNormal(vec3 cubePosition, vec3 size, vec3 surfacePosition)
-{
-    // Source: https://gist.github.com/Shtille/1f98c649abeeb7a18c5a56696546d3cf
-    // step(edge,x) : x < edge ? 0 : 1
-
-	vec3 boxMin = cubePosition - size / 2.0;
-	vec3 boxMax = cubePosition + size / 2.0;
-
-	vec3 center = (boxMax + boxMin) * 0.5;
-	vec3 boxSize = (boxMax - boxMin) * 0.5;
-	vec3 pc = surfacePosition - center;
-	// step(edge,x) : x < edge ? 0 : 1
-	vec3 normal = vec3(0.0);
-	normal += vec3(sign(pc.x), 0.0, 0.0) * step(abs(abs(pc.x) - boxSize.x), EPSILON);
-	normal += vec3(0.0, sign(pc.y), 0.0) * step(abs(abs(pc.y) - boxSize.y), EPSILON);
-	normal += vec3(0.0, 0.0, sign(pc.z)) * step(abs(abs(pc.z) - boxSize.z), EPSILON);
-	return normalize(normal);
-}
-
-bool planeIntersection(vec3 planeNormal, vec3 planePoint, Ray ray, out float hitDistance) 
-{ 
-    float denom = dot(planeNormal, ray.direction); 
-    if (abs(denom) > EPSILON) { 
-        vec3 d = planePoint - ray.origin; 
-        hitDistance = dot(d, planeNormal) / denom; 
-        return (hitDistance >= EPSILON); 
-    } 
- 
-    return false; 
-} 
-
-bool raycast(Ray ray, out SurfacePoint hitPoint) {
-	bool didHit = false;
-	float minHitDist = RENDER_DISTANCE;
-
-	float hitDist;
-	for (int i = 0; i<u_objects.length(); i++) {
-		if (u_objects[i].type == 0) continue;
-
-		if (u_objects[i].type == 1 && sphereIntersection(u_objects[i].position, u_objects[i].scale.x, ray, hitDist)) {
-			didHit = true;
-			if (hitDist < minHitDist) {
-				minHitDist = hitDist;
-				hitPoint.position = ray.origin + ray.direction * minHitDist;
-				hitPoint.normal = normalize(hitPoint.position - u_objects[i].position);
-				hitPoint.material = u_objects[i].material;
-			}
-		}
-
-		if (u_objects[i].type == 2 && boxIntersection(u_objects[i].position, u_objects[i].scale, ray, hitDist)) {
-			didHit = true;
-			if (hitDist < minHitDist) {
-				minHitDist = hitDist;
-				hitPoint.position = ray.origin + ray.direction * minHitDist;
-				hitPoint.normal = boxNormal(u_objects[i].position, u_objects[i].scale, ray.origin + ray.direction * minHitDist);
-				hitPoint.material = u_objects[i].material;
-			}
-		}
-	}
+// Adds up the total light received directly from the light sources in reach (see lightsAt), and from the skybox unless the path ends here
+vec3 computeDirectIllumination(SurfacePoint point, vec3 observerPos, Sampler sampler, int depth, bool lastBounce) {
+	vec3 directIllumination = vec3(0);
 
-	if (u_planeVisible && planeIntersection(vec3(0,1,0), vec3(0, 0, 0), ray, hitDist)) {
-		didHit = true;
-		if (hitDist < minHitDist) {
-			minHitDist = hitDist;
-			hitPoint.position = ray.origin + ray.direction * minHitDist;
-			hitPoint.normal = vec3(0,1,0);
-			hitPoint.material = u_planeMaterial;
-		}
+	// Skybox, see sampleEnvironment
+	vec3 environmentDir;
+	vec3 environmentLight;
+	vec2 xi = sample2D(sampler, bounceDimension(depth, BOUNCE_ENVIRONMENT));
+	if (!lastBounce && sampleEnvironment(point, 1.0, xi, environmentDir, environmentLight)) {
+		if (!occluded(Ray(point.position + point.normal * EPSILON, environmentDir), RENDER_DISTANCE)) directIllumination += environmentLight;
 	}
 
-	return didHit;
-}
-
-// Adapted from https://bitbucket.org/Daerst/gpu-ray-tracing-in-unity/src/Tutorial_Pt2/Assets/RayTracingShader.compute
-mat3x3 getTangentSpace(vec3 normal)
-{
-    // Choose a helper vector for the cross product
-    vec3 helper = vec3(1, 0, 0);
-    if (abs(normal.x) > 0.99)
-        helper = vec3(0, 0, 1);
-
-    // Generate vectors
-    vec3 tangent = normalize(cross(normal, helper));
-    vec3 binormal = normalize(cross(normal, tangent));
-    return mat3x3(tangent, binormal, normal);
-}
-
-// Basic rejection sampling method
-vec3 _sampleHemisphere(vec3 normal, vec2 seed)
-{
-    vec3 vec = normalize(vec3(rand(seed)*2.0-1.0,rand(seed.yx+vec2(1.123123123,2.545454))*2.0-1.0,rand(seed-vec2(9.21428,7.43163431))*2.0-1.0));
-	if (dot(vec, normal) < 0.0) vec *= -1; 
-
-	return vec;
-}
-
-// Adapted from https://bitbucket.org/Daerst/gpu-ray-tracing-in-unity/src/Tutorial_Pt2/Assets/RayTracingShader.compute
-vec3 sampleHemisphere(vec3 normal, float alpha, vec2 seed)
-{
-    // Sample the hemisphere, where alpha determines the kind of the sampling
-    float cosTheta = pow(rand(seed), 1.0 / (alpha + 1.0));
-    float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
-    float phi = 2 * PI * rand(seed.yx);
-    vec3 tangentSpaceDir = vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
-
-    // Transform direction to world space
-    return getTangentSpace(normal) * tangentSpaceDir;
-}
-
-vec3 sampleSkybox(vec3 dir) {
-	if (u_skyboxStrength == 0.0) return vec3(0.0);
-	
-	return min(vec3(u_skyboxCeiling), u_skyboxStrength*pow(texture(u_skyboxTexture, vec2(0.5 + atan(dir.x, dir.z)/(2*PI), 0.5 + asin(-dir.y)/PI)).xyz, vec3(1.0/u_skyboxGamma)));
-}
-
-// Adds up the total light received directly from all light sources
-vec3 computeDirectIllumination(SurfacePoint point, vec3 observerPos, float seed) {
-	vec3 directIllumination = vec3(0);
-
-	for (int lightIndex = 0; lightIndex<u_lights.length(); lightIndex++) {
+	uint firstLight, lastLight;
+	lightsAt(point.position, firstLight, lastLight);
+	for (uint entry = firstLight; entry < lastLight; entry++) {
+		uint lightIndex = u_lightGridCells[entry];
 		PointLight light = u_lights[lightIndex];
 			
 		float lightDistance = length(light.position - point.position);
@@ -249,19 +51,14 @@ vec3 computeDirectIllumination(SurfacePoint point, vec3 observerPos, float seed)
 			int shadowRays = int(u_shadowResolution*light.radius*light.radius/(lightDistance*lightDistance)+1); // There must be a better way to find the right amount of shadow rays
 			int shadowRayHits = 0;
 			for (int i = 0; i<shadowRays; i++) {
-				// Sample a point on the light sphere
-				
-				vec3 lightSurfacePoint = light.position + normalize(vec3(rand(vec2(i+seed, 1)+point.position.xy), rand(vec2(i+seed, 2)+point.position.yz), rand(vec2(i+seed, 3)+point.position.xz))) * light.radius;
+				// Sample a point on the light sphere. Every light and shadow ray has dimensions of its own.
+				uint dimension = hashCombine(hashCombine(bounceDimension(depth, BOUNCE_LIGHT_POINT), lightIndex), uint(i));
+				vec3 xi = vec3(sample2D(sampler, dimension), sample1D(sampler, dimension + 1u));
+				vec3 lightSurfacePoint = light.position + normalize(xi) * light.radius;
 				vec3 lightDir = normalize(lightSurfacePoint - point.position);
 				vec3 rayOrigin = point.position + lightDir * EPSILON * 2.0;
 				float maxRayLength = length(lightSurfacePoint - rayOrigin);
-				Ray shadowRay = Ray(rayOrigin, lightDir);
-				SurfacePoint SR_hit;
-				if (raycast(shadowRay, SR_hit)) {
-					if (length(SR_hit.position-rayOrigin) < maxRayLength) {
-						shadowRayHits += 1;
-					}
-				}
+				if (occluded(Ray(rayOrigin, lightDir), maxRayLength)) shadowRayHits += 1;
 
 			}
 
@@ -282,19 +79,20 @@ vec3 computeDirectIllumination(SurfacePoint point, vec3 observerPos, float seed)
 }
 
 // Based on https://bitbucket.org/Daerst/gpu-ray-tracing-in-unity/src/Tutorial_Pt2/Assets/RayTracingShader.compute
-vec3 computeSceneColor(Ray cameraRay, float seed) {
+vec3 computeSceneColor(Ray cameraRay, Sampler sampler) {
 	vec3 totalIllumination = vec3(0);
 	vec3 rayOrigin = cameraRay.origin;
 	vec3 rayDirection = cameraRay.direction;
 	vec3 energy = vec3(1.0);
-	for (int depth = 0; depth < u_lightBounces; depth++) {
+	float bouncePdf = 0.0; // Of the last bounce, see environmentMisWeight
+	for (int depth = 0; depth < LIGHT_BOUNCES; depth++) {
 		SurfacePoint hitPoint;
 		if (raycast(Ray(rayOrigin, rayDirection), hitPoint)) {
 			// Part one: Hit object's emission
 			totalIllumination += energy * hitPoint.material.emission * hitPoint.material.emissionStrength;
 
 			// Part two: Direct light (received directly from light sources)
-			totalIllumination += energy * computeDirectIllumination(hitPoint, rayOrigin, seed);
+			totalIllumination += energy * computeDirectIllumination(hitPoint, rayOrigin, sampler, depth, depth + 1 == LIGHT_BOUNCES);
 
 			// Part three: Indirect light (other objects + skybox)
 			float specChance = dot(hitPoint.material.specular, vec3(1.0/3.0));
@@ -305,7 +103,7 @@ vec3 computeSceneColor(Ray cameraRay, float seed) {
 			diffChance /= sum;
 
 			// Roulette-select the ray's path
-			float roulette = rand(hitPoint.position.zx+vec2(hitPoint.position.y)+vec2(seed, depth));
+			float roulette = sample1D(sampler, bounceDimension(depth, BOUNCE_ROULETTE));
 			if (roulette < specChance)
 			{
 				// Specular reflection
@@ -314,25 +112,27 @@ vec3 computeSceneColor(Ray cameraRay, float seed) {
 				if (smoothness == 1.0) {
 					rayDirection = reflect(rayDirection, hitPoint.normal);
 				} else {
-					rayDirection = sampleHemisphere(reflect(rayDirection, hitPoint.normal), alpha, hitPoint.position.zx+vec2(hitPoint.position.y)+vec2(seed, depth));
+					rayDirection = sampleHemisphere(reflect(rayDirection, hitPoint.normal), alpha, sample2D(sampler, bounceDimension(depth, BOUNCE_DIRECTION)));
 				}
 				rayOrigin = hitPoint.position + rayDirection * EPSILON;
 				float f = (alpha + 2) / (alpha + 1);
 				energy *= hitPoint.material.specular * clamp(dot(hitPoint.normal, rayDirection) * f, 0.0, 1.0);
+				bouncePdf = 0.0;
 			}
 			else if (diffChance > 0 && roulette < specChance + diffChance)
 			{
 				// Diffuse reflection
 				rayOrigin = hitPoint.position + hitPoint.normal * EPSILON;
-				rayDirection = sampleHemisphere(hitPoint.normal, 1.0, hitPoint.position.zx+vec2(hitPoint.position.y)+vec2(seed, depth));
+				rayDirection = sampleHemisphere(hitPoint.normal, 1.0, sample2D(sampler, bounceDimension(depth, BOUNCE_DIRECTION)));
 				energy *= hitPoint.material.albedo * clamp(dot(hitPoint.normal, rayDirection), 0.0, 1.0);
+				bouncePdf = diffChance * max(dot(hitPoint.normal, rayDirection), 0.0) / PI;
 			} else {
 				// This means both the hit material's albedo and specular are totally black, so there won't be anymore light. We can stop here.
 				break;
 			}
 		} else {
 			// The ray didn't hit anything, so we add the sky's color and we're done
-			totalIllumination += energy * sampleSkybox(rayDirection);
+			totalIllumination += energy * sampleSkybox(rayDirection) * environmentMisWeight(rayDirection, bouncePdf, 1.0);
 			break;
 		}
 	}
@@ -344,54 +144,68 @@ void main() {
 	vec2 centeredUV = (fragUV * 2 - vec2(1)) * vec2(u_aspectRatio, 1.0);
 
 	if (u_directOutputPass) {
-		vec3 rayDir = (normalize(vec4(centeredUV, -1.0, 0.0)) * u_rotationMatrix).xyz;
-		Ray cameraRay = Ray(u_cameraPosition, rayDir);
-
 		fragColor = texture(u_screenTexture, fragUV);
-		float divider = float(u_accumulatedPasses);
-		fragColor.x /= divider;
-		fragColor.y /= divider;
-		fragColor.z /= divider;
-
-		// Selected object outline rendering
-		if (u_selectedSphereIndex >= 0) {
-			float hitDist;
 
-			float selectedSphereDist = length(u_objects[u_selectedSphereIndex].position - u_cameraPosition);
+		if (u_showSampleCount) {
+			// u_accumulatedPasses still holds the index of the last pass, which every unconverged pixel received
+			float fraction = texture(u_momentsTexture, fragUV).y / float(u_accumulatedPasses + 1);
+			fragColor = vec4(fraction, 1.0 - abs(fraction * 2.0 - 1.0), 1.0 - fraction, 1.0);
+		}
 
-			// Check if this camera ray is hitting the outline
-			Object selectedObject = u_objects[u_selectedSphereIndex];
-			if (selectedObject.type == 1 && sphereIntersection(selectedObject.position, selectedObject.scale[0]+OUTLINE_WIDTH*selectedSphereDist, cameraRay, hitDist)) {
-				if (!sphereIntersection(selectedObject.position, selectedObject.scale[0], cameraRay, hitDist)) {
-					fragColor = OUTLINE_COLOR;
-				}
-			} else if (selectedObject.type == 2 && boxIntersection(selectedObject.position, selectedObject.scale+vec3(OUTLINE_WIDTH*selectedSphereDist), cameraRay, hitDist)) {
-				if (!boxIntersection(selectedObject.position, selectedObject.scale, cameraRay, hitDist)) {
-					fragColor = OUTLINE_COLOR;
+		// Selected object outline: pixels next to the selected object's visible pixels in the object index buffer
+		ivec2 pixel = ivec2(gl_FragCoord.xy);
+		if (u_selectedSphereIndex >= 0 && texelFetch(u_objectIndexTexture, pixel, 0).r != u_selectedSphereIndex) {
+			ivec2 lastPixel = textureSize(u_objectIndexTexture, 0) - ivec2(1);
+			for (int y = -OUTLINE_WIDTH; y <= OUTLINE_WIDTH; y++) {
+				for (int x = -OUTLINE_WIDTH; x <= OUTLINE_WIDTH; x++) {
+					ivec2 neighbour = clamp(pixel + ivec2(x, y), ivec2(0), lastPixel);
+					if (texelFetch(u_objectIndexTexture, neighbour, 0).r == u_selectedSphereIndex) fragColor = OUTLINE_COLOR;
 				}
 			}
 		}
 	} else {
-		if (u_blur > 0.0 && u_accumulatedPasses > 0) centeredUV += vec2(rand(vec2(1, u_time)+fragUV.xy)*u_blur-u_blur/2, rand(vec2(2, u_time)+fragUV.yx)*u_blur-u_blur/2);
+		ivec2 pixel = ivec2(gl_FragCoord.xy);
+		if (u_adaptiveSampling && u_accumulatedPasses > 0 && tileConverged(pixel, textureSize(u_screenTexture, 0))) {
+			// Nothing left to add, but the pixel still has to be copied into this pass' target
+			fragColor = texelFetch(u_screenTexture, pixel, 0);
+			fragCompensation = texelFetch(u_compensationTexture, pixel, 0);
+			fragMoments = texelFetch(u_momentsTexture, pixel, 0);
+			return;
+		}
+
+		// The camera ray and bloom are sampled once per pass, with the dimensions of its first sample
+		Sampler passSampler = Sampler(pixel, u_firstSample);
+		if (u_blur > 0.0 && u_accumulatedPasses > 0) centeredUV += (sample2D(passSampler, DIMENSION_PIXEL) - 0.5) * u_blur;
 		vec3 rayDir = (normalize(vec4(centeredUV, -1.0, 0.0)) * u_rotationMatrix).xyz;
 		Ray cameraRay = Ray(u_cameraPosition, rayDir);
 
 		// Camera raycasting
-		vec3 colorSum = computeSceneColor(cameraRay, u_time);
-		for (int i = 0; i<u_framePasses-1; i++) colorSum += computeSceneColor(cameraRay, u_time+i);
-		fragColor = vec4(colorSum / u_framePasses, 1.0);
-
+		vec3 colorSum = vec3(0.0);
+		for (int i = 0; i<u_framePasses; i++) colorSum += computeSceneColor(cameraRay, Sampler(pixel, u_firstSample + uint(i)));
+		vec3 color = colorSum / u_framePasses;
 
+		vec3 mean = vec3(0.0);
+		vec3 compensation = vec3(0.0);
+		vec4 moments = vec4(0.0);
 		if (u_accumulatedPasses > 0) {
 			// Bloom
 			SurfacePoint hitPoint;
-			vec3 offsetDirection = cameraRay.direction + vec3(rand(vec2(1, u_time)+fragUV)*u_bloomRadius-u_bloomRadius/2, rand(vec2(2, u_time)+fragUV)*u_bloomRadius-u_bloomRadius/2, rand(vec2(3, u_time)+fragUV)*u_bloomRadius-u_bloomRadius/2);
+			vec3 bloomXi = vec3(sample2D(passSampler, DIMENSION_BLOOM), sample1D(passSampler, DIMENSION_BLOOM + 1u));
+			vec3 offsetDirection = cameraRay.direction + (bloomXi - 0.5) * u_bloomRadius;
 			if (raycast(Ray(cameraRay.origin, offsetDirection), hitPoint)) {
-				fragColor += vec4(hitPoint.material.emission*hitPoint.material.emissionStrength*u_bloomIntensity, 1.0);
+				color += hitPoint.material.emission*hitPoint.material.emissionStrength*u_bloomIntensity;
 			}
 
-			// Add last frame back (progressive sampling)
-			fragColor += texture(u_screenTexture, fragUV);
+			// Last frame's mean (progressive sampling). It was rendered into the other target, so reading it here
+			// doesn't race with this pass' writes.
+			mean = texelFetch(u_screenTexture, pixel, 0).rgb;
+			compensation = texelFetch(u_compensationTexture, pixel, 0).rgb;
+			moments = texelFetch(u_momentsTexture, pixel, 0);
 		}
+
+		addToRunningMean(color, int(moments.y), mean, compensation);
+		fragColor = vec4(mean, 1.0);
+		fragCompensation = vec4(compensation, 0.0);
+		fragMoments = addToMoments(color, moments);
 	}
 }
\ No newline at end of file
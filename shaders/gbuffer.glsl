@@ -0,0 +1,35 @@
+#version 430 core
+
+// Primary hit of every pixel, traced without the blur jitter: the guides of the denoiser and the object index buffer
+// used for picking and the selection outline. Rendered into Renderer::GBuffer whenever an accumulation restarts, since
+// they don't change while it runs.
+
+#include "common.glsl"
+
+in vec2 fragUV;
+layout(location = 0) out vec4 fragNormalDepth; // Depth 0 means the ray left the scene
+layout(location = 1) out vec4 fragAlbedo;
+layout(location = 2) out int fragObjectIndex; // Index into u_objects, or what closestHit() returns for the plane or a miss
+
+uniform vec3 u_cameraPosition;
+uniform mat4 u_rotationMatrix;
+uniform float u_aspectRatio;
+
+void main() {
+	vec2 centeredUV = (fragUV * 2 - vec2(1)) * vec2(u_aspectRatio, 1.0);
+	vec3 rayDir = (normalize(vec4(centeredUV, -1.0, 0.0)) * u_rotationMatrix).xyz;
+	Ray cameraRay = Ray(u_cameraPosition, rayDir);
+
+	float hitDistance;
+	int hit = closestHit(cameraRay, hitDistance);
+	fragObjectIndex = hit;
+	if (hit == -1) {
+		fragNormalDepth = vec4(0.0);
+		fragAlbedo = vec4(0.0);
+		return;
+	}
+
+	SurfacePoint point = surfaceAt(cameraRay, hit, hitDistance);
+	fragNormalDepth = vec4(point.normal, hitDistance);
+	fragAlbedo = vec4(point.material.albedo, 1.0);
+}
@@ -0,0 +1,81 @@
+#version 430 core
+
+// Seeds a new accumulation with the samples of the previous one. Every pixel's primary hit (from the new G-buffer) is
+// projected into the previous camera, and the previous mean, compensation and moments at that pixel are carried over
+// if the previous G-buffer saw the same surface there. Pixels that were hidden or off screen (disocclusions) start
+// with no passes. See Reprojection::Apply.
+
+in vec2 fragUV;
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec4 fragCompensation;
+layout(location = 2) out vec4 fragMoments;
+
+uniform sampler2D u_screenTexture; // Previous mean
+uniform sampler2D u_compensationTexture;
+uniform sampler2D u_momentsTexture;
+uniform sampler2D u_normalDepthTexture; // New G-buffer
+uniform sampler2D u_previousNormalDepthTexture;
+
+uniform vec3 u_cameraPosition;
+uniform mat4 u_rotationMatrix;
+uniform float u_aspectRatio;
+uniform vec3 u_previousCameraPosition;
+uniform mat4 u_previousRotationMatrix;
+uniform float u_previousAspectRatio;
+
+uniform float u_depthTolerance; // Relative to the hit distance
+uniform float u_normalThreshold; // Smallest cosine between the new and previous normal
+uniform float u_maxHistory; // Passes carried over per pixel are capped at this
+
+void discardHistory() {
+	fragColor = vec4(0.0);
+	fragCompensation = vec4(0.0);
+	fragMoments = vec4(0.0);
+}
+
+void main() {
+	// Same camera ray as fragment.glsl and gbuffer.glsl
+	vec2 centeredUV = (fragUV * 2 - vec2(1)) * vec2(u_aspectRatio, 1.0);
+	vec3 rayDir = (normalize(vec4(centeredUV, -1.0, 0.0)) * u_rotationMatrix).xyz;
+
+	vec4 normalDepth = texelFetch(u_normalDepthTexture, ivec2(gl_FragCoord.xy), 0);
+	bool miss = normalDepth.w == 0.0;
+
+	// Sky pixels only depend on the direction, so they are looked up from the previous camera's position
+	vec3 previousDir = miss ? rayDir : u_cameraPosition + rayDir * normalDepth.w - u_previousCameraPosition;
+	// Inverse of the (row vector) rotation that turns camera rays into world directions
+	vec3 cameraDir = (u_previousRotationMatrix * vec4(previousDir, 0.0)).xyz;
+	if (cameraDir.z >= 0.0) {
+		discardHistory();
+		return;
+	}
+
+	vec2 previousUV = (cameraDir.xy / -cameraDir.z / vec2(u_previousAspectRatio, 1.0) + vec2(1)) * 0.5;
+	ivec2 resolution = textureSize(u_screenTexture, 0);
+	ivec2 previousPixel = ivec2(floor(previousUV * vec2(resolution)));
+	if (any(lessThan(previousPixel, ivec2(0))) || any(greaterThanEqual(previousPixel, resolution))) {
+		discardHistory();
+		return;
+	}
+
+	// Disocclusion test: the previous camera has to have seen the same surface (or the sky) at that pixel
+	vec4 previousNormalDepth = texelFetch(u_previousNormalDepthTexture, previousPixel, 0);
+	bool previousMiss = previousNormalDepth.w == 0.0;
+	if (miss != previousMiss) {
+		discardHistory();
+		return;
+	}
+	if (!miss) {
+		float distance = length(previousDir);
+		if (abs(previousNormalDepth.w - distance) > u_depthTolerance * distance ||
+			dot(previousNormalDepth.xyz, normalDepth.xyz) < u_normalThreshold) {
+			discardHistory();
+			return;
+		}
+	}
+
+	fragColor = texelFetch(u_screenTexture, previousPixel, 0);
+	fragCompensation = texelFetch(u_compensationTexture, previousPixel, 0);
+	vec4 moments = texelFetch(u_momentsTexture, previousPixel, 0);
+	fragMoments = vec4(moments.x, min(moments.y, u_maxHistory), 0.0, 0.0);
+}
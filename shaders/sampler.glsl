@@ -0,0 +1,97 @@
+// Random numbers of the path tracers, included by common.glsl. The samples of a pixel are the points of an
+// Owen-scrambled Sobol sequence (Burley 2020, "Practical Hash-based Owen Scrambling"), taken in the order of their
+// sample index in the accumulation. Every dimension id draws from its own shuffled and scrambled copy of the first two
+// Sobol dimensions, so a path can use as many of them as it needs. The pixels of a blue-noise tile share that
+// scrambling and shift the points by the tile's value at the pixel instead (Georgiev & Fajardo 2016, "Blue-noise
+// dithered sampling"), which spreads the error of neighbouring pixels as blue noise.
+
+#define BLUE_NOISE_SIZE 64 // Must match BlueNoise::Size
+
+// Dimension ids. Different ids are independent of each other; an id only has to stand for the same decision in every
+// sample.
+#define DIMENSION_PIXEL 0u // 2D: jitter of the camera ray (u_blur)
+#define DIMENSION_BLOOM 1u // 2D, and 1D at DIMENSION_BLOOM + 1: offset of the bloom ray
+#define DIMENSION_BOUNCES 8u // The dimensions of every bounce follow from here, see bounceDimension
+#define DIMENSIONS_PER_BOUNCE 8u
+// Offsets for bounceDimension
+#define BOUNCE_ENVIRONMENT 0u // 2D: direction of the explicit skybox sample
+#define BOUNCE_ROULETTE 1u // 1D: specular or diffuse bounce
+#define BOUNCE_DIRECTION 2u // 2D: bounce direction (sampleHemisphere)
+#define BOUNCE_LIGHT_CHOICE 3u // 2D: skybox or light sample, and which light (wavefront.glsl)
+#define BOUNCE_LIGHT_POINT 4u // 2D, and 1D at BOUNCE_LIGHT_POINT + 1: point on the light sphere (wavefront.glsl)
+
+uniform sampler2D u_blueNoiseTexture; // See BlueNoise
+
+struct Sampler {
+	ivec2 pixel;
+	uint index; // Index of the sample in the accumulation, see Renderer::SampleCount
+};
+
+// PCG hash (Jarzynski & Olano 2020, "Hash Functions for GPU Rendering")
+uint pcgHash(uint value) {
+	uint state = value * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+uint hashCombine(uint seed, uint value) {
+	return pcgHash(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+uint bounceDimension(int depth, uint offset) {
+	return DIMENSION_BOUNCES + uint(depth) * DIMENSIONS_PER_BOUNCE + offset;
+}
+
+// Owen scrambling: every bit is flipped or not depending on a hash of the bits above it. Uses the Laine-Karras
+// permutation on the reversed bits, with Burley's constants.
+uint nestedUniformScramble(uint x, uint seed) {
+	x = bitfieldReverse(x);
+	x ^= x * 0x3d20adeau;
+	x += seed;
+	x *= (seed >> 16) | 1u;
+	x ^= x * 0x05526c56u;
+	x ^= x * 0x53a22864u;
+	return bitfieldReverse(x);
+}
+
+// Second dimension of the Sobol sequence. The first one is bitfieldReverse(index).
+uint sobolSecondDimension(uint index) {
+	uint result = 0u;
+	for (uint direction = 1u << 31; index != 0u; index >>= 1, direction ^= direction >> 1) {
+		if ((index & 1u) != 0u) result ^= direction;
+	}
+	return result;
+}
+
+uint dimensionSeed(Sampler sampler, uint dimension) {
+	// Every tile scrambles its own way, so the tiles don't repeat the same error pattern across the image
+	uvec2 tile = uvec2(sampler.pixel / BLUE_NOISE_SIZE);
+	return hashCombine(hashCombine(pcgHash(dimension), tile.x), tile.y);
+}
+
+// Every dimension reads the tile at its own offset, so the pixel isn't shifted the same way in all of them
+vec2 blueNoiseShift(Sampler sampler, uint seed) {
+	ivec2 texel = (sampler.pixel + ivec2(seed & 63u, (seed >> 8) & 63u)) & (BLUE_NOISE_SIZE - 1);
+	// The tile uses its 256 levels equally often, so the middle of each level's interval is uniformly distributed
+	return (texelFetch(u_blueNoiseTexture, texel, 0).rg * 255.0 + 0.5) / 256.0;
+}
+
+// [0, 1) from the upper 24 bits, all a float can hold in that range
+float unitFloat(uint bits) {
+	return float(bits >> 8) * (1.0 / 16777216.0);
+}
+
+vec2 sample2D(Sampler sampler, uint dimension) {
+	uint seed = dimensionSeed(sampler, dimension);
+	uint index = nestedUniformScramble(sampler.index, seed);
+	uint x = nestedUniformScramble(bitfieldReverse(index), hashCombine(seed, 0u));
+	uint y = nestedUniformScramble(sobolSecondDimension(index), hashCombine(seed, 1u));
+	return fract(vec2(unitFloat(x), unitFloat(y)) + blueNoiseShift(sampler, seed));
+}
+
+float sample1D(Sampler sampler, uint dimension) {
+	uint seed = dimensionSeed(sampler, dimension);
+	uint index = nestedUniformScramble(sampler.index, seed);
+	uint x = nestedUniformScramble(bitfieldReverse(index), hashCombine(seed, 0u));
+	return fract(unitFloat(x) + blueNoiseShift(sampler, seed).x);
+}
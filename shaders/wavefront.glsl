@@ -0,0 +1,350 @@
+#version 430 core
+
+// Wavefront version of computeSceneColor() in fragment.glsl. Every bounce is split into stages that run as separate
+// dispatches and pass rays to each other through queues in storage buffers:
+//   generate   - one camera ray per pixel, all of them go into the extend queue (except converged ones, see
+//                u_adaptiveSampling)
+//   extend     - finds the closest hit of every queued ray, misses pick up the skybox and end there
+//   shade      - emission, specular highlights and the next bounce; queues a shadow ray and the bounced ray
+//   shadow     - adds the light carried by each shadow ray that reaches its light
+//   accumulate - averages the samples of every pixel and adds them to the accumulation texture
+// prepare runs on a single thread between stages and turns queue lengths into indirect dispatch sizes, so the CPU never
+// waits for a queue length. Wavefront::Init compiles this file once per stage with one of the STAGE_* defines.
+
+#include "common.glsl"
+
+#define WORKGROUP_SIZE 64 // Must match Wavefront::WorkgroupSize
+#define MAX_DISPATCH_WIDTH 65535u // Must match Wavefront::MaxDispatchWidth
+
+#define PREPARE_EXTEND 0
+#define PREPARE_SHADE 1
+#define PREPARE_SHADOW 2
+#define PREPARE_GENERATE 3
+
+layout(local_size_x = WORKGROUP_SIZE) in;
+
+// One per pixel, indexed like the pixels of the accumulation texture
+struct Path {
+	vec3 origin;
+	int depth;
+	vec3 direction;
+	uint sampleIndex; // See Sampler
+	vec3 energy;
+	float hitDistance; // Written by extend for shade
+	vec3 radiance; // Sum of this pass's samples
+	int hitObject;
+	float bouncePdf; // Of the last bounce, see environmentMisWeight
+	float environmentChance; // Chance the last shade took an explicit skybox sample with, see environmentSampleChance
+};
+
+struct ShadowRay {
+	vec3 origin;
+	uint path;
+	vec3 direction;
+	float maxDistance;
+	vec3 contribution; // Added to the path's radiance if nothing is in the way
+	float padding;
+};
+
+layout(std430, binding = 5) buffer Paths {
+	Path paths[];
+};
+
+// The counters double as indirect dispatch arguments, so this buffer is also bound to GL_DISPATCH_INDIRECT_BUFFER
+layout(std430, binding = 6) buffer RayQueues {
+	uint extendCount[2];
+	uint shadeCount;
+	uint shadowCount;
+	uvec4 extendDispatch;
+	uvec4 shadeDispatch;
+	uvec4 shadowDispatch;
+	uint queueEntries[]; // Two extend queues (read and written alternately by each bounce), then the shade queue
+};
+
+layout(std430, binding = 7) buffer ShadowRays {
+	ShadowRay shadowRays[];
+};
+
+layout(rgba32f, binding = 0) uniform image2D u_accumulation; // Running mean of the accumulated passes
+layout(rgba32f, binding = 1) uniform image2D u_compensation; // See addToRunningMean
+layout(rgba32f, binding = 2) uniform image2D u_moments; // See addToMoments
+
+uniform uint u_pathCount;
+uniform ivec2 u_resolution;
+uniform int u_accumulatedPasses;
+uniform uint u_firstSample; // Sample index of this pass' first sample, see Renderer::SampleCount
+uniform int u_sample; // Index of the sample being traced within the pass
+uniform int u_bounce;
+uniform int u_prepareStage;
+uniform vec3 u_cameraPosition;
+uniform mat4 u_rotationMatrix;
+uniform float u_aspectRatio;
+
+ivec2 pathPixel(uint path) {
+	return ivec2(path % u_resolution.x, path / u_resolution.x);
+}
+
+// Sampled once per pass, like in fragment.glsl
+Ray cameraRay(uint path) {
+	ivec2 pixel = pathPixel(path);
+	vec2 uv = (vec2(pixel) + 0.5) / vec2(u_resolution);
+	vec2 centeredUV = (uv * 2 - vec2(1)) * vec2(u_aspectRatio, 1.0);
+	if (u_blur > 0.0 && u_accumulatedPasses > 0) centeredUV += (sample2D(Sampler(pixel, u_firstSample), DIMENSION_PIXEL) - 0.5) * u_blur;
+	vec3 rayDir = (normalize(vec4(centeredUV, -1.0, 0.0)) * u_rotationMatrix).xyz;
+	return Ray(u_cameraPosition, rayDir);
+}
+
+// Chance that shade queues the shadow ray of an explicit skybox sample rather than of a light in reach
+float environmentSampleChance(uint lightsInReach) {
+	return lightsInReach > 0 ? 0.5 : 1.0;
+}
+
+// Dispatches have at most MAX_DISPATCH_WIDTH work groups along x, larger ones continue in rows along y. Without them,
+// a 4K target needs more work groups than the minimum GL_MAX_COMPUTE_WORK_GROUP_COUNT.
+uvec4 dispatchSize(uint count) {
+	uint groups = (count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+	uint width = min(groups, MAX_DISPATCH_WIDTH);
+	return uvec4(width, width == 0u ? 1u : (groups + width - 1u) / width, 1, 0);
+}
+
+// Index of this invocation in the grid of dispatchSize (or Wavefront::DispatchInvocations)
+uint invocationIndex() {
+	return (gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) * WORKGROUP_SIZE + gl_LocalInvocationID.x;
+}
+
+#if defined(STAGE_GENERATE)
+
+void main() {
+	uint path = invocationIndex();
+	if (path >= u_pathCount) return;
+
+	Ray ray = cameraRay(path);
+	paths[path].origin = ray.origin;
+	paths[path].direction = ray.direction;
+	paths[path].depth = 0;
+	paths[path].sampleIndex = u_firstSample + uint(u_sample);
+	paths[path].energy = vec3(1.0);
+	paths[path].bouncePdf = 0.0;
+	paths[path].environmentChance = 0.0;
+	if (u_sample == 0) paths[path].radiance = vec3(0.0);
+
+	if (u_adaptiveSampling && u_accumulatedPasses > 0) {
+		// Only pixels of unconverged tiles are traced; the prepare stage has reset the queue length
+		if (tileConverged(pathPixel(path), u_resolution)) return;
+		queueEntries[atomicAdd(extendCount[0], 1)] = path;
+		return;
+	}
+
+	// Every path starts out active, so the first extend queue is simply all of them in order
+	queueEntries[path] = path;
+	if (path == 0) extendCount[0] = u_pathCount;
+}
+
+#elif defined(STAGE_PREPARE)
+
+void main() {
+	if (u_prepareStage == PREPARE_EXTEND) {
+		extendDispatch = dispatchSize(extendCount[u_bounce & 1]);
+		extendCount[(u_bounce + 1) & 1] = 0;
+		shadeCount = 0;
+		shadowCount = 0;
+	} else if (u_prepareStage == PREPARE_GENERATE) {
+		extendCount[0] = 0;
+	} else if (u_prepareStage == PREPARE_SHADE) {
+		shadeDispatch = dispatchSize(shadeCount);
+	} else {
+		shadowDispatch = dispatchSize(shadowCount);
+	}
+}
+
+#elif defined(STAGE_EXTEND)
+
+void main() {
+	uint queue = uint(u_bounce & 1);
+	uint entry = invocationIndex();
+	if (entry >= extendCount[queue]) return;
+	uint path = queueEntries[queue * u_pathCount + entry];
+
+	Ray ray = Ray(paths[path].origin, paths[path].direction);
+	float hitDistance;
+	int hit = closestHit(ray, hitDistance);
+	if (hit == -1) {
+		// The ray didn't hit anything, so we add the sky's color and we're done
+		paths[path].radiance += paths[path].energy * sampleSkybox(ray.direction) * environmentMisWeight(ray.direction, paths[path].bouncePdf, paths[path].environmentChance);
+		return;
+	}
+
+	paths[path].hitDistance = hitDistance;
+	paths[path].hitObject = hit;
+	queueEntries[2 * u_pathCount + atomicAdd(shadeCount, 1)] = path;
+}
+
+#elif defined(STAGE_SHADE)
+
+void main() {
+	uint entry = invocationIndex();
+	if (entry >= shadeCount) return;
+	uint pathIndex = queueEntries[2 * u_pathCount + entry];
+	Path path = paths[pathIndex];
+
+	SurfacePoint hitPoint = surfaceAt(Ray(path.origin, path.direction), path.hitObject, path.hitDistance);
+	Sampler sampler = Sampler(pathPixel(pathIndex), path.sampleIndex);
+	int depth = path.depth;
+
+	// Part one: Hit object's emission
+	path.radiance += path.energy * hitPoint.material.emission * hitPoint.material.emissionStrength;
+
+	// Part two: Direct light. Specular highlights aren't shadowed, so they are added here for every light; the diffuse
+	// light of one randomly picked light is left to the shadow stage.
+	uint firstLight, lastLight;
+	lightsAt(hitPoint.position, firstLight, lastLight);
+	uint lightsInReach = lastLight - firstLight;
+	for (uint i = firstLight; i < lastLight; i++) {
+		PointLight light = u_lights[u_lightGridCells[i]];
+
+		float lightDistance = length(light.position - hitPoint.position);
+		if (lightDistance > light.reach) continue;
+
+		float diffuse = clamp(dot(hitPoint.normal, normalize(light.position-hitPoint.position)), 0.0, 1.0);
+		if (diffuse > EPSILON || hitPoint.material.roughness < 1.0) {
+			vec3 lightDir = normalize(hitPoint.position - light.position);
+			vec3 reflectedLightDir = reflect(lightDir, hitPoint.normal);
+			vec3 cameraDir = normalize(path.origin - hitPoint.position);
+			path.radiance += path.energy * hitPoint.material.specularHighlight * light.color * (light.power/(lightDistance*lightDistance)) * pow(max(dot(cameraDir, reflectedLightDir), 0.0), 1.0/max(hitPoint.material.specularExponent, EPSILON));
+		}
+	}
+
+	// Only one shadow ray per path and bounce: either an explicit skybox sample (see sampleEnvironment) or one light in
+	// reach.
+	// The skybox isn't sampled when the path ends here, since there is no bounce to share its light with.
+	float environmentChance = depth + 1 < u_lightBounces && u_environmentSampling != 0 ? environmentSampleChance(lightsInReach) : 0.0;
+	path.environmentChance = environmentChance;
+	vec3 environmentDir;
+	vec3 environmentLight;
+	vec2 xi = sample2D(sampler, bounceDimension(depth, BOUNCE_ENVIRONMENT));
+	vec2 lightChoice = sample2D(sampler, bounceDimension(depth, BOUNCE_LIGHT_CHOICE));
+	if (lightChoice.x < environmentChance) {
+		if (sampleEnvironment(hitPoint, environmentChance, xi, environmentDir, environmentLight)) {
+			vec3 rayOrigin = hitPoint.position + hitPoint.normal * EPSILON;
+			// Divided by the chance of sampling the skybox
+			vec3 contribution = path.energy * environmentLight / environmentChance;
+			shadowRays[atomicAdd(shadowCount, 1)] = ShadowRay(rayOrigin, pathIndex, environmentDir, RENDER_DISTANCE, contribution, 0.0);
+		}
+	} else if (lightsInReach > 0) {
+		uint lightIndex = firstLight + min(uint(lightChoice.y * float(lightsInReach)), lightsInReach - 1);
+		PointLight light = u_lights[u_lightGridCells[lightIndex]];
+
+		float lightDistance = length(light.position - hitPoint.position);
+		float diffuse = clamp(dot(hitPoint.normal, normalize(light.position-hitPoint.position)), 0.0, 1.0);
+		if (lightDistance <= light.reach && diffuse > EPSILON) {
+			// Sample a point on the light sphere
+			uint dimension = bounceDimension(depth, BOUNCE_LIGHT_POINT);
+			vec3 pointXi = vec3(sample2D(sampler, dimension), sample1D(sampler, dimension + 1u));
+			vec3 lightSurfacePoint = light.position + normalize(pointXi) * light.radius;
+			vec3 lightDir = normalize(lightSurfacePoint - hitPoint.position);
+			vec3 rayOrigin = hitPoint.position + lightDir * EPSILON * 2.0;
+
+			// Divided by the chance of picking this light
+			vec3 contribution = path.energy * light.color * light.power * diffuse * hitPoint.material.albedo / (lightDistance * lightDistance) * float(lightsInReach) / (1.0 - environmentChance);
+			shadowRays[atomicAdd(shadowCount, 1)] = ShadowRay(rayOrigin, pathIndex, lightDir, length(lightSurfacePoint - rayOrigin), contribution, 0.0);
+		}
+	}
+
+	// Part three: Indirect light (other objects + skybox)
+	float specChance = dot(hitPoint.material.specular, vec3(1.0/3.0));
+	float diffChance = dot(hitPoint.material.albedo, vec3(1.0/3.0));
+
+	float sum = specChance + diffChance;
+	specChance /= sum;
+	diffChance /= sum;
+
+	// Roulette-select the ray's path
+	bool bounced = true;
+	float roulette = sample1D(sampler, bounceDimension(depth, BOUNCE_ROULETTE));
+	if (roulette < specChance)
+	{
+		// Specular reflection
+		float smoothness = 1.0-hitPoint.material.roughness;
+		float alpha = pow(1000.0, smoothness*smoothness);
+		if (smoothness == 1.0) {
+			path.direction = reflect(path.direction, hitPoint.normal);
+		} else {
+			path.direction = sampleHemisphere(reflect(path.direction, hitPoint.normal), alpha, sample2D(sampler, bounceDimension(depth, BOUNCE_DIRECTION)));
+		}
+		path.origin = hitPoint.position + path.direction * EPSILON;
+		float f = (alpha + 2) / (alpha + 1);
+		path.energy *= hitPoint.material.specular * clamp(dot(hitPoint.normal, path.direction) * f, 0.0, 1.0);
+		path.bouncePdf = 0.0;
+	}
+	else if (diffChance > 0 && roulette < specChance + diffChance)
+	{
+		// Diffuse reflection
+		path.origin = hitPoint.position + hitPoint.normal * EPSILON;
+		path.direction = sampleHemisphere(hitPoint.normal, 1.0, sample2D(sampler, bounceDimension(depth, BOUNCE_DIRECTION)));
+		path.energy *= hitPoint.material.albedo * clamp(dot(hitPoint.normal, path.direction), 0.0, 1.0);
+		path.bouncePdf = diffChance * max(dot(hitPoint.normal, path.direction), 0.0) / PI;
+	} else {
+		// Both the albedo and the specular color are black, no more light can come from this path
+		bounced = false;
+	}
+
+	path.depth++;
+	paths[pathIndex] = path;
+	if (bounced && path.depth < u_lightBounces) {
+		uint nextQueue = uint((u_bounce + 1) & 1);
+		queueEntries[nextQueue * u_pathCount + atomicAdd(extendCount[nextQueue], 1)] = pathIndex;
+	}
+}
+
+#elif defined(STAGE_SHADOW)
+
+void main() {
+	uint entry = invocationIndex();
+	if (entry >= shadowCount) return;
+	ShadowRay shadowRay = shadowRays[entry];
+
+	if (!occluded(Ray(shadowRay.origin, shadowRay.direction), shadowRay.maxDistance)) {
+		// Each path queues at most one shadow ray per bounce, so no other invocation writes this radiance
+		paths[shadowRay.path].radiance += shadowRay.contribution;
+	}
+}
+
+#elif defined(STAGE_ACCUMULATE)
+
+void main() {
+	uint path = invocationIndex();
+	if (path >= u_pathCount) return;
+	ivec2 pixel = pathPixel(path);
+	// Converged pixels weren't traced and keep their current values
+	if (u_adaptiveSampling && u_accumulatedPasses > 0 && tileConverged(pixel, u_resolution)) return;
+
+	vec3 color = paths[path].radiance / u_framePasses;
+
+	vec3 mean = vec3(0.0);
+	vec3 compensation = vec3(0.0);
+	vec4 moments = vec4(0.0);
+	if (u_accumulatedPasses > 0) {
+		// Bloom
+		Ray ray = cameraRay(path);
+		SurfacePoint hitPoint;
+		Sampler passSampler = Sampler(pixel, u_firstSample);
+		vec3 bloomXi = vec3(sample2D(passSampler, DIMENSION_BLOOM), sample1D(passSampler, DIMENSION_BLOOM + 1u));
+		vec3 offsetDirection = ray.direction + (bloomXi - 0.5) * u_bloomRadius;
+		if (raycast(Ray(ray.origin, offsetDirection), hitPoint)) {
+			color += hitPoint.material.emission*hitPoint.material.emissionStrength*u_bloomIntensity;
+		}
+
+		// Last frame's mean (progressive sampling). Every invocation only touches its own pixel, so it is updated in
+		// place.
+		mean = imageLoad(u_accumulation, pixel).rgb;
+		compensation = imageLoad(u_compensation, pixel).rgb;
+		moments = imageLoad(u_moments, pixel);
+	}
+
+	addToRunningMean(color, int(moments.y), mean, compensation);
+	imageStore(u_accumulation, pixel, vec4(mean, 1.0));
+	imageStore(u_compensation, pixel, vec4(compensation, 0.0));
+	imageStore(u_moments, pixel, addToMoments(color, moments));
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include "adaptive.h"
+
+#include "renderer.h"
+
+namespace Adaptive
+{
+    bool Enabled = false;
+    float Threshold = 0.01f;
+    int MinPasses = 16;
+    bool ShowSampleCount = false;
+
+    GLuint Program;
+    GLint ThresholdUniformLocation, MinPassesUniformLocation;
+
+    GLuint MaskBuffer;
+    GLuint AllocatedTileCount = 0;
+
+    bool SetEnabled(const bool enabled)
+    {
+        if (enabled && !Program)
+        {
+            Program = Renderer::CreateComputeProgram("shaders\\convergence.glsl", "");
+
+            GLint linked = GL_FALSE;
+            if (Program) glGetProgramiv(Program, GL_LINK_STATUS, &linked);
+            glUseProgram(Renderer::ShaderProgram);
+            if (!linked)
+            {
+                Delete();
+                return false;
+            }
+
+            ThresholdUniformLocation = glGetUniformLocation(Program, "u_threshold");
+            MinPassesUniformLocation = glGetUniformLocation(Program, "u_minPasses");
+        }
+
+        Enabled = enabled;
+        return true;
+    }
+
+    void Delete()
+    {
+        glDeleteProgram(Program);
+        glDeleteBuffers(1, &MaskBuffer);
+        Program = MaskBuffer = 0;
+        AllocatedTileCount = 0;
+        Enabled = false;
+    }
+
+    void UpdateMask()
+    {
+        const GLuint tilesX = (static_cast<GLuint>(Renderer::TargetWidth) + TileSize - 1) / TileSize;
+        const GLuint tilesY = (static_cast<GLuint>(Renderer::TargetHeight) + TileSize - 1) / TileSize;
+        if (tilesX * tilesY != AllocatedTileCount)
+        {
+            if (!MaskBuffer) glGenBuffers(1, &MaskBuffer);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, MaskBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, tilesX * tilesY * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MaskBinding, MaskBuffer);
+            AllocatedTileCount = tilesX * tilesY;
+        }
+
+        const Renderer::AccumulationTarget& target = Renderer::Targets[Renderer::CurrentTarget];
+        glBindImageTexture(0, target.m_MeanTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        glBindImageTexture(2, target.m_MomentsTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+
+        glUseProgram(Program);
+        glUniform1f(ThresholdUniformLocation, Threshold);
+        glUniform1i(MinPassesUniformLocation, MinPasses);
+        glDispatchCompute(tilesX, tilesY, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(Renderer::ShaderProgram);
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Adaptive sampling: after every pass, convergence.glsl marks the tiles of the accumulation target whose pixels are
+// no longer noisy, and both backends stop tracing the pixels of those tiles.
+namespace Adaptive
+{
+    // Must match TILE_SIZE in common.glsl
+    constexpr GLuint TileSize = 16;
+    // Shader storage buffer binding point of the ConvergenceMask block in common.glsl
+    constexpr GLuint MaskBinding = 8;
+
+    extern bool Enabled;
+    // Standard error of a pixel's mean, relative to its brightness, below which it counts as converged
+    extern float Threshold;
+    // Passes every pixel receives before its variance estimate is trusted
+    extern int MinPasses;
+    // Makes the display pass show the number of passes of every pixel
+    extern bool ShowSampleCount;
+
+    // Compiles convergence.glsl the first time adaptive sampling is enabled. Returns false (and leaves it disabled) if
+    // it doesn't compile.
+    bool SetEnabled(bool enabled);
+    void Delete();
+
+    // Re-evaluates every tile of Renderer::Targets[Renderer::CurrentTarget] after a pass has been added to it
+    void UpdateMask();
+}
@@ -0,0 +1,184 @@
+#include "blue_noise.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <random>
+
+#include "stb_image.h"
+#include "stb_image_write.h"
+
+namespace BlueNoise
+{
+    // Standard deviation of the Gaussian each set pixel spreads its energy with, in pixels (Ulichney's choice)
+    constexpr float Sigma = 1.5f;
+    // Share of the pixels set in the initial random pattern
+    constexpr float InitialDensity = 0.1f;
+
+    std::vector<unsigned char> Texels;
+    GLuint Texture = 0;
+
+    // Sum of a Gaussian around every set pixel of a mask, wrapping around its edges so the tile repeats seamlessly
+    struct EnergyField
+    {
+        int m_Size;
+        std::vector<float> m_Kernel; // Weight of every (wrapped) offset from the centre
+        std::vector<float> m_Energy;
+
+        explicit EnergyField(const int size) : m_Size(size), m_Kernel(size * size), m_Energy(size * size, 0.0f)
+        {
+            for (int y = 0; y < size; y++)
+            {
+                for (int x = 0; x < size; x++)
+                {
+                    const float dx = static_cast<float>(std::min(x, size - x));
+                    const float dy = static_cast<float>(std::min(y, size - y));
+                    m_Kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * Sigma * Sigma));
+                }
+            }
+        }
+
+        // Adds (sign 1) or removes (sign -1) the energy of a pixel that was set or cleared
+        void Apply(const int pixel, const float sign)
+        {
+            const int mask = m_Size - 1;
+            const int px = pixel % m_Size, py = pixel / m_Size;
+            for (int y = 0; y < m_Size; y++)
+            {
+                const int row = ((y - py) & mask) * m_Size;
+                for (int x = 0; x < m_Size; x++) m_Energy[y * m_Size + x] += sign * m_Kernel[row + ((x - px) & mask)];
+            }
+        }
+
+        // The set pixel with the most energy (tightest cluster) or the clear one with the least (largest void)
+        int Extreme(const std::vector<char>& pattern, const bool set) const
+        {
+            int best = -1;
+            for (int i = 0; i < static_cast<int>(m_Energy.size()); i++)
+            {
+                if (static_cast<bool>(pattern[i]) != set) continue;
+                if (best < 0 || (set ? m_Energy[i] > m_Energy[best] : m_Energy[i] < m_Energy[best])) best = i;
+            }
+            return best;
+        }
+    };
+
+    std::vector<uint32_t> GenerateMask(const int size, const uint32_t seed)
+    {
+        const int pixelCount = size * size;
+        std::mt19937 random(seed);
+        std::vector<char> pattern(pixelCount, 0);
+        EnergyField field(size);
+
+        const int initialCount = std::max(1, static_cast<int>(static_cast<float>(pixelCount) * InitialDensity));
+        for (int placed = 0; placed < initialCount;)
+        {
+            const int pixel = static_cast<int>(random() % static_cast<uint32_t>(pixelCount));
+            if (pattern[pixel]) continue;
+            pattern[pixel] = 1;
+            field.Apply(pixel, 1.0f);
+            placed++;
+        }
+
+        // Moves the tightest cluster into the largest void until that void is where the cluster came from
+        while (true)
+        {
+            const int cluster = field.Extreme(pattern, true);
+            pattern[cluster] = 0;
+            field.Apply(cluster, -1.0f);
+            const int largestVoid = field.Extreme(pattern, false);
+            pattern[largestVoid] = 1;
+            field.Apply(largestVoid, 1.0f);
+            if (largestVoid == cluster) break;
+        }
+
+        std::vector<uint32_t> ranks(pixelCount);
+        const std::vector<char> prototype = pattern;
+        const EnergyField prototypeField = field;
+
+        // The pixels of the initial pattern are ranked by taking out the tightest cluster one at a time
+        for (int rank = initialCount - 1; rank >= 0; rank--)
+        {
+            const int cluster = field.Extreme(pattern, true);
+            pattern[cluster] = 0;
+            field.Apply(cluster, -1.0f);
+            ranks[cluster] = static_cast<uint32_t>(rank);
+        }
+
+        // And the others by filling the largest void. Past half the pixels, Ulichney looks for the tightest cluster of
+        // clear pixels instead, but the energies of set and clear pixels add up to the same constant everywhere, so
+        // that is the same pixel.
+        pattern = prototype;
+        field = prototypeField;
+        for (int rank = initialCount; rank < pixelCount; rank++)
+        {
+            const int largestVoid = field.Extreme(pattern, false);
+            pattern[largestVoid] = 1;
+            field.Apply(largestVoid, 1.0f);
+            ranks[largestVoid] = static_cast<uint32_t>(rank);
+        }
+
+        return ranks;
+    }
+
+    bool Write(const char* path)
+    {
+        const int pixelCount = Size * Size;
+        std::vector<unsigned char> texels(static_cast<size_t>(pixelCount) * 2);
+        for (int channel = 0; channel < 2; channel++)
+        {
+            const std::vector<uint32_t> ranks = GenerateMask(Size, static_cast<uint32_t>(channel + 1));
+            // Every 8-bit value is used by the same number of pixels
+            for (int i = 0; i < pixelCount; i++)
+            {
+                texels[i * 2 + channel] =
+                    static_cast<unsigned char>(ranks[i] * 256 / static_cast<uint32_t>(pixelCount));
+            }
+        }
+
+        const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+        std::error_code error;
+        if (!directory.empty()) std::filesystem::create_directories(directory, error);
+        return stbi_write_png(path, Size, Size, 2, texels.data(), Size * 2) != 0;
+    }
+
+    void Load()
+    {
+        int width = 0, height = 0, channels = 0;
+        unsigned char* loaded = stbi_load(FilePath, &width, &height, &channels, 2);
+        if (loaded && width == Size && height == Size)
+        {
+            Texels.assign(loaded, loaded + Size * Size * 2);
+        }
+        else
+        {
+            std::cout << "Failed to load " << FilePath << ", shifting the samples by white noise instead\n";
+            std::mt19937 random(1);
+            Texels.resize(Size * Size * 2);
+            for (unsigned char& texel : Texels) texel = static_cast<unsigned char>(random() >> 24);
+        }
+        stbi_image_free(loaded);
+    }
+
+    void Init()
+    {
+        if (Texels.empty()) Load();
+
+        if (!Texture) glGenTextures(1, &Texture);
+        glActiveTexture(GL_TEXTURE0 + TextureUnit);
+        glBindTexture(GL_TEXTURE_2D, Texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, Size, Size, 0, GL_RG, GL_UNSIGNED_BYTE, Texels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void Delete()
+    {
+        glDeleteTextures(1, &Texture);
+        Texture = 0;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+
+// Tile of blue noise the shaders shift their sample points by, one independent mask in each of its red and green
+// channels (see sampler.glsl). The tile is generated offline with the void-and-cluster method (Ulichney 1993) by
+// "opengl-raytracing-headless --generate-blue-noise" and loaded from FilePath at startup.
+namespace BlueNoise
+{
+    // Texels along each side of the tile
+    constexpr int Size = 64;
+    // Texture unit the tile stays bound to, for u_blueNoiseTexture. No other pass binds anything to it: units 0 to 7
+    // are taken by the accumulation, skybox, G-buffer, denoiser and reprojection textures.
+    constexpr GLint TextureUnit = 8;
+    constexpr const char* FilePath = "textures\\blue_noise.png";
+
+    // size * size ranks (0 to size * size - 1), each pixel's position in the order void-and-cluster fills the mask
+    // in. Pixels of similar rank are spread evenly over the torus. size must be a power of two.
+    std::vector<uint32_t> GenerateMask(int size, uint32_t seed);
+    // Generates the two masks and writes them as a two-channel PNG. Returns false if the file couldn't be written.
+    bool Write(const char* path);
+
+    // Red and green of every texel of the tile, rows in the order they are uploaded (texel y is row y). Filled by Load.
+    extern std::vector<unsigned char> Texels;
+
+    // Loads the tile into Texels. Without the file, white noise is used instead: the image converges to the same
+    // result, only its error isn't spread as evenly at low sample counts. Needs no OpenGL context, see CpuTracer.
+    void Load();
+    // Loads the tile unless it already is and binds it to TextureUnit
+    void Init();
+    void Delete();
+}
@@ -0,0 +1,272 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <limits>
+#include <glm/glm.hpp>
+
+#include "scene.h"
+
+namespace Bvh
+{
+    constexpr int BinCount = 16;
+    constexpr int MaxLeafSize = 4;
+    constexpr int MaxDepth = 64; // Must not exceed BVH_STACK_SIZE in common.glsl
+
+    std::vector<Node> Nodes;
+    std::vector<int> ObjectIndices;
+    GLuint NodeBuffer, ObjectIndexBuffer;
+
+    bool RebuildRequired = true;
+    bool RefitRequired = false;
+
+    struct Bounds
+    {
+        glm::vec3 m_Min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 m_Max = glm::vec3(-std::numeric_limits<float>::max());
+
+        void Grow(const Bounds& other)
+        {
+            m_Min = glm::min(m_Min, other.m_Min);
+            m_Max = glm::max(m_Max, other.m_Max);
+        }
+
+        void Grow(const glm::vec3 point)
+        {
+            m_Min = glm::min(m_Min, point);
+            m_Max = glm::max(m_Max, point);
+        }
+
+        float Area() const
+        {
+            const glm::vec3 extent = m_Max - m_Min;
+            return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+        }
+    };
+
+    // Bounds of the objects being built, indexed like Scene::Objects
+    std::vector<Bounds> ObjectBounds;
+
+    Bounds ComputeObjectBounds(const Scene::Object& object)
+    {
+        const glm::vec3 position(object.m_Position[0], object.m_Position[1], object.m_Position[2]);
+        const glm::vec3 halfSize = object.m_Type == 1
+                                       ? glm::vec3(object.m_Scale[0])
+                                       : glm::vec3(object.m_Scale[0], object.m_Scale[1], object.m_Scale[2]) * 0.5f;
+        return {position - halfSize, position + halfSize};
+    }
+
+    void SetNodeBounds(Node& node, const Bounds& bounds)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            node.m_BoundsMin[axis] = bounds.m_Min[axis];
+            node.m_BoundsMax[axis] = bounds.m_Max[axis];
+        }
+    }
+
+    Bounds LeafBounds(const Node& node)
+    {
+        Bounds bounds;
+        for (int i = node.m_LeftFirst; i < node.m_LeftFirst + node.m_Count; i++)
+        {
+            bounds.Grow(ObjectBounds[ObjectIndices[i]]);
+        }
+        return bounds;
+    }
+
+    void Subdivide(const int nodeIndex, const int depth)
+    {
+        const int first = Nodes[nodeIndex].m_LeftFirst;
+        const int count = Nodes[nodeIndex].m_Count;
+
+        const Bounds nodeBounds = LeafBounds(Nodes[nodeIndex]);
+        SetNodeBounds(Nodes[nodeIndex], nodeBounds);
+        if (count <= 1 || depth >= MaxDepth) return;
+
+        Bounds centroidBounds;
+        for (int i = first; i < first + count; i++)
+        {
+            const Bounds& bounds = ObjectBounds[ObjectIndices[i]];
+            centroidBounds.Grow((bounds.m_Min + bounds.m_Max) * 0.5f);
+        }
+
+        // Binned SAH: sweep the bin boundaries of every axis and keep the cheapest split
+        int bestAxis = -1, bestSplit = 0;
+        float bestCost = std::numeric_limits<float>::max();
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float extent = centroidBounds.m_Max[axis] - centroidBounds.m_Min[axis];
+            if (extent <= 0.0f) continue;
+            const float binScale = BinCount / extent;
+
+            Bounds binBounds[BinCount];
+            int binCounts[BinCount] = {};
+            for (int i = first; i < first + count; i++)
+            {
+                const Bounds& bounds = ObjectBounds[ObjectIndices[i]];
+                const float centroid = (bounds.m_Min[axis] + bounds.m_Max[axis]) * 0.5f;
+                const int bin = std::min(BinCount - 1, static_cast<int>((centroid - centroidBounds.m_Min[axis]) *
+                                                                        binScale));
+                binBounds[bin].Grow(bounds);
+                binCounts[bin]++;
+            }
+
+            float leftAreas[BinCount - 1];
+            int leftCounts[BinCount - 1];
+            Bounds left;
+            int leftCount = 0;
+            for (int split = 0; split < BinCount - 1; split++)
+            {
+                left.Grow(binBounds[split]);
+                leftCount += binCounts[split];
+                leftAreas[split] = leftCount > 0 ? left.Area() : 0.0f;
+                leftCounts[split] = leftCount;
+            }
+
+            Bounds right;
+            int rightCount = 0;
+            for (int split = BinCount - 2; split >= 0; split--)
+            {
+                right.Grow(binBounds[split + 1]);
+                rightCount += binCounts[split + 1];
+                if (leftCounts[split] == 0 || rightCount == 0) continue;
+
+                const float cost = leftAreas[split] * static_cast<float>(leftCounts[split]) + right.Area() *
+                    static_cast<float>(rightCount);
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        // All centroids coincide, or splitting costs more than intersecting every object in a small leaf
+        if (bestAxis == -1) return;
+        if (count <= MaxLeafSize && bestCost >= nodeBounds.Area() * static_cast<float>(count)) return;
+
+        const float binScale = BinCount / (centroidBounds.m_Max[bestAxis] - centroidBounds.m_Min[bestAxis]);
+        const int* middle = std::partition(&ObjectIndices[first], &ObjectIndices[first] + count, [&](const int object)
+        {
+            const Bounds& bounds = ObjectBounds[object];
+            const float centroid = (bounds.m_Min[bestAxis] + bounds.m_Max[bestAxis]) * 0.5f;
+            return std::min(BinCount - 1, static_cast<int>((centroid - centroidBounds.m_Min[bestAxis]) * binScale))
+                <= bestSplit;
+        });
+        const int leftCount = static_cast<int>(middle - &ObjectIndices[first]);
+        if (leftCount == 0 || leftCount == count) return;
+
+        const int leftChild = static_cast<int>(Nodes.size());
+        Nodes.push_back({{}, first, {}, leftCount});
+        Nodes.push_back({{}, first + leftCount, {}, count - leftCount});
+        Nodes[nodeIndex].m_LeftFirst = leftChild;
+        Nodes[nodeIndex].m_Count = 0;
+
+        Subdivide(leftChild, depth + 1);
+        Subdivide(leftChild + 1, depth + 1);
+    }
+
+    void MarkRebuild()
+    {
+        RebuildRequired = true;
+    }
+
+    void MarkRefit()
+    {
+        RefitRequired = true;
+    }
+
+    void Build()
+    {
+        ObjectBounds.resize(Scene::Objects.size());
+        ObjectIndices.clear();
+        for (size_t i = 0; i < Scene::Objects.size(); i++)
+        {
+            if (Scene::Objects[i].m_Type == 0) continue;
+            ObjectBounds[i] = ComputeObjectBounds(Scene::Objects[i]);
+            ObjectIndices.push_back(static_cast<int>(i));
+        }
+
+        // An empty scene still gets a root so the buffer isn't empty. Its m_LeftFirst and m_Count are both 0, which no
+        // real node can have (children are never stored at index 0), and raycast() skips it.
+        Nodes.clear();
+        Nodes.reserve(ObjectIndices.size() * 2 + 1);
+        Nodes.push_back({{}, 0, {}, static_cast<int>(ObjectIndices.size())});
+        Subdivide(0, 0);
+
+        RebuildRequired = false;
+        RefitRequired = false;
+    }
+
+    void Refit()
+    {
+        RefitRequired = false;
+        if (ObjectIndices.empty()) return;
+
+        for (const int object : ObjectIndices)
+        {
+            ObjectBounds[object] = ComputeObjectBounds(Scene::Objects[object]);
+        }
+
+        // Children are always stored after their parent, so a reverse sweep visits them first
+        for (size_t i = Nodes.size(); i-- > 0;)
+        {
+            Node& node = Nodes[i];
+            if (node.m_Count > 0)
+            {
+                SetNodeBounds(node, LeafBounds(node));
+                continue;
+            }
+
+            const Node& left = Nodes[node.m_LeftFirst];
+            const Node& right = Nodes[node.m_LeftFirst + 1];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                node.m_BoundsMin[axis] = std::min(left.m_BoundsMin[axis], right.m_BoundsMin[axis]);
+                node.m_BoundsMax[axis] = std::max(left.m_BoundsMax[axis], right.m_BoundsMax[axis]);
+            }
+        }
+    }
+
+    void UploadBuffer(GLuint& buffer, const GLuint binding, const void* data, const size_t size)
+    {
+        if (!buffer) glGenBuffers(1, &buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        // Zero-sized buffers can't be bound, so an empty list still gets one (unused) element
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(std::max(size, sizeof(int))),
+                     size ? data : nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+    }
+
+    bool Update()
+    {
+        if (RebuildRequired)
+        {
+            Build();
+            UploadBuffer(NodeBuffer, NodeBinding, Nodes.data(), Nodes.size() * sizeof(Node));
+            UploadBuffer(ObjectIndexBuffer, ObjectIndexBinding, ObjectIndices.data(),
+                         ObjectIndices.size() * sizeof(int));
+            return true;
+        }
+
+        if (RefitRequired)
+        {
+            Refit();
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, NodeBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, static_cast<GLsizeiptr>(Nodes.size() * sizeof(Node)),
+                            Nodes.data());
+            return true;
+        }
+
+        return false;
+    }
+
+    void Delete()
+    {
+        glDeleteBuffers(1, &NodeBuffer);
+        glDeleteBuffers(1, &ObjectIndexBuffer);
+        NodeBuffer = ObjectIndexBuffer = 0;
+        RebuildRequired = true;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+
+// Bounding volume hierarchy over Scene::Objects, built on the CPU with binned SAH and traversed by closestHit() and
+// occluded() in common.glsl. The nodes and the object index list are uploaded as two shader storage buffers.
+namespace Bvh
+{
+    // Matches BvhNode in common.glsl (std430). Inner nodes have m_Count == 0 and their children at m_LeftFirst and
+    // m_LeftFirst + 1; leaves reference m_Count entries of ObjectIndices starting at m_LeftFirst.
+    struct Node
+    {
+        float m_BoundsMin[3];
+        int m_LeftFirst;
+        float m_BoundsMax[3];
+        int m_Count;
+    };
+
+    static_assert(sizeof(Node) == 32, "Bvh::Node must match the std430 layout of BvhNode");
+
+    // Shader storage buffer binding points used by common.glsl
+    constexpr GLuint NodeBinding = 0;
+    constexpr GLuint ObjectIndexBinding = 1;
+
+    extern std::vector<Node> Nodes;
+    extern std::vector<int> ObjectIndices;
+    extern GLuint NodeBuffer, ObjectIndexBuffer;
+
+    // Objects were added or removed: the tree must be rebuilt.
+    void MarkRebuild();
+    // Objects were moved or resized: refitting the bounds of the existing tree is enough.
+    void MarkRefit();
+
+    void Build();
+    void Refit();
+
+    // Rebuilds or refits the tree if it was marked and uploads it. Returns true if anything was uploaded.
+    bool Update();
+    void Delete();
+}
@@ -0,0 +1,249 @@
+#include "checkpoint.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <GL/glew.h>
+
+#include "adaptive.h"
+#include "hash.h"
+#include "mapped_file.h"
+#include "renderer.h"
+#include "scene.h"
+
+namespace Checkpoint
+{
+    bool Enabled = true;
+    float Interval = 60.0f;
+    int MinPasses = 64;
+
+    constexpr const char* FilePath = "render_checkpoint.bin";
+    // Saves go to this file first and replace FilePath once complete, so a crash while saving keeps the last one
+    constexpr const char* TempFilePath = "render_checkpoint.bin.part";
+
+    constexpr char Magic[8] = {'R', 'T', 'C', 'H', 'K', 'P', 'T', '\0'};
+    constexpr uint32_t Version = 2;
+
+    // Followed by the mean, compensation and moments textures, RGBA32F rows bottom to top
+    struct Header
+    {
+        char m_Magic[8];
+        uint32_t m_Version;
+        int32_t m_Width, m_Height;
+        int32_t m_Passes;
+        uint64_t m_SceneHash;
+        float m_CameraPosition[3];
+        float m_CameraYaw, m_CameraPitch;
+        uint32_t m_SampleCount; // Renderer::SampleCount after the last pass
+    };
+
+    static_assert(sizeof(Header) == 56, "Checkpoint::Header must not contain padding");
+
+    // State of the accumulation after the last Update
+    int RecordedPasses = 0;
+    uint32_t RecordedSampleCount = 0;
+    glm::vec3 RecordedCameraPosition(0.0f);
+    float RecordedCameraYaw = 0.0f, RecordedCameraPitch = 0.0f;
+    bool Unsaved = false;
+    std::chrono::steady_clock::time_point LastSave = std::chrono::steady_clock::now();
+
+    // Header of the checkpoint on disk, read once
+    Header SavedHeader{};
+    bool SavedHeaderLoaded = false;
+
+    // Everything that changes the converged image except the camera. FramePasses is left out since it only changes
+    // how many samples a pass averages, not what they converge to.
+    uint64_t SceneHash(const int width, const int height)
+    {
+        uint64_t hash = Hash::Value(width);
+        hash = Hash::Value(height, hash);
+        hash = Hash::Bytes(Scene::Objects.data(), Scene::Objects.size() * sizeof(Scene::Object), hash);
+        // The padding of materials and lights is never initialized
+        for (const Scene::Material& material : Scene::Materials)
+            hash = Hash::Bytes(&material, offsetof(Scene::Material, m_Padding), hash);
+        hash = Hash::Bytes(&Scene::PlaneMaterial, offsetof(Scene::Material, m_Padding), hash);
+        for (const Scene::PointLight& light : Scene::Lights)
+            hash = Hash::Bytes(&light, offsetof(Scene::PointLight, m_Padding), hash);
+
+        hash = Hash::Value(Scene::PlaneVisible, hash);
+        hash = Hash::Value(Scene::ShadowResolution, hash);
+        hash = Hash::Value(Scene::LightBounces, hash);
+        hash = Hash::Value(Scene::Blur, hash);
+        hash = Hash::Value(Scene::BloomRadius, hash);
+        hash = Hash::Value(Scene::BloomIntensity, hash);
+        hash = Hash::Value(Scene::SkyboxStrength, hash);
+        hash = Hash::Value(Scene::SkyboxGamma, hash);
+        hash = Hash::Value(Scene::SkyboxCeiling, hash);
+        return Hash::Value(Renderer::SkyboxHash, hash);
+    }
+
+    // SceneHash of the current scene and target size. Hashing every object, material and light is only worth it again
+    // after Scene::FlushChanges applied changes, a new skybox or a resize; accumulations restart far more often.
+    uint64_t CachedSceneHash = 0;
+    uint64_t CachedSceneRevision = 0, CachedSkyboxHash = 0;
+    int CachedWidth = -1, CachedHeight = -1;
+
+    uint64_t CurrentSceneHash()
+    {
+        if (CachedWidth != Renderer::TargetWidth || CachedHeight != Renderer::TargetHeight ||
+            CachedSceneRevision != Scene::Revision || CachedSkyboxHash != Renderer::SkyboxHash)
+        {
+            CachedSceneHash = SceneHash(Renderer::TargetWidth, Renderer::TargetHeight);
+            CachedSceneRevision = Scene::Revision;
+            CachedSkyboxHash = Renderer::SkyboxHash;
+            CachedWidth = Renderer::TargetWidth;
+            CachedHeight = Renderer::TargetHeight;
+        }
+        return CachedSceneHash;
+    }
+
+    size_t TextureSize(const int width, const int height)
+    {
+        return static_cast<size_t>(width) * height * 4 * sizeof(float);
+    }
+
+    void Update(const int accumulatedPasses)
+    {
+        RecordedPasses = accumulatedPasses;
+        RecordedSampleCount = Renderer::SampleCount;
+        RecordedCameraPosition = Scene::CameraPosition;
+        RecordedCameraYaw = Scene::CameraYaw;
+        RecordedCameraPitch = Scene::CameraPitch;
+        Unsaved = true;
+
+        const auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<float>(now - LastSave).count() >= Interval) Save();
+    }
+
+    void Save()
+    {
+        if (!Enabled || !Unsaved || RecordedPasses < MinPasses) return;
+        LastSave = std::chrono::steady_clock::now();
+
+        Header header{};
+        std::memcpy(header.m_Magic, Magic, sizeof(Magic));
+        header.m_Version = Version;
+        header.m_Width = Renderer::TargetWidth;
+        header.m_Height = Renderer::TargetHeight;
+        header.m_Passes = RecordedPasses;
+        header.m_SceneHash = CurrentSceneHash();
+        std::memcpy(header.m_CameraPosition, &RecordedCameraPosition, sizeof(header.m_CameraPosition));
+        header.m_CameraYaw = RecordedCameraYaw;
+        header.m_CameraPitch = RecordedCameraPitch;
+        header.m_SampleCount = RecordedSampleCount;
+
+        const size_t textureSize = TextureSize(header.m_Width, header.m_Height);
+        MappedFile::Mapping file;
+        if (!MappedFile::Create(TempFilePath, sizeof(Header) + 3 * textureSize, file)) return;
+
+        auto* data = static_cast<unsigned char*>(file.m_Data);
+        std::memcpy(data, &header, sizeof(Header));
+        // Straight from the textures into the mapping
+        const Renderer::AccumulationTarget& target = Renderer::Targets[Renderer::CurrentTarget];
+        const GLuint textures[3] = {target.m_MeanTexture, target.m_CompensationTexture, target.m_MomentsTexture};
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        for (int i = 0; i < 3; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, data + sizeof(Header) + i * textureSize);
+        }
+        MappedFile::Close(file);
+
+        std::error_code error;
+        std::filesystem::rename(TempFilePath, FilePath, error);
+        if (error) return;
+
+        SavedHeader = header;
+        SavedHeaderLoaded = true;
+        Unsaved = false;
+    }
+
+    void Discard()
+    {
+        Unsaved = false;
+    }
+
+    const Header* LoadHeader()
+    {
+        if (!SavedHeaderLoaded)
+        {
+            SavedHeaderLoaded = true;
+            MappedFile::Mapping file;
+            if (MappedFile::Open(FilePath, file))
+            {
+                if (file.m_Size >= sizeof(Header)) std::memcpy(&SavedHeader, file.m_Data, sizeof(Header));
+                MappedFile::Close(file);
+            }
+        }
+
+        const bool valid = !std::memcmp(SavedHeader.m_Magic, Magic, sizeof(Magic)) &&
+            SavedHeader.m_Version == Version && SavedHeader.m_Passes > 0;
+        return valid ? &SavedHeader : nullptr;
+    }
+
+    bool MatchesScene(const Header& header)
+    {
+        return header.m_Width == Renderer::TargetWidth && header.m_Height == Renderer::TargetHeight &&
+            header.m_SceneHash == CurrentSceneHash();
+    }
+
+    bool MatchesCamera(const Header& header)
+    {
+        return !std::memcmp(header.m_CameraPosition, &Scene::CameraPosition, sizeof(header.m_CameraPosition)) &&
+            header.m_CameraYaw == Scene::CameraYaw && header.m_CameraPitch == Scene::CameraPitch;
+    }
+
+    void AdoptCamera()
+    {
+        const Header* header = LoadHeader();
+        if (!Enabled || !header || !MatchesScene(*header)) return;
+
+        Scene::CameraPosition = glm::vec3(header->m_CameraPosition[0], header->m_CameraPosition[1],
+                                          header->m_CameraPosition[2]);
+        Scene::CameraYaw = header->m_CameraYaw;
+        Scene::CameraPitch = header->m_CameraPitch;
+    }
+
+    int Restore()
+    {
+        const Header* header = LoadHeader();
+        // The camera moves far more often than the scene changes, and comparing it is cheaper
+        if (!Enabled || !header || !MatchesCamera(*header) || !MatchesScene(*header)) return 0;
+
+        const size_t textureSize = TextureSize(header->m_Width, header->m_Height);
+        MappedFile::Mapping file;
+        if (!MappedFile::Open(FilePath, file)) return 0;
+        if (file.m_Size != sizeof(Header) + 3 * textureSize)
+        {
+            MappedFile::Close(file);
+            return 0;
+        }
+
+        const auto* data = static_cast<const unsigned char*>(file.m_Data);
+        const Renderer::AccumulationTarget& target = Renderer::Targets[Renderer::CurrentTarget];
+        const GLuint textures[3] = {target.m_MeanTexture, target.m_CompensationTexture, target.m_MomentsTexture};
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        for (int i = 0; i < 3; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, header->m_Width, header->m_Height, GL_RGBA, GL_FLOAT,
+                            data + sizeof(Header) + i * textureSize);
+        }
+        MappedFile::Close(file);
+
+        Renderer::UpdateGBuffer();
+        if (Adaptive::Enabled) Adaptive::UpdateMask();
+
+        // Sample indices that were already used would repeat their samples
+        Renderer::SampleCount = header->m_SampleCount;
+        RecordedPasses = header->m_Passes;
+        RecordedSampleCount = header->m_SampleCount;
+        RecordedCameraPosition = Scene::CameraPosition;
+        RecordedCameraYaw = Scene::CameraYaw;
+        RecordedCameraPitch = Scene::CameraPitch;
+        Unsaved = false;
+        return header->m_Passes;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// Saves the accumulation (Renderer::Targets[Renderer::CurrentTarget]) to a memory-mapped file, together with its pass
+// count, the number of samples taken and a fingerprint of the scene, settings, skybox and resolution it was rendered with,
+// so a long render survives closing the application, resizing the window or a crash.
+namespace Checkpoint
+{
+    extern bool Enabled;
+    // Seconds between periodic saves
+    extern float Interval;
+    // Accumulations with fewer passes aren't worth saving
+    extern int MinPasses;
+
+    // Records the state after a pass (including Renderer::SampleCount and the camera) and saves it if Interval has
+    // passed since the last save.
+    void Update(int accumulatedPasses);
+    // Saves the state last given to Update now, unless it is too short or already saved. Called before the
+    // accumulation is lost, e.g. when the window is resized or closed.
+    void Save();
+    // Forgets the state given to Update, so Save doesn't write whatever replaces the accumulation under it. Called when
+    // an animation takes over the accumulation target.
+    void Discard();
+
+    // Moves the camera to the one of the saved checkpoint if it was rendered from the current scene, so Restore picks
+    // it up. Called once at startup.
+    void AdoptCamera();
+    // Loads the checkpoint into the current accumulation target if it matches the current scene, camera and target
+    // size, and renders the G-buffer for it. Call after Renderer::SetCamera when an accumulation starts. Returns the
+    // accumulatedPasses to continue with (0 if there was nothing to restore) and sets Renderer::SampleCount so the
+    // following passes continue after the saved samples.
+    int Restore();
+}
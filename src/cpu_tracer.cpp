@@ -0,0 +1,691 @@
+#include "cpu_tracer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "blue_noise.h"
+#include "environment.h"
+#include "scene.h"
+
+// Mirrors the constants in common.glsl
+#define RENDER_DISTANCE 10000.0f
+#define EPSILON 0.0001f
+#define PI 3.1415926538f
+
+namespace CpuTracer
+{
+    constexpr int TileSize = 16;
+
+    struct Ray
+    {
+        glm::vec3 m_Origin;
+        glm::vec3 m_Direction;
+    };
+
+    struct SurfacePoint
+    {
+        glm::vec3 m_Position;
+        glm::vec3 m_Normal;
+        const Scene::Material* m_Material;
+    };
+
+    const float* SkyboxData = nullptr;
+    int SkyboxWidth = 0, SkyboxHeight = 0;
+
+    // Importance sampling distribution of SkyboxData, built by the first pass after SetSkybox
+    Environment::Distribution SkyDistribution;
+    bool SkyDistributionBuilt = false;
+
+    void SetSkybox(const float* rgbData, const int width, const int height)
+    {
+        SkyboxData = rgbData;
+        SkyboxWidth = width;
+        SkyboxHeight = height;
+        SkyDistributionBuilt = false;
+    }
+
+    glm::vec3 ToVec3(const float* values)
+    {
+        return {values[0], values[1], values[2]};
+    }
+
+    // Port of sampler.glsl, so both tracers draw the same samples: Owen-scrambled Sobol points indexed by the sample's
+    // index in the accumulation, shifted by the blue-noise tile
+    constexpr uint32_t DimensionPixel = 0;
+    constexpr uint32_t DimensionBloom = 1;
+    constexpr uint32_t DimensionBounces = 8;
+    constexpr uint32_t DimensionsPerBounce = 8;
+    constexpr uint32_t BounceEnvironment = 0;
+    constexpr uint32_t BounceRoulette = 1;
+    constexpr uint32_t BounceDirection = 2;
+    constexpr uint32_t BounceLightPoint = 4;
+
+    struct Sampler
+    {
+        glm::ivec2 m_Pixel;
+        uint32_t m_Index;
+    };
+
+    uint32_t PcgHash(const uint32_t value)
+    {
+        const uint32_t state = value * 747796405u + 2891336453u;
+        const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    uint32_t HashCombine(const uint32_t seed, const uint32_t value)
+    {
+        return PcgHash(seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+    }
+
+    uint32_t BounceDimension(const int depth, const uint32_t offset)
+    {
+        return DimensionBounces + static_cast<uint32_t>(depth) * DimensionsPerBounce + offset;
+    }
+
+    // bitfieldReverse()
+    uint32_t ReverseBits(uint32_t x)
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    uint32_t NestedUniformScramble(uint32_t x, const uint32_t seed)
+    {
+        x = ReverseBits(x);
+        x ^= x * 0x3d20adeau;
+        x += seed;
+        x *= (seed >> 16) | 1u;
+        x ^= x * 0x05526c56u;
+        x ^= x * 0x53a22864u;
+        return ReverseBits(x);
+    }
+
+    uint32_t SobolSecondDimension(uint32_t index)
+    {
+        uint32_t result = 0;
+        for (uint32_t direction = 1u << 31; index != 0; index >>= 1, direction ^= direction >> 1)
+        {
+            if (index & 1u) result ^= direction;
+        }
+        return result;
+    }
+
+    uint32_t DimensionSeed(const Sampler& sampler, const uint32_t dimension)
+    {
+        // Every tile scrambles its own way, so the tiles don't repeat the same error pattern across the image
+        const auto tileX = static_cast<uint32_t>(sampler.m_Pixel.x / BlueNoise::Size);
+        const auto tileY = static_cast<uint32_t>(sampler.m_Pixel.y / BlueNoise::Size);
+        return HashCombine(HashCombine(PcgHash(dimension), tileX), tileY);
+    }
+
+    glm::vec2 BlueNoiseShift(const Sampler& sampler, const uint32_t seed)
+    {
+        // Every dimension reads the tile at its own offset, so the pixel isn't shifted the same way in all of them
+        constexpr int mask = BlueNoise::Size - 1;
+        const int x = (sampler.m_Pixel.x + static_cast<int>(seed & 63u)) & mask;
+        const int y = (sampler.m_Pixel.y + static_cast<int>((seed >> 8) & 63u)) & mask;
+        const unsigned char* texel = &BlueNoise::Texels[(static_cast<size_t>(y) * BlueNoise::Size + x) * 2];
+        return {(static_cast<float>(texel[0]) + 0.5f) / 256.0f, (static_cast<float>(texel[1]) + 0.5f) / 256.0f};
+    }
+
+    // [0, 1) from the upper 24 bits, all a float can hold in that range
+    float UnitFloat(const uint32_t bits)
+    {
+        return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+    }
+
+    float Fract(const float value)
+    {
+        return value - std::floor(value);
+    }
+
+    glm::vec2 Sample2D(const Sampler& sampler, const uint32_t dimension)
+    {
+        const uint32_t seed = DimensionSeed(sampler, dimension);
+        const uint32_t index = NestedUniformScramble(sampler.m_Index, seed);
+        const uint32_t x = NestedUniformScramble(ReverseBits(index), HashCombine(seed, 0));
+        const uint32_t y = NestedUniformScramble(SobolSecondDimension(index), HashCombine(seed, 1));
+        const glm::vec2 shift = BlueNoiseShift(sampler, seed);
+        return {Fract(UnitFloat(x) + shift.x), Fract(UnitFloat(y) + shift.y)};
+    }
+
+    float Sample1D(const Sampler& sampler, const uint32_t dimension)
+    {
+        const uint32_t seed = DimensionSeed(sampler, dimension);
+        const uint32_t index = NestedUniformScramble(sampler.m_Index, seed);
+        const uint32_t x = NestedUniformScramble(ReverseBits(index), HashCombine(seed, 0));
+        return Fract(UnitFloat(x) + BlueNoiseShift(sampler, seed).x);
+    }
+
+    glm::vec3 BoxNormal(const glm::vec3 cubePosition, const glm::vec3 size, const glm::vec3 surfacePosition)
+    {
+        const glm::vec3 boxSize = size * 0.5f;
+        const glm::vec3 pc = surfacePosition - cubePosition;
+
+        glm::vec3 normal(0.0f);
+        if (std::abs(std::abs(pc.x) - boxSize.x) <= EPSILON) normal.x += pc.x > 0 ? 1.0f : (pc.x < 0 ? -1.0f : 0.0f);
+        if (std::abs(std::abs(pc.y) - boxSize.y) <= EPSILON) normal.y += pc.y > 0 ? 1.0f : (pc.y < 0 ? -1.0f : 0.0f);
+        if (std::abs(std::abs(pc.z) - boxSize.z) <= EPSILON) normal.z += pc.z > 0 ? 1.0f : (pc.z < 0 ? -1.0f : 0.0f);
+        return glm::normalize(normal);
+    }
+
+    // Like raycast() in common.glsl, only the closest object is remembered during the search; its normal and
+    // material are looked up once at the end.
+    bool Raycast(const Ray& ray, SurfacePoint& hitPoint)
+    {
+        float minHitDist = RENDER_DISTANCE;
+        const Scene::Object* hitObject = nullptr;
+
+        float hitDist;
+        for (const Scene::Object& object : Scene::Objects)
+        {
+            const glm::vec3 position = ToVec3(object.m_Position);
+            if ((object.m_Type == 1 && Scene::SphereIntersection(position, object.m_Scale[0], ray.m_Origin,
+                                                                 ray.m_Direction, &hitDist)) ||
+                (object.m_Type == 2 && Scene::BoxIntersection(position, ToVec3(object.m_Scale), ray.m_Origin,
+                                                              ray.m_Direction, &hitDist)))
+            {
+                if (hitDist < minHitDist)
+                {
+                    minHitDist = hitDist;
+                    hitObject = &object;
+                }
+            }
+        }
+
+        bool planeHit = false;
+        if (Scene::PlaneVisible && Scene::PlaneIntersection(glm::vec3(0, 1, 0), glm::vec3(0, 0, 0), ray.m_Origin,
+                                                            ray.m_Direction, &hitDist))
+        {
+            if (hitDist < minHitDist)
+            {
+                minHitDist = hitDist;
+                planeHit = true;
+            }
+        }
+
+        if (planeHit)
+        {
+            hitPoint.m_Position = ray.m_Origin + ray.m_Direction * minHitDist;
+            hitPoint.m_Normal = glm::vec3(0, 1, 0);
+            hitPoint.m_Material = &Scene::PlaneMaterial;
+        }
+        else if (hitObject)
+        {
+            const glm::vec3 position = ToVec3(hitObject->m_Position);
+            hitPoint.m_Position = ray.m_Origin + ray.m_Direction * minHitDist;
+            hitPoint.m_Normal = hitObject->m_Type == 1
+                                    ? glm::normalize(hitPoint.m_Position - position)
+                                    : BoxNormal(position, ToVec3(hitObject->m_Scale), hitPoint.m_Position);
+            hitPoint.m_Material = &Scene::Materials[hitObject->m_MaterialIndex];
+        }
+
+        // Hits beyond RENDER_DISTANCE are misses, as in closestHit()
+        return planeHit || hitObject != nullptr;
+    }
+
+    glm::vec3 SampleHemisphere(const glm::vec3 normal, const float alpha, const glm::vec2 xi)
+    {
+        const float cosTheta = std::pow(xi.x, 1.0f / (alpha + 1.0f));
+        const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+        const float phi = 2 * PI * xi.y;
+
+        const glm::vec3 helper = std::abs(normal.x) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(1, 0, 0);
+        const glm::vec3 tangent = glm::normalize(glm::cross(normal, helper));
+        const glm::vec3 binormal = glm::normalize(glm::cross(normal, tangent));
+
+        return tangent * (std::cos(phi) * sinTheta) + binormal * (std::sin(phi) * sinTheta) + normal * cosTheta;
+    }
+
+    glm::vec2 SkyboxUV(const glm::vec3 dir)
+    {
+        return {0.5f + std::atan2(dir.x, dir.z) / (2 * PI), 0.5f + std::asin(-dir.y) / PI};
+    }
+
+    // Bilinear lookup with GL_REPEAT wrapping, matching texture() on the GPU's skybox texture
+    glm::vec3 SkyboxTexel(const float u, const float v)
+    {
+        const float x = u * static_cast<float>(SkyboxWidth) - 0.5f;
+        const float y = v * static_cast<float>(SkyboxHeight) - 0.5f;
+        const float fx = std::floor(x), fy = std::floor(y);
+        const float tx = x - fx, ty = y - fy;
+
+        auto fetch = [](int px, int py)
+        {
+            px = ((px % SkyboxWidth) + SkyboxWidth) % SkyboxWidth;
+            py = ((py % SkyboxHeight) + SkyboxHeight) % SkyboxHeight;
+            return ToVec3(SkyboxData + (static_cast<size_t>(py) * SkyboxWidth + px) * 3);
+        };
+
+        const int ix = static_cast<int>(fx), iy = static_cast<int>(fy);
+        return glm::mix(glm::mix(fetch(ix, iy), fetch(ix + 1, iy), tx),
+                        glm::mix(fetch(ix, iy + 1), fetch(ix + 1, iy + 1), tx), ty);
+    }
+
+    glm::vec3 SampleSkybox(const glm::vec3 dir)
+    {
+        if (Scene::SkyboxStrength == 0.0f || !SkyboxData) return glm::vec3(0.0f);
+
+        const glm::vec2 uv = SkyboxUV(dir);
+        const glm::vec3 texel = SkyboxTexel(uv.x, uv.y);
+        return glm::min(glm::vec3(Scene::SkyboxCeiling),
+                        Scene::SkyboxStrength * glm::pow(texel, glm::vec3(1.0f / Scene::SkyboxGamma)));
+    }
+
+    // The skybox importance sampling of common.glsl (see Environment) on SkyDistribution
+
+    int FindCdfInterval(const int offset, const int count, const float value)
+    {
+        int low = 0;
+        int high = count - 1;
+        while (low < high)
+        {
+            const int middle = (low + high + 1) / 2;
+            if (SkyDistribution.m_Cdf[offset + middle] <= value) low = middle;
+            else high = middle - 1;
+        }
+        return low;
+    }
+
+    float EnvironmentPdf(const glm::vec3 dir)
+    {
+        const int width = SkyDistribution.m_Width, height = SkyDistribution.m_Height;
+        const std::vector<float>& cdf = SkyDistribution.m_Cdf;
+        const glm::vec2 uv = SkyboxUV(dir);
+        const int row = std::clamp(static_cast<int>(uv.y * static_cast<float>(height)), 0, height - 1);
+        const int column = std::clamp(static_cast<int>(uv.x * static_cast<float>(width)), 0, width - 1);
+        const int rowOffset = height + 1 + row * (width + 1);
+        const float probability = (cdf[row + 1] - cdf[row]) * (cdf[rowOffset + column + 1] - cdf[rowOffset + column]);
+        const float cosLatitude = std::cos((uv.y - 0.5f) * PI);
+        return probability * static_cast<float>(width) * static_cast<float>(height) /
+            (2 * PI * PI * std::max(cosLatitude, EPSILON));
+    }
+
+    glm::vec3 EnvironmentDirection(glm::vec2 xi, float& pdf)
+    {
+        const int width = SkyDistribution.m_Width, height = SkyDistribution.m_Height;
+        const std::vector<float>& cdf = SkyDistribution.m_Cdf;
+        xi.x = std::min(xi.x, 0.99999994f);
+        xi.y = std::min(xi.y, 0.99999994f);
+        const int row = FindCdfInterval(0, height, xi.y);
+        const float rowStart = cdf[row];
+        const float v = (static_cast<float>(row) + (xi.y - rowStart) / (cdf[row + 1] - rowStart)) /
+            static_cast<float>(height);
+
+        const int rowOffset = height + 1 + row * (width + 1);
+        const int column = FindCdfInterval(rowOffset, width, xi.x);
+        const float columnStart = cdf[rowOffset + column];
+        const float u = (static_cast<float>(column) + (xi.x - columnStart) /
+            (cdf[rowOffset + column + 1] - columnStart)) / static_cast<float>(width);
+
+        const float latitude = (v - 0.5f) * PI;
+        const float phi = (u - 0.5f) * 2 * PI;
+        const glm::vec3 dir(std::cos(latitude) * std::sin(phi), -std::sin(latitude),
+                            std::cos(latitude) * std::cos(phi));
+        pdf = EnvironmentPdf(dir);
+        return dir;
+    }
+
+    float DiffuseChance(const Scene::Material& material)
+    {
+        const float specChance = glm::dot(ToVec3(material.m_Specular), glm::vec3(1.0f / 3.0f));
+        const float diffChance = glm::dot(ToVec3(material.m_Albedo), glm::vec3(1.0f / 3.0f));
+        return specChance + diffChance > 0.0f ? diffChance / (specChance + diffChance) : 0.0f;
+    }
+
+    // Explicit skybox sample for the diffuse bounce at point, weighted against that bounce by the balance heuristic
+    bool SampleEnvironment(const SurfacePoint& point, const glm::vec2 xi, glm::vec3& direction,
+                           glm::vec3& contribution)
+    {
+        const float diffChance = DiffuseChance(*point.m_Material);
+        if (Scene::SkyboxStrength == 0.0f || !SkyDistribution.m_Sampling || diffChance == 0.0f) return false;
+
+        float pdf;
+        direction = EnvironmentDirection(xi, pdf);
+        const float cosTheta = glm::dot(point.m_Normal, direction);
+        if (cosTheta <= 0.0f || pdf <= 0.0f) return false;
+
+        const float bouncePdf = diffChance * cosTheta / PI;
+        contribution = ToVec3(point.m_Material->m_Albedo) * cosTheta * SampleSkybox(direction) * bouncePdf /
+            (bouncePdf + pdf);
+        return true;
+    }
+
+    // Weight of the skybox seen by a diffuse bounce ray that escaped; 1 after other bounces (bouncePdf 0)
+    float EnvironmentMisWeight(const glm::vec3 dir, const float bouncePdf)
+    {
+        if (bouncePdf == 0.0f || !SkyDistribution.m_Sampling) return 1.0f;
+        return bouncePdf / (bouncePdf + EnvironmentPdf(dir));
+    }
+
+    // Adds up the total light received directly from all light sources, and from the skybox unless the path ends here
+    glm::vec3 ComputeDirectIllumination(const SurfacePoint& point, const glm::vec3 observerPos, const Sampler& sampler,
+                                        const int depth, const bool lastBounce)
+    {
+        glm::vec3 directIllumination(0.0f);
+
+        // Skybox, see SampleEnvironment
+        glm::vec3 environmentDir, environmentLight;
+        const glm::vec2 environmentXi = Sample2D(sampler, BounceDimension(depth, BounceEnvironment));
+        if (!lastBounce && SampleEnvironment(point, environmentXi, environmentDir, environmentLight))
+        {
+            if (!Scene::Occluded(point.m_Position + point.m_Normal * EPSILON, environmentDir, RENDER_DISTANCE))
+                directIllumination += environmentLight;
+        }
+
+        for (size_t lightIndex = 0; lightIndex < Scene::Lights.size(); lightIndex++)
+        {
+            const Scene::PointLight& light = Scene::Lights[lightIndex];
+            const glm::vec3 lightPosition = ToVec3(light.m_Position);
+            const float lightDistance = glm::length(lightPosition - point.m_Position);
+            if (lightDistance > light.m_Reach) continue;
+
+            const float diffuse = std::clamp(glm::dot(point.m_Normal, glm::normalize(lightPosition - point.m_Position)),
+                                             0.0f, 1.0f);
+
+            if (diffuse > EPSILON || point.m_Material->m_Roughness < 1.0f)
+            {
+                // Shadow raycasting
+                const int shadowRays = static_cast<int>(static_cast<float>(Scene::ShadowResolution) * light.m_Radius *
+                    light.m_Radius / (lightDistance * lightDistance) + 1);
+                int shadowRayHits = 0;
+                for (int i = 0; i < shadowRays; i++)
+                {
+                    // Sample a point on the light sphere. Every light and shadow ray has dimensions of its own.
+                    const uint32_t dimension = HashCombine(
+                        HashCombine(BounceDimension(depth, BounceLightPoint), static_cast<uint32_t>(lightIndex)),
+                        static_cast<uint32_t>(i));
+                    const glm::vec3 xi(Sample2D(sampler, dimension), Sample1D(sampler, dimension + 1));
+                    const glm::vec3 lightSurfacePoint = lightPosition + glm::normalize(xi) * light.m_Radius;
+                    const glm::vec3 lightDir = glm::normalize(lightSurfacePoint - point.m_Position);
+                    const glm::vec3 rayOrigin = point.m_Position + lightDir * EPSILON * 2.0f;
+                    const float maxRayLength = glm::length(lightSurfacePoint - rayOrigin);
+
+                    if (Scene::Occluded(rayOrigin, lightDir, maxRayLength)) shadowRayHits += 1;
+                }
+
+                const glm::vec3 lightColor = ToVec3(light.m_Color);
+
+                // Diffuse
+                const float attenuation = lightDistance * lightDistance;
+                directIllumination += lightColor * light.m_Power * diffuse * ToVec3(point.m_Material->m_Albedo) *
+                    (1.0f - static_cast<float>(shadowRayHits) / static_cast<float>(shadowRays)) / attenuation;
+
+                // Specular highlight
+                const glm::vec3 lightDir = glm::normalize(point.m_Position - lightPosition);
+                const glm::vec3 reflectedLightDir = glm::reflect(lightDir, point.m_Normal);
+                const glm::vec3 cameraDir = glm::normalize(observerPos - point.m_Position);
+                directIllumination += point.m_Material->m_SpecularHighlight * lightColor *
+                    (light.m_Power / (lightDistance * lightDistance)) *
+                    std::pow(std::max(glm::dot(cameraDir, reflectedLightDir), 0.0f),
+                             1.0f / std::max(point.m_Material->m_SpecularExponent, EPSILON));
+            }
+        }
+
+        return directIllumination;
+    }
+
+    glm::vec3 ComputeSceneColor(const Ray& cameraRay, const Sampler& sampler)
+    {
+        glm::vec3 totalIllumination(0.0f);
+        glm::vec3 rayOrigin = cameraRay.m_Origin;
+        glm::vec3 rayDirection = cameraRay.m_Direction;
+        glm::vec3 energy(1.0f);
+        float bouncePdf = 0.0f; // Of the last bounce, see EnvironmentMisWeight
+
+        for (int depth = 0; depth < Scene::LightBounces; depth++)
+        {
+            SurfacePoint hitPoint;
+            if (!Raycast({rayOrigin, rayDirection}, hitPoint))
+            {
+                // The ray didn't hit anything, so we add the sky's color and we're done
+                totalIllumination += energy * SampleSkybox(rayDirection) *
+                    EnvironmentMisWeight(rayDirection, bouncePdf);
+                break;
+            }
+
+            const Scene::Material& material = *hitPoint.m_Material;
+            const glm::vec3 albedo = ToVec3(material.m_Albedo);
+            const glm::vec3 specular = ToVec3(material.m_Specular);
+
+            // Part one: Hit object's emission
+            totalIllumination += energy * ToVec3(material.m_Emission) * material.m_EmissionStrength;
+
+            // Part two: Direct light (received directly from light sources)
+            totalIllumination += energy * ComputeDirectIllumination(hitPoint, rayOrigin, sampler, depth,
+                                                                    depth + 1 == Scene::LightBounces);
+
+            // Part three: Indirect light (other objects + skybox)
+            float specChance = glm::dot(specular, glm::vec3(1.0f / 3.0f));
+            float diffChance = glm::dot(albedo, glm::vec3(1.0f / 3.0f));
+
+            const float sum = specChance + diffChance;
+            specChance /= sum;
+            diffChance /= sum;
+
+            // Roulette-select the ray's path
+            const float roulette = Sample1D(sampler, BounceDimension(depth, BounceRoulette));
+            if (roulette < specChance)
+            {
+                // Specular reflection
+                const float smoothness = 1.0f - material.m_Roughness;
+                const float alpha = std::pow(1000.0f, smoothness * smoothness);
+                if (smoothness == 1.0f)
+                {
+                    rayDirection = glm::reflect(rayDirection, hitPoint.m_Normal);
+                }
+                else
+                {
+                    rayDirection = SampleHemisphere(glm::reflect(rayDirection, hitPoint.m_Normal), alpha,
+                                                    Sample2D(sampler, BounceDimension(depth, BounceDirection)));
+                }
+                rayOrigin = hitPoint.m_Position + rayDirection * EPSILON;
+                const float f = (alpha + 2) / (alpha + 1);
+                energy *= specular * std::clamp(glm::dot(hitPoint.m_Normal, rayDirection) * f, 0.0f, 1.0f);
+                bouncePdf = 0.0f;
+            }
+            else if (diffChance > 0 && roulette < specChance + diffChance)
+            {
+                // Diffuse reflection
+                rayOrigin = hitPoint.m_Position + hitPoint.m_Normal * EPSILON;
+                rayDirection = SampleHemisphere(hitPoint.m_Normal, 1.0f,
+                                                Sample2D(sampler, BounceDimension(depth, BounceDirection)));
+                energy *= albedo * std::clamp(glm::dot(hitPoint.m_Normal, rayDirection), 0.0f, 1.0f);
+                bouncePdf = diffChance * std::max(glm::dot(hitPoint.m_Normal, rayDirection), 0.0f) / PI;
+            }
+            else
+            {
+                // Both the albedo and specular are totally black, so there won't be anymore light.
+                break;
+            }
+        }
+
+        return totalIllumination;
+    }
+
+    // Per-pixel body of fragment.glsl's main() for the accumulation pass
+    glm::vec3 ShadePixel(const glm::ivec2 pixel, const glm::vec2 fragUV, const float aspectRatio,
+                         const glm::vec3 cameraPosition, const glm::mat4& rotationMatrix, const int accumulatedPasses,
+                         const uint32_t firstSample)
+    {
+        glm::vec2 centeredUV = (fragUV * 2.0f - glm::vec2(1.0f)) * glm::vec2(aspectRatio, 1.0f);
+
+        // The camera ray and bloom are sampled once per pass, with the dimensions of its first sample
+        const Sampler passSampler{pixel, firstSample};
+        if (Scene::Blur > 0.0f && accumulatedPasses > 0)
+            centeredUV += (Sample2D(passSampler, DimensionPixel) - 0.5f) * Scene::Blur;
+        const Ray cameraRay{
+            cameraPosition, glm::vec3(glm::normalize(glm::vec4(centeredUV, -1.0f, 0.0f)) * rotationMatrix)
+        };
+
+        // Camera raycasting
+        glm::vec3 colorSum(0.0f);
+        for (int i = 0; i < Scene::FramePasses; i++)
+            colorSum += ComputeSceneColor(cameraRay, {pixel, firstSample + static_cast<uint32_t>(i)});
+        glm::vec3 color = colorSum / static_cast<float>(Scene::FramePasses);
+
+        if (accumulatedPasses > 0)
+        {
+            // Bloom
+            const glm::vec3 bloomXi(Sample2D(passSampler, DimensionBloom), Sample1D(passSampler, DimensionBloom + 1));
+            const glm::vec3 offsetDirection = cameraRay.m_Direction + (bloomXi - 0.5f) * Scene::BloomRadius;
+
+            SurfacePoint hitPoint;
+            if (Raycast({cameraRay.m_Origin, offsetDirection}, hitPoint))
+            {
+                color += ToVec3(hitPoint.m_Material->m_Emission) * hitPoint.m_Material->m_EmissionStrength * Scene::
+                    BloomIntensity;
+            }
+        }
+
+        return color;
+    }
+
+    // Work-stealing scheduler: every worker owns a deque of tiles. It takes work from the back of its own deque and,
+    // once that runs dry, steals from the front of the others, so uneven tiles (sky vs. glossy surfaces) balance out.
+    class TileScheduler
+    {
+    public:
+        TileScheduler(const int tileCount, const int workerCount) : m_Queues(workerCount)
+        {
+            // Contiguous ranges keep neighbouring tiles (and their cache lines) on the same worker.
+            for (int tile = 0; tile < tileCount; tile++)
+            {
+                m_Queues[static_cast<size_t>(tile) * workerCount / tileCount].m_Tiles.push_back(tile);
+            }
+        }
+
+        bool Next(const int worker, int& tile)
+        {
+            if (Pop(m_Queues[worker], tile, true)) return true;
+
+            const int workerCount = static_cast<int>(m_Queues.size());
+            for (int offset = 1; offset < workerCount; offset++)
+            {
+                if (Pop(m_Queues[(worker + offset) % workerCount], tile, false)) return true;
+            }
+            return false;
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex m_Mutex;
+            std::deque<int> m_Tiles;
+        };
+
+        static bool Pop(Queue& queue, int& tile, const bool own)
+        {
+            std::lock_guard lock(queue.m_Mutex);
+            if (queue.m_Tiles.empty()) return false;
+
+            if (own)
+            {
+                tile = queue.m_Tiles.back();
+                queue.m_Tiles.pop_back();
+            }
+            else
+            {
+                tile = queue.m_Tiles.front();
+                queue.m_Tiles.pop_front();
+            }
+            return true;
+        }
+
+        std::vector<Queue> m_Queues;
+    };
+
+    void RenderPass(float* accumulation, const int width, const int height, const glm::vec3 cameraPosition,
+                    const glm::mat4& rotationMatrix, const int accumulatedPasses, const uint32_t firstSample,
+                    int threadCount)
+    {
+        if (threadCount <= 0) threadCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        if (!SkyDistributionBuilt)
+        {
+            SkyDistribution = {};
+            if (SkyboxData) Environment::Build(SkyboxData, SkyboxWidth, SkyboxHeight, SkyDistribution);
+            SkyDistributionBuilt = true;
+        }
+
+        const int tilesX = (width + TileSize - 1) / TileSize;
+        const int tilesY = (height + TileSize - 1) / TileSize;
+        TileScheduler scheduler(tilesX * tilesY, threadCount);
+
+        const float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+
+        auto worker = [&](const int workerIndex)
+        {
+            int tile;
+            while (scheduler.Next(workerIndex, tile))
+            {
+                const int x0 = (tile % tilesX) * TileSize;
+                const int y0 = (tile / tilesX) * TileSize;
+                for (int y = y0; y < std::min(y0 + TileSize, height); y++)
+                {
+                    for (int x = x0; x < std::min(x0 + TileSize, width); x++)
+                    {
+                        const glm::vec2 fragUV((static_cast<float>(x) + 0.5f) / static_cast<float>(width),
+                                               (static_cast<float>(y) + 0.5f) / static_cast<float>(height));
+                        const glm::vec3 color = ShadePixel({x, y}, fragUV, aspectRatio, cameraPosition,
+                                                           rotationMatrix, accumulatedPasses, firstSample);
+
+                        // Add last frame back (progressive sampling)
+                        float* pixel = accumulation + (static_cast<size_t>(y) * width + x) * 3;
+                        for (int c = 0; c < 3; c++)
+                            pixel[c] = accumulatedPasses > 0 ? pixel[c] + color[c] : color[c];
+                    }
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        for (int i = 1; i < threadCount; i++) threads.emplace_back(worker, i);
+        worker(0);
+        for (std::thread& thread : threads) thread.join();
+    }
+
+    void RenderGuides(float* normalDepth, float* albedo, const int width, const int height,
+                      const glm::vec3 cameraPosition, const glm::mat4& rotationMatrix)
+    {
+        const float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                const glm::vec2 fragUV((static_cast<float>(x) + 0.5f) / static_cast<float>(width),
+                                       (static_cast<float>(y) + 0.5f) / static_cast<float>(height));
+                const glm::vec2 centeredUV = (fragUV * 2.0f - glm::vec2(1.0f)) * glm::vec2(aspectRatio, 1.0f);
+                const Ray cameraRay{
+                    cameraPosition, glm::vec3(glm::normalize(glm::vec4(centeredUV, -1.0f, 0.0f)) * rotationMatrix)
+                };
+
+                const size_t pixel = static_cast<size_t>(y) * width + x;
+                SurfacePoint hitPoint;
+                if (Raycast(cameraRay, hitPoint))
+                {
+                    normalDepth[pixel * 4] = hitPoint.m_Normal.x;
+                    normalDepth[pixel * 4 + 1] = hitPoint.m_Normal.y;
+                    normalDepth[pixel * 4 + 2] = hitPoint.m_Normal.z;
+                    normalDepth[pixel * 4 + 3] = glm::length(hitPoint.m_Position - cameraPosition);
+                    for (int c = 0; c < 3; c++) albedo[pixel * 3 + c] = hitPoint.m_Material->m_Albedo[c];
+                }
+                else
+                {
+                    std::fill_n(normalDepth + pixel * 4, 4, 0.0f);
+                    std::fill_n(albedo + pixel * 3, 3, 0.0f);
+                }
+            }
+        }
+    }
+}
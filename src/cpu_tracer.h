@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Multithreaded CPU port of the path tracer in fragment.glsl. It renders the same Scene::Objects, Scene::Lights and
+// Scene::PlaneMaterial with the same estimator, including the explicit skybox samples of Environment (built from its
+// own copy of the skybox), so its output matches the GPU path in expectation. It is used as a correctness reference
+// for shader changes and to render on machines without a GPU.
+namespace CpuTracer
+{
+    // The skybox data is borrowed, not copied: it must stay alive while passes are rendered. Its sampling distribution
+    // is built by the next pass with the skybox settings and Environment::Enabled at that time.
+    void SetSkybox(const float* rgbData, int width, int height);
+
+    // Adds one accumulation pass to accumulation (width * height RGB sums, bottom row first; the GPU's accumulation
+    // targets keep the mean instead). An accumulatedPasses of 0 discards the previous contents, exactly like
+    // u_accumulatedPasses. The pass takes Scene::FramePasses samples numbered from firstSample on, like u_firstSample,
+    // and shifts them by the tile BlueNoise::Load must have loaded.
+    // threadCount = 0 uses every hardware thread.
+    void RenderPass(float* accumulation, int width, int height, glm::vec3 cameraPosition,
+                    const glm::mat4& rotationMatrix, int accumulatedPasses, uint32_t firstSample,
+                    int threadCount = 0);
+
+    // Writes the denoiser's guides like gbuffer.glsl: normal and depth (4 floats, depth 0 for misses) and albedo
+    // (3 floats) of every pixel's primary hit, bottom row first.
+    void RenderGuides(float* normalDepth, float* albedo, int width, int height, glm::vec3 cameraPosition,
+                      const glm::mat4& rotationMatrix);
+}
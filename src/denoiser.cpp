@@ -0,0 +1,275 @@
+#include "denoiser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "renderer.h"
+#include "scene.h"
+
+namespace Denoiser
+{
+    bool Enabled = false;
+    int Iterations = 5;
+    float ColorSigma = 2.0f;
+    float NormalPower = 64.0f;
+    float DepthSigma = 1.0f;
+    float AlbedoSigma = 0.1f;
+
+    // Texture units of the guides; the color is read from unit 0
+    constexpr GLint NormalDepthUnit = 4;
+    constexpr GLint AlbedoUnit = 5;
+
+    // B3 spline taps at offsets 0, 1 and 2, as in denoise.glsl
+    constexpr float Kernel[3] = {3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+    // Relative depth difference tolerated where the gradient is flat, EPSILON in denoise.glsl
+    constexpr float DepthEpsilon = 0.001f;
+
+    struct FilterTarget
+    {
+        GLuint m_Fbo;
+        GLuint m_Texture;
+    };
+
+    GLuint Program;
+    GLint StepWidthUniformLocation, ColorPhiUniformLocation, NormalPhiUniformLocation, DepthPhiUniformLocation,
+          AlbedoPhiUniformLocation;
+
+    // Iterations alternate between the two
+    FilterTarget Targets[2];
+    int TargetWidth = 0, TargetHeight = 0;
+    GLuint OutputFbo;
+
+    bool SetEnabled(const bool enabled)
+    {
+        if (enabled && !Program)
+        {
+            Program = Renderer::CreateShaderProgram("shaders\\vertex.glsl", "shaders\\denoise.glsl");
+
+            GLint linked = GL_FALSE;
+            if (Program) glGetProgramiv(Program, GL_LINK_STATUS, &linked);
+            if (!linked)
+            {
+                Delete();
+                return false;
+            }
+
+            StepWidthUniformLocation = glGetUniformLocation(Program, "u_stepWidth");
+            ColorPhiUniformLocation = glGetUniformLocation(Program, "u_colorPhi");
+            NormalPhiUniformLocation = glGetUniformLocation(Program, "u_normalPhi");
+            DepthPhiUniformLocation = glGetUniformLocation(Program, "u_depthPhi");
+            AlbedoPhiUniformLocation = glGetUniformLocation(Program, "u_albedoPhi");
+            glProgramUniform1i(Program, glGetUniformLocation(Program, "u_colorTexture"), 0);
+            glProgramUniform1i(Program, glGetUniformLocation(Program, "u_normalDepthTexture"), NormalDepthUnit);
+            glProgramUniform1i(Program, glGetUniformLocation(Program, "u_albedoTexture"), AlbedoUnit);
+        }
+
+        Enabled = enabled;
+        return true;
+    }
+
+    void DeleteTargets()
+    {
+        for (FilterTarget& target : Targets)
+        {
+            glDeleteFramebuffers(1, &target.m_Fbo);
+            glDeleteTextures(1, &target.m_Texture);
+            target = {};
+        }
+        TargetWidth = TargetHeight = 0;
+    }
+
+    void Delete()
+    {
+        glDeleteProgram(Program);
+        Program = 0;
+        DeleteTargets();
+        Enabled = false;
+    }
+
+    void AllocateTargets(const int width, const int height)
+    {
+        DeleteTargets();
+        for (FilterTarget& target : Targets)
+        {
+            glGenTextures(1, &target.m_Texture);
+            glBindTexture(GL_TEXTURE_2D, target.m_Texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            glGenFramebuffers(1, &target.m_Fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, target.m_Fbo);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.m_Texture, 0);
+        }
+        TargetWidth = width;
+        TargetHeight = height;
+    }
+
+    // The color weight follows the noise: a sample's variance shrinks with the number of samples averaged
+    float InitialColorPhi(const int passCount)
+    {
+        return ColorSigma * ColorSigma / static_cast<float>(std::max(1, passCount * Scene::FramePasses));
+    }
+
+    GLuint Apply(const int passCount)
+    {
+        const Renderer::AccumulationTarget& accumulation = Renderer::Targets[Renderer::CurrentTarget];
+        OutputFbo = accumulation.m_Fbo;
+        if (Iterations <= 0) return accumulation.m_MeanTexture;
+
+        if (TargetWidth != Renderer::TargetWidth || TargetHeight != Renderer::TargetHeight)
+            AllocateTargets(Renderer::TargetWidth, Renderer::TargetHeight);
+
+        glUseProgram(Program);
+        glUniform1f(NormalPhiUniformLocation, NormalPower);
+        glUniform1f(DepthPhiUniformLocation, DepthSigma);
+        glUniform1f(AlbedoPhiUniformLocation, AlbedoSigma * AlbedoSigma);
+
+        glActiveTexture(GL_TEXTURE0 + NormalDepthUnit);
+        glBindTexture(GL_TEXTURE_2D, Renderer::GBuffer.m_NormalDepthTexture);
+        glActiveTexture(GL_TEXTURE0 + AlbedoUnit);
+        glBindTexture(GL_TEXTURE_2D, Renderer::GBuffer.m_AlbedoTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        glViewport(0, 0, TargetWidth, TargetHeight);
+        GLuint input = accumulation.m_MeanTexture;
+        float colorPhi = InitialColorPhi(passCount);
+        for (int iteration = 0; iteration < Iterations; iteration++)
+        {
+            const FilterTarget& output = Targets[iteration % 2];
+            glBindFramebuffer(GL_FRAMEBUFFER, output.m_Fbo);
+            glBindTexture(GL_TEXTURE_2D, input);
+            glUniform1i(StepWidthUniformLocation, 1 << iteration);
+            glUniform1f(ColorPhiUniformLocation, colorPhi);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+
+            input = output.m_Texture;
+            OutputFbo = output.m_Fbo;
+            // Later iterations reach further but see less noise, so they only average similar colors
+            colorPhi *= 0.5f;
+        }
+
+        glUseProgram(Renderer::ShaderProgram);
+        return input;
+    }
+
+    void ReadOutput(float* buffer)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, OutputFbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(0, 0, Renderer::TargetWidth, Renderer::TargetHeight, GL_RGB, GL_FLOAT, buffer);
+    }
+
+    float Depth(const float* normalDepth, const int width, const int height, const int x, const int y)
+    {
+        return normalDepth[(static_cast<size_t>(std::clamp(y, 0, height - 1)) * width + std::clamp(x, 0, width - 1)) *
+            4 + 3];
+    }
+
+    // depthGradient() in denoise.glsl
+    glm::vec2 DepthGradient(const float* normalDepth, const int width, const int height, const int x, const int y,
+                            const float depth)
+    {
+        const float left = Depth(normalDepth, width, height, x - 1, y);
+        const float right = Depth(normalDepth, width, height, x + 1, y);
+        const float down = Depth(normalDepth, width, height, x, y - 1);
+        const float up = Depth(normalDepth, width, height, x, y + 1);
+        return {
+            std::abs(right - depth) < std::abs(depth - left) ? right - depth : depth - left,
+            std::abs(up - depth) < std::abs(depth - down) ? up - depth : depth - down
+        };
+    }
+
+    // One row of one iteration, see denoise.glsl
+    void FilterRow(const float* input, float* output, const float* normalDepth, const float* albedo, const int width,
+                   const int height, const int y, const int stepWidth, const float colorPhi)
+    {
+        const float albedoPhi = AlbedoSigma * AlbedoSigma;
+        for (int x = 0; x < width; x++)
+        {
+            const size_t pixel = static_cast<size_t>(y) * width + x;
+            const glm::vec3 center(input[pixel * 3], input[pixel * 3 + 1], input[pixel * 3 + 2]);
+            const glm::vec4 centerNormalDepth(normalDepth[pixel * 4], normalDepth[pixel * 4 + 1],
+                                              normalDepth[pixel * 4 + 2], normalDepth[pixel * 4 + 3]);
+            const glm::vec3 centerAlbedo(albedo[pixel * 3], albedo[pixel * 3 + 1], albedo[pixel * 3 + 2]);
+
+            glm::vec3 result = center;
+            if (centerNormalDepth.w != 0.0f)
+            {
+                const glm::vec2 gradient = DepthGradient(normalDepth, width, height, x, y, centerNormalDepth.w);
+
+                glm::vec3 colorSum(0.0f);
+                float weightSum = 0.0f;
+                for (int dy = -2; dy <= 2; dy++)
+                {
+                    for (int dx = -2; dx <= 2; dx++)
+                    {
+                        const int tapX = std::clamp(x + dx * stepWidth, 0, width - 1);
+                        const int tapY = std::clamp(y + dy * stepWidth, 0, height - 1);
+                        const size_t tap = static_cast<size_t>(tapY) * width + tapX;
+                        const glm::vec3 color(input[tap * 3], input[tap * 3 + 1], input[tap * 3 + 2]);
+                        const glm::vec3 tapNormal(normalDepth[tap * 4], normalDepth[tap * 4 + 1],
+                                                  normalDepth[tap * 4 + 2]);
+                        const float tapDepth = normalDepth[tap * 4 + 3];
+                        const glm::vec3 tapAlbedo(albedo[tap * 3], albedo[tap * 3 + 1], albedo[tap * 3 + 2]);
+
+                        const glm::vec3 colorDifference = color - center;
+                        const glm::vec3 albedoDifference = tapAlbedo - centerAlbedo;
+                        float weight = Kernel[std::abs(dx)] * Kernel[std::abs(dy)];
+                        weight *= std::pow(std::max(glm::dot(tapNormal, glm::vec3(centerNormalDepth)), 0.0f),
+                                           NormalPower);
+                        const float expectedDepthChange = std::abs(glm::dot(
+                            gradient, glm::vec2(static_cast<float>(dx * stepWidth), static_cast<float>(dy * stepWidth))));
+                        weight *= std::exp(-std::abs(tapDepth - centerNormalDepth.w) /
+                            (DepthSigma * expectedDepthChange + DepthEpsilon * centerNormalDepth.w));
+                        weight *= std::exp(-glm::dot(colorDifference, colorDifference) / colorPhi);
+                        weight *= std::exp(-glm::dot(albedoDifference, albedoDifference) / albedoPhi);
+
+                        colorSum += color * weight;
+                        weightSum += weight;
+                    }
+                }
+                result = colorSum / weightSum;
+            }
+
+            output[pixel * 3] = result.x;
+            output[pixel * 3 + 1] = result.y;
+            output[pixel * 3 + 2] = result.z;
+        }
+    }
+
+    void FilterCpu(float* color, const float* normalDepth, const float* albedo, const int width, const int height,
+                   const int passCount, int threadCount)
+    {
+        if (threadCount <= 0) threadCount = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+        std::vector<float> scratch(static_cast<size_t>(width) * height * 3);
+        float* input = color;
+        float* output = scratch.data();
+        float colorPhi = InitialColorPhi(passCount);
+        for (int iteration = 0; iteration < Iterations; iteration++)
+        {
+            // Rows are independent within an iteration; every thread takes every threadCount-th one
+            auto worker = [&](const int first)
+            {
+                for (int y = first; y < height; y += threadCount)
+                    FilterRow(input, output, normalDepth, albedo, width, height, y, 1 << iteration, colorPhi);
+            };
+
+            std::vector<std::thread> threads;
+            threads.reserve(threadCount - 1);
+            for (int i = 1; i < threadCount; i++) threads.emplace_back(worker, i);
+            worker(0);
+            for (std::thread& thread : threads) thread.join();
+
+            std::swap(input, output);
+            colorPhi *= 0.5f;
+        }
+
+        if (input != color) std::copy(input, input + scratch.size(), color);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Edge-avoiding A-Trous filter over the accumulated image, guided by the normal, depth and albedo in
+// Renderer::GBuffer (see denoise.glsl). Runs between accumulation and the display pass, so previews and animation
+// frames look clean long before the accumulation has converged.
+namespace Denoiser
+{
+    extern bool Enabled;
+    // Each iteration doubles the filter's reach, see denoise.glsl
+    extern int Iterations;
+    // Edge-stopping parameters; smaller values blur less across the corresponding edges
+    extern float ColorSigma; // Noise (standard deviation) of a single sample, scaled down as samples accumulate
+    extern float NormalPower;
+    extern float DepthSigma; // Relative to the depth change predicted by the center pixel's depth gradient
+    extern float AlbedoSigma;
+
+    // Compiles denoise.glsl the first time the denoiser is enabled. Returns false (and leaves it disabled) if it
+    // doesn't compile.
+    bool SetEnabled(bool enabled);
+    void Delete();
+
+    // Filters the mean in Renderer::Targets[Renderer::CurrentTarget], which holds passCount passes, and returns the
+    // texture holding the result.
+    GLuint Apply(int passCount);
+    // Framebuffer holding the result of the last Apply as its first color attachment
+    extern GLuint OutputFbo;
+    // Reads the RGB result of the last Apply into buffer, bottom row first.
+    void ReadOutput(float* buffer);
+
+    // CPU version of Apply for headless rendering: filters color (RGB means) in place. normalDepth holds 4 and albedo
+    // 3 floats per pixel, see CpuTracer::RenderGuides. threadCount = 0 uses every hardware thread.
+    void FilterCpu(float* color, const float* normalDepth, const float* albedo, int width, int height,
+                   int passCount, int threadCount = 0);
+}
@@ -0,0 +1,138 @@
+#include "environment.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+#include "scene.h"
+
+namespace Environment
+{
+    constexpr double Pi = 3.14159265358979323846;
+
+    bool Enabled = true;
+
+    std::vector<float> Image;
+    int ImageWidth = 0, ImageHeight = 0;
+    bool ImageChanged = false;
+
+    // What the uploaded distribution was built with
+    struct BuiltState
+    {
+        bool m_Enabled;
+        float m_SkyboxStrength, m_SkyboxGamma, m_SkyboxCeiling;
+
+        bool operator==(const BuiltState& other) const = default;
+    };
+
+    BuiltState Built{};
+    GLuint DistributionBuffer = 0;
+
+    // Matches the header of the EnvironmentDistribution block in common.glsl
+    struct DistributionHeader
+    {
+        int32_t m_Width, m_Height;
+        int32_t m_Sampling; // 0 if disabled or the skybox is black
+        int32_t m_Padding;
+    };
+
+    void SetImage(std::vector<float>&& rgb, const int width, const int height)
+    {
+        Image = std::move(rgb);
+        ImageWidth = width;
+        ImageHeight = height;
+        ImageChanged = true;
+    }
+
+    BuiltState CurrentState()
+    {
+        return {Enabled, Scene::SkyboxStrength, Scene::SkyboxGamma, Scene::SkyboxCeiling};
+    }
+
+    // Same as sampleSkybox in common.glsl, reduced to its luminance
+    float Radiance(const float* rgb)
+    {
+        float radiance[3];
+        for (int c = 0; c < 3; c++)
+        {
+            radiance[c] = std::min(Scene::SkyboxCeiling, Scene::SkyboxStrength *
+                                   std::pow(std::max(rgb[c], 0.0f), 1.0f / Scene::SkyboxGamma));
+        }
+        return 0.2126f * radiance[0] + 0.7152f * radiance[1] + 0.0722f * radiance[2];
+    }
+
+    // Turns the prefix sums in cdf[0..count] into a CDF ending in exactly 1. Returns the total.
+    double Normalize(float* cdf, const double* sums, const int count)
+    {
+        const double total = sums[count];
+        for (int i = 0; i <= count; i++)
+            cdf[i] = total > 0.0 ? static_cast<float>(sums[i] / total) : static_cast<float>(i) / count;
+        cdf[count] = 1.0f;
+        return total;
+    }
+
+    void Build(const float* rgb, const int width, const int height, Distribution& distribution)
+    {
+        distribution.m_Width = width;
+        distribution.m_Height = height;
+        std::vector<float>& data = distribution.m_Cdf;
+        data.assign(static_cast<size_t>(height + 1) + static_cast<size_t>(height) * (width + 1), 0.0f);
+        std::vector<double> rowSums(static_cast<size_t>(height) + 1, 0.0);
+        std::vector<double> sums(static_cast<size_t>(width) + 1);
+        for (int row = 0; row < height; row++)
+        {
+            // Rows near the poles cover less of the sphere
+            const double latitude = ((row + 0.5) / height - 0.5) * Pi;
+            const double solidAngle = std::cos(latitude);
+
+            sums[0] = 0.0;
+            for (int column = 0; column < width; column++)
+            {
+                const float* texel = rgb + (static_cast<size_t>(row) * width + column) * 3;
+                sums[column + 1] = sums[column] + Radiance(texel) * solidAngle;
+            }
+
+            float* conditional = data.data() + (height + 1) + static_cast<size_t>(row) * (width + 1);
+            rowSums[row + 1] = rowSums[row] + Normalize(conditional, sums.data(), width);
+        }
+
+        const double total = Normalize(data.data(), rowSums.data(), height);
+        distribution.m_Sampling = Enabled && Scene::SkyboxStrength > 0.0f && total > 0.0;
+    }
+
+    void Update()
+    {
+        const BuiltState state = CurrentState();
+        if (DistributionBuffer && !ImageChanged && state == Built) return;
+        ImageChanged = false;
+        Built = state;
+
+        Distribution distribution;
+        if (ImageWidth > 0 && ImageHeight > 0) Build(Image.data(), ImageWidth, ImageHeight, distribution);
+        const DistributionHeader header{
+            distribution.m_Width, distribution.m_Height, distribution.m_Sampling ? 1 : 0, 0
+        };
+        const std::vector<float>& data = distribution.m_Cdf;
+
+        if (!DistributionBuffer) glGenBuffers(1, &DistributionBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, DistributionBuffer);
+        // Never empty, even without an image, so the block is always backed
+        const size_t dataSize = std::max<size_t>(data.size(), 1) * sizeof(float);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(sizeof(header) + dataSize), nullptr,
+                     GL_STATIC_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), &header);
+        if (!data.empty())
+        {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(header),
+                            static_cast<GLsizeiptr>(data.size() * sizeof(float)), data.data());
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DistributionBinding, DistributionBuffer);
+    }
+
+    void Delete()
+    {
+        glDeleteBuffers(1, &DistributionBuffer);
+        DistributionBuffer = 0;
+    }
+}
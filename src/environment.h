@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <GL/glew.h>
+
+// Importance sampling of the skybox. The skybox radiance (after the strength, gamma and ceiling settings) is turned
+// into a piecewise constant distribution over its equirectangular texels: a marginal CDF over the rows and one
+// conditional CDF per row, weighted by each row's solid angle. Both backends and CpuTracer use it for an explicit
+// skybox sample with a shadow ray at every diffuse bounce, combined with the bounce ray itself by multiple importance
+// sampling, so bright parts of the sky (the sun) no longer have to be found by chance.
+namespace Environment
+{
+    // Shader storage buffer binding point of the EnvironmentDistribution block in common.glsl
+    constexpr GLuint DistributionBinding = 9;
+    // Larger skyboxes are sampled through a smaller mip level, see SkyboxLoader::Upload
+    constexpr int MaxWidth = 512;
+
+    extern bool Enabled;
+
+    // The CDFs as they are uploaded: the marginal CDF of the rows (height + 1 entries), then the conditional CDF of
+    // every row (width + 1 entries each)
+    struct Distribution
+    {
+        int m_Width = 0, m_Height = 0;
+        bool m_Sampling = false; // False if disabled or the skybox is black
+        std::vector<float> m_Cdf;
+    };
+
+    // Builds the distribution of an RGB image with the current skybox settings, without uploading it. Used by
+    // Update, and by CpuTracer for its own copy of the skybox.
+    void Build(const float* rgb, int width, int height, Distribution& distribution);
+
+    // The image the distribution is built from: RGB floats, rows in the order of the skybox texture.
+    void SetImage(std::vector<float>&& rgb, int width, int height);
+    // Rebuilds and uploads the distribution if the image, the skybox settings or Enabled changed since the last call.
+    // Called before every pass.
+    void Update();
+    void Delete();
+}
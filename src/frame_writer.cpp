@@ -0,0 +1,314 @@
+#include "frame_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <GL/glew.h>
+
+#include "mapped_file.h"
+#include "renderer.h"
+#include "stb_image_write.h"
+
+namespace FrameWriter
+{
+    struct Job
+    {
+        std::string m_Filepath;
+        int m_Width;
+        int m_Height;
+        std::vector<unsigned char> m_Pixels; // RGB rows, bottom row first, no padding
+    };
+
+    // Push blocks while the queue is full, so a slow disk holds the render thread back instead of piling up frames
+    class JobQueue
+    {
+    public:
+        explicit JobQueue(const size_t capacity) : m_Capacity(capacity)
+        {
+        }
+
+        void Push(Job&& job)
+        {
+            std::unique_lock lock(m_Mutex);
+            m_NotFull.wait(lock, [this] { return m_Jobs.size() < m_Capacity; });
+            m_Jobs.push_back(std::move(job));
+            m_Unfinished++;
+            m_NotEmpty.notify_one();
+        }
+
+        // Returns false once the queue is closed and empty
+        bool Pop(Job& job)
+        {
+            std::unique_lock lock(m_Mutex);
+            m_NotEmpty.wait(lock, [this] { return !m_Jobs.empty() || m_Closed; });
+            if (m_Jobs.empty()) return false;
+
+            job = std::move(m_Jobs.front());
+            m_Jobs.pop_front();
+            m_NotFull.notify_one();
+            return true;
+        }
+
+        void MarkFinished()
+        {
+            std::lock_guard lock(m_Mutex);
+            if (--m_Unfinished == 0) m_Idle.notify_all();
+        }
+
+        void WaitUntilIdle()
+        {
+            std::unique_lock lock(m_Mutex);
+            m_Idle.wait(lock, [this] { return m_Unfinished == 0; });
+        }
+
+        void Close()
+        {
+            std::lock_guard lock(m_Mutex);
+            m_Closed = true;
+            m_NotEmpty.notify_all();
+        }
+
+    private:
+        std::mutex m_Mutex;
+        std::condition_variable m_NotEmpty, m_NotFull, m_Idle;
+        std::deque<Job> m_Jobs;
+        size_t m_Capacity;
+        size_t m_Unfinished = 0; // Queued or being encoded
+        bool m_Closed = false;
+    };
+
+    struct Readback
+    {
+        GLuint m_Buffer = 0;
+        GLsync m_Fence = nullptr;
+        std::string m_Filepath;
+        Format m_Format = Format::Png;
+        int m_Width = 0, m_Height = 0;
+    };
+
+    Format OutputFormat = Format::Png;
+
+    Readback Ring[RingSize];
+    int NextReadback = 0;
+    GLsizeiptr BufferSize = 0;
+
+    JobQueue* Queue = nullptr;
+    std::vector<std::thread> Workers;
+
+    // Pixel buffers of encoded frames, reused by the next readbacks
+    std::mutex StagingMutex;
+    std::vector<std::vector<unsigned char>> StagingBuffers;
+
+    // Frames that couldn't be written since the last Flush, counted by the workers too
+    std::atomic<int> FailedWrites = 0;
+
+    void ReportFailure(const std::string& filepath)
+    {
+        // One insertion, so lines from different workers don't interleave
+        std::cout << "Failed to write " + filepath + '\n';
+        FailedWrites++;
+    }
+
+    std::vector<unsigned char> AcquireStagingBuffer(const size_t size)
+    {
+        std::vector<unsigned char> buffer;
+        {
+            std::lock_guard lock(StagingMutex);
+            if (!StagingBuffers.empty())
+            {
+                buffer = std::move(StagingBuffers.back());
+                StagingBuffers.pop_back();
+            }
+        }
+        buffer.resize(size);
+        return buffer;
+    }
+
+    void WorkerLoop()
+    {
+        Job job;
+        while (Queue->Pop(job))
+        {
+            if (!stbi_write_png(job.m_Filepath.c_str(), job.m_Width, job.m_Height, 3, job.m_Pixels.data(),
+                                job.m_Width * 3))
+                ReportFailure(job.m_Filepath);
+
+            {
+                std::lock_guard lock(StagingMutex);
+                StagingBuffers.push_back(std::move(job.m_Pixels));
+            }
+            Queue->MarkFinished();
+        }
+    }
+
+    void StartWorkers()
+    {
+        // Leave one core to the render thread. hardware_concurrency() may return 0 when it can't tell.
+        const unsigned workerCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        Queue = new JobQueue(2 * workerCount);
+        // A global in stb_image_write, so set once here instead of racing from every worker
+        stbi_flip_vertically_on_write(true);
+        for (unsigned i = 0; i < workerCount; i++) Workers.emplace_back(WorkerLoop);
+    }
+
+    size_t ImageSize(const Format format, const int width, const int height)
+    {
+        const size_t pixelSize = format == Format::Pfm ? 3 * sizeof(float) : 3;
+        return pixelSize * width * height;
+    }
+
+    // Queues the pixels for one of the workers to encode
+    void WritePng(Readback& readback, const void* pixels, const size_t size)
+    {
+        Job job{std::move(readback.m_Filepath), readback.m_Width, readback.m_Height, AcquireStagingBuffer(size)};
+        std::memcpy(job.m_Pixels.data(), pixels, size);
+        Queue->Push(std::move(job));
+    }
+
+    // PFM rows go bottom to top like glReadPixels rows, so the pixels are copied as they are. The scale is padded
+    // with zeros until the header is a multiple of 4 bytes long, which keeps the floats aligned in the file.
+    void WritePfm(const Readback& readback, const void* pixels, const size_t size)
+    {
+        std::string header = "PF\n" + std::to_string(readback.m_Width) + " " + std::to_string(readback.m_Height) +
+            "\n-1.0"; // Negative scale: little endian
+        while ((header.size() + 1) % 4 != 0) header += '0';
+        header += '\n';
+
+        MappedFile::Mapping file;
+        if (!MappedFile::Create(readback.m_Filepath.c_str(), header.size() + size, file))
+        {
+            ReportFailure(readback.m_Filepath);
+            return;
+        }
+
+        unsigned char* data = static_cast<unsigned char*>(file.m_Data);
+        std::memcpy(data, header.data(), header.size());
+        std::memcpy(data + header.size(), pixels, size);
+        MappedFile::Close(file);
+    }
+
+    // Copies a finished readback out of its pixel pack buffer
+    void Retire(Readback& readback)
+    {
+        glClientWaitSync(readback.m_Fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(readback.m_Fence);
+        readback.m_Fence = nullptr;
+
+        const size_t size = ImageSize(readback.m_Format, readback.m_Width, readback.m_Height);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.m_Buffer);
+        if (const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(size),
+                                                  GL_MAP_READ_BIT))
+        {
+            if (readback.m_Format == Format::Pfm) WritePfm(readback, pixels, size);
+            else WritePng(readback, pixels, size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // Retires the pending readbacks oldest first, so frames reach the disk in order
+    void RetireAll(const bool onlyCompleted)
+    {
+        for (int i = 0; i < RingSize; i++)
+        {
+            Readback& readback = Ring[(NextReadback + i) % RingSize];
+            if (!readback.m_Fence) continue;
+
+            if (onlyCompleted && glClientWaitSync(readback.m_Fence, 0, 0) == GL_TIMEOUT_EXPIRED) return;
+            Retire(readback);
+        }
+    }
+
+    void AllocateBuffers(const GLsizeiptr size)
+    {
+        RetireAll(false);
+        for (Readback& readback : Ring)
+        {
+            if (!readback.m_Buffer) glGenBuffers(1, &readback.m_Buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.m_Buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        BufferSize = size;
+    }
+
+    void Capture(const std::string& filepath)
+    {
+        if (!Queue) StartWorkers();
+
+        const int width = Renderer::TargetWidth, height = Renderer::TargetHeight;
+        const auto size = static_cast<GLsizeiptr>(ImageSize(OutputFormat, width, height));
+        // Grows only, so switching to PNG keeps the buffers sized for PFM
+        if (size > BufferSize) AllocateBuffers(size);
+
+        Readback& readback = Ring[NextReadback];
+        if (readback.m_Fence) Retire(readback);
+        NextReadback = (NextReadback + 1) % RingSize;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.m_Buffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        // Into the bound pixel pack buffer, so this returns without waiting for the GPU
+        if (OutputFormat == Format::Pfm)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, Renderer::DisplayedFbo);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            glReadPixels(0, 0, width, height, GL_RGB, GL_FLOAT, nullptr);
+        }
+        else
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glReadBuffer(GL_FRONT);
+            glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        readback.m_Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readback.m_Filepath = filepath + (OutputFormat == Format::Pfm ? ".pfm" : ".png");
+        readback.m_Format = OutputFormat;
+        readback.m_Width = width;
+        readback.m_Height = height;
+    }
+
+    void Poll()
+    {
+        if (Queue) RetireAll(true);
+    }
+
+    bool Flush()
+    {
+        if (!Queue) return true;
+        RetireAll(false);
+        Queue->WaitUntilIdle();
+        return FailedWrites.exchange(0) == 0;
+    }
+
+    bool Shutdown()
+    {
+        if (!Queue) return true;
+        const bool written = Flush();
+
+        Queue->Close();
+        for (std::thread& worker : Workers) worker.join();
+        Workers.clear();
+        delete Queue;
+        Queue = nullptr;
+
+        for (Readback& readback : Ring)
+        {
+            glDeleteBuffers(1, &readback.m_Buffer);
+            readback = {};
+        }
+        NextReadback = 0;
+        BufferSize = 0;
+        StagingBuffers.clear();
+        return written;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+// Writes animation frames to disk without stalling the render thread. Each capture reads the frame into the next
+// pixel pack buffer of a ring; the pixels are only mapped a few frames later, once the fence behind the readback has
+// signalled. PNG encoding then runs on worker threads fed through a bounded queue, while PFM frames are copied
+// straight from the pixel pack buffer into a memory-mapped file.
+namespace FrameWriter
+{
+    enum class Format
+    {
+        Png, // The displayed image, clamped to 8 bits
+        Pfm  // The accumulated (or denoised) radiance as 32-bit floats, unclamped
+    };
+
+    extern Format OutputFormat;
+
+    // Frames in flight between glReadPixels and mapping the pixel pack buffer
+    constexpr int RingSize = 3;
+
+    // Starts reading the last frame DrawToScreen showed into the ring. The extension of OutputFormat is appended to
+    // filepath. Only blocks if the GPU is RingSize frames behind or the PNG queue is full.
+    void Capture(const std::string& filepath);
+    // Writes out every readback that has already completed. Called once per frame.
+    void Poll();
+    // Waits until every captured frame has been written to disk. Returns false if any frame captured since the last
+    // Flush could not be written; each failure is also printed when it happens.
+    bool Flush();
+    // Flushes, then stops the workers and frees the buffers. Returns what Flush returned.
+    bool Shutdown();
+}
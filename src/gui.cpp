@@ -8,12 +8,20 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include "adaptive.h"
 #include "animation.h"
+#include "checkpoint.h"
+#include "denoiser.h"
+#include "environment.h"
+#include "frame_writer.h"
+#include "renderer.h"
+#include "reprojection.h"
 #include "scene.h"
+#include "scene_file.h"
+#include "shader_variants.h"
+#include "skybox_loader.h"
 
 // The excessive use of the extern keyword here is probably not ideal. These functions should be declared in a header file but trying that resulted in linking errors whereas this works fine.
-extern float* LoadImageData(char const* filename, int* x, int* y, int* channelsInFile, int desiredChannels);
-extern void FreeImageData(void* imageData);
 extern bool RefreshRequired;
 
 namespace Gui
@@ -52,63 +60,57 @@ namespace Gui
         ImGui::DestroyContext();
     }
 
-    std::string ArrayElementName(const char* arrayName, const int index, const char* keyName)
+    // The widgets below only edit the Scene globals and record the change in Scene's change journal. Labels are
+    // string literals (made unique with ImGui::PushID where needed) so drawing them doesn't allocate.
+
+    bool FloatParameter(const char* label, const char* displayName, float* floatPtr)
     {
-        return std::string(arrayName).append("[").append(std::to_string(index)).append("].").append(keyName);
+        ImGui::Text("%s", displayName);
+        ImGui::SameLine();
+        return ImGui::InputFloat(label, floatPtr);
     }
 
-    void ShaderFloatParameter(const char* name, const char* displayName, float* floatPtr)
+    bool IntParameter(const char* label, const char* displayName, int* intPtr)
     {
         ImGui::Text("%s", displayName);
         ImGui::SameLine();
-        if (ImGui::InputFloat(std::string("##").append(name).c_str(), floatPtr))
-        {
-            if (Scene::BoundShader)
-                glUniform1f(glGetUniformLocation(Scene::BoundShader, name), *floatPtr);
-            RefreshRequired = true;
-        }
+        return ImGui::InputInt(label, intPtr);
     }
 
-    void ShaderSliderParameter(const char* name, const char* displayName, float* floatPtr)
+    bool SliderParameter(const char* label, const char* displayName, float* floatPtr)
     {
         ImGui::Text("%s", displayName);
         ImGui::SameLine();
-        if (ImGui::SliderFloat(std::string("##").append(name).c_str(), floatPtr, 0.0f, 1.0f))
-        {
-            if (Scene::BoundShader)
-                glUniform1f(glGetUniformLocation(Scene::BoundShader, name), *floatPtr);
-            RefreshRequired = true;
-        }
+        return ImGui::SliderFloat(label, floatPtr, 0.0f, 1.0f);
     }
 
-    void ShaderVecParameter(const char* name, const char* displayName, float* floatPtr)
+    bool VecParameter(const char* label, const char* displayName, float* floatPtr)
     {
         ImGui::Text("%s", displayName);
         ImGui::SameLine();
-        if (ImGui::InputFloat3(std::string("##").append(name).c_str(), floatPtr))
-        {
-            if (Scene::BoundShader)
-            {
-                glUniform3f(glGetUniformLocation(Scene::BoundShader, name), *(floatPtr + 0),
-                            *(floatPtr + 1), *(floatPtr + 2));
-            }
-            RefreshRequired = true;
-        }
+        return ImGui::InputFloat3(label, floatPtr);
     }
 
-    void ShaderColorParameter(const char* name, const char* displayName, float* floatPtr)
+    bool ColorParameter(const char* label, const char* displayName, float* floatPtr)
     {
         ImGui::Text("%s", displayName);
         ImGui::SameLine();
-        if (ImGui::ColorPicker3(name, floatPtr))
-        {
-            if (Scene::BoundShader)
-            {
-                glUniform3f(glGetUniformLocation(Scene::BoundShader, name), *(floatPtr + 0),
-                            *(floatPtr + 1), *(floatPtr + 2));
-            }
-            RefreshRequired = true;
-        }
+        return ImGui::ColorPicker3(label, floatPtr);
+    }
+
+    // Returns true if any field of the material was edited
+    bool MaterialParameters(Scene::Material& material)
+    {
+        bool changed = false;
+        changed |= ColorParameter("##albedo", "Albedo", material.m_Albedo);
+        changed |= ColorParameter("##specular", "Specular", material.m_Specular);
+        changed |= ColorParameter("##emission", "Emission", material.m_Emission);
+        changed |= FloatParameter("##emissionStrength", "Emission Strength", &material.m_EmissionStrength);
+
+        changed |= SliderParameter("##roughness", "Roughness", &material.m_Roughness);
+        changed |= SliderParameter("##specularHighlight", "Highlight", &material.m_SpecularHighlight);
+        changed |= SliderParameter("##specularExponent", "Exponent", &material.m_SpecularExponent);
+        return changed;
     }
 
     void ObjectSettingsUi()
@@ -119,120 +121,74 @@ namespace Gui
         if (Scene::SelectedObjectIndex != -1)
         {
             const int i = Scene::SelectedObjectIndex;
-            const std::string indexStr = std::to_string(i);
+            Scene::Object& object = Scene::Objects[i];
 
-            ImGui::Text("%s", std::string("Object #").append(indexStr).c_str());
+            ImGui::Text("Object #%d", i);
+            ImGui::PushID(i);
 
-            ShaderVecParameter(ArrayElementName("u_objects", i, "position").c_str(), "Position",
-                               Scene::Objects[i].m_Position);
+            bool geometryChanged = false;
+            geometryChanged |= VecParameter("##position", "Position", object.m_Position);
 
             ImGui::Text("Is box");
             ImGui::SameLine();
-            bool isBox = Scene::Objects[i].m_Type == 2;
-            const std::string typeVariableName = ArrayElementName("u_objects", i, "type");
-            const std::string scaleVariableName = ArrayElementName("u_objects", i, "scale");
-            if (ImGui::Checkbox(std::string("##").append(typeVariableName).c_str(), &isBox))
+            bool isBox = object.m_Type == 2;
+            if (ImGui::Checkbox("##type", &isBox))
             {
-                Scene::Objects[i].m_Type = isBox ? 2 : 1;
-                if (Scene::BoundShader)
-                {
-                    glUniform1ui(glGetUniformLocation(Scene::BoundShader, typeVariableName.c_str()),
-                                 Scene::Objects[i].m_Type);
-                }
-                RefreshRequired = true;
+                object.m_Type = isBox ? 2 : 1;
+                geometryChanged = true;
 
                 if (isBox)
                 {
-                    Scene::Objects[i].m_Scale[0] *= 2.0f;
-                    Scene::Objects[i].m_Scale[1] *= 2.0f;
-                    Scene::Objects[i].m_Scale[2] *= 2.0f;
+                    object.m_Scale[0] *= 2.0f;
+                    object.m_Scale[1] *= 2.0f;
+                    object.m_Scale[2] *= 2.0f;
                 }
                 else
                 {
-                    const float minDimension = std::min({
-                        Scene::Objects[i].m_Scale[0], Scene::Objects[i].m_Scale[1], Scene::Objects[i].m_Scale[2]
-                    });
-                    Scene::Objects[i].m_Scale[0] = minDimension / 2.0f;
-                    Scene::Objects[i].m_Scale[1] = minDimension / 2.0f;
-                    Scene::Objects[i].m_Scale[2] = minDimension / 2.0f;
-                }
-
-                if (Scene::BoundShader)
-                {
-                    glUniform3f(glGetUniformLocation(Scene::BoundShader, scaleVariableName.c_str()),
-                                Scene::Objects[i].m_Scale[0], Scene::Objects[i].m_Scale[1],
-                                Scene::Objects[i].m_Scale[2]);
+                    const float minDimension = std::min({object.m_Scale[0], object.m_Scale[1], object.m_Scale[2]});
+                    object.m_Scale[0] = minDimension / 2.0f;
+                    object.m_Scale[1] = minDimension / 2.0f;
+                    object.m_Scale[2] = minDimension / 2.0f;
                 }
             }
 
-            if (Scene::Objects[i].m_Type == 1)
+            if (object.m_Type == 1)
             {
-                ImGui::Text("Radius");
-                ImGui::SameLine();
-                if (ImGui::InputFloat(std::string("##").append(scaleVariableName).c_str(),
-                                      &Scene::Objects[i].m_Scale[0]))
+                if (FloatParameter("##scale", "Radius", &object.m_Scale[0]))
                 {
-                    Scene::Objects[i].m_Scale[1] = Scene::Objects[i].m_Scale[0];
-                    Scene::Objects[i].m_Scale[2] = Scene::Objects[i].m_Scale[0];
-                    if (Scene::BoundShader)
-                    {
-                        glUniform3f(
-                            glGetUniformLocation(Scene::BoundShader, scaleVariableName.c_str()),
-                            Scene::Objects[i].m_Scale[0], Scene::Objects[i].m_Scale[1], Scene::Objects[i].m_Scale[2]);
-                    }
-                    RefreshRequired = true;
+                    object.m_Scale[1] = object.m_Scale[0];
+                    object.m_Scale[2] = object.m_Scale[0];
+                    geometryChanged = true;
                 }
             }
-            else if (Scene::Objects[i].m_Type == 2)
+            else if (object.m_Type == 2)
             {
-                ShaderVecParameter(scaleVariableName.c_str(), "Scale", Scene::Objects[i].m_Scale);
+                geometryChanged |= VecParameter("##scale", "Scale", object.m_Scale);
             }
 
-            ShaderColorParameter(ArrayElementName("u_objects", i, "material.albedo").c_str(), "Albedo",
-                                 Scene::Objects[i].m_Material.m_Albedo);
-            ShaderColorParameter(ArrayElementName("u_objects", i, "material.specular").c_str(), "Specular",
-                                 Scene::Objects[i].m_Material.m_Specular);
-            ShaderColorParameter(ArrayElementName("u_objects", i, "material.emission").c_str(), "Emission",
-                                 Scene::Objects[i].m_Material.m_Emission);
-            ShaderFloatParameter(ArrayElementName("u_objects", i, "material.emissionStrength").c_str(),
-                                 "Emission Strength", &Scene::Objects[i].m_Material.m_EmissionStrength);
-
-            ShaderSliderParameter(ArrayElementName("u_objects", i, "material.roughness").c_str(), "Roughness",
-                                  &Scene::Objects[i].m_Material.m_Roughness);
-            ShaderSliderParameter(ArrayElementName("u_objects", i, "material.specularHighlight").c_str(), "Highlight",
-                                  &Scene::Objects[i].m_Material.m_SpecularHighlight);
-            ShaderSliderParameter(ArrayElementName("u_objects", i, "material.specularExponent").c_str(), "Exponent",
-                                  &Scene::Objects[i].m_Material.m_SpecularExponent);
+            if (geometryChanged) Scene::MarkObjectDirty(i, true);
 
+            // Edited as a copy since the palette entry may be shared with other objects
+            Scene::Material material = Scene::Materials[object.m_MaterialIndex];
+            if (MaterialParameters(material)) Scene::SetObjectMaterial(i, material);
+
+            ImGui::PopID();
             ImGui::NewLine();
         }
         else
         {
             ImGui::Text("Plane");
 
+            bool changed = false;
             ImGui::Text("Visible");
             ImGui::SameLine();
-            if (ImGui::Checkbox("##plane_visible", &Scene::PlaneVisible))
-            {
-                if (Scene::BoundShader)
-                {
-                    glUniform1ui(glGetUniformLocation(Scene::BoundShader, "u_planeVisible"),
-                                 Scene::PlaneVisible);
-                }
-                RefreshRequired = true;
-            }
+            changed |= ImGui::Checkbox("##plane_visible", &Scene::PlaneVisible);
 
-            ShaderColorParameter("u_planeMaterial.albedo", "Albedo", Scene::PlaneMaterial.m_Albedo);
-            ShaderColorParameter("u_planeMaterial.specular", "Specular", Scene::PlaneMaterial.m_Specular);
-            ShaderColorParameter("u_planeMaterial.emission", "Emission", Scene::PlaneMaterial.m_Emission);
-            ShaderFloatParameter("u_planeMaterial.emissionStrength", "Emission Strength",
-                                 &Scene::PlaneMaterial.m_EmissionStrength);
-
-            ShaderSliderParameter("u_planeMaterial.roughness", "Roughness", &Scene::PlaneMaterial.m_Roughness);
-            ShaderSliderParameter("u_planeMaterial.specularHighlight", "Highlight",
-                                  &Scene::PlaneMaterial.m_SpecularHighlight);
-            ShaderSliderParameter("u_planeMaterial.specularExponent", "Exponent",
-                                  &Scene::PlaneMaterial.m_SpecularExponent);
+            ImGui::PushID("plane");
+            changed |= MaterialParameters(Scene::PlaneMaterial);
+            ImGui::PopID();
+
+            if (changed) Scene::MarkSettingsDirty();
         }
 
 
@@ -247,85 +203,22 @@ namespace Gui
         ImGui::PushItemWidth(-1);
         for (size_t i = 0; i < Scene::Lights.size(); i++)
         {
-            std::string indexStr = std::to_string(i);
+            Scene::PointLight& light = Scene::Lights[i];
+            ImGui::PushID(static_cast<int>(i));
 
-            ImGui::Text("%s", std::string("Light #").append(indexStr).c_str());
-            ImGui::Text("Position");
-            ImGui::SameLine();
-            if (ImGui::InputFloat3(std::string("##light_pos_").append(indexStr).c_str(), Scene::Lights[i].m_Position))
-            {
-                if (Scene::BoundShader)
-                {
-                    glUniform3f(
-                        glGetUniformLocation(Scene::BoundShader,
-                                             std::string("u_lights[").append(std::to_string(i)).append("].position").
-                                                                      c_str()), Scene::Lights[i].m_Position[0],
-                        Scene::Lights[i].m_Position[1], Scene::Lights[i].m_Position[2]);
-                }
-                RefreshRequired = true;
-            }
+            bool changed = false;
+            ImGui::Text("Light #%zu", i);
+            changed |= VecParameter("##light_pos", "Position", light.m_Position);
+            changed |= FloatParameter("##light_radius", "Radius", &light.m_Radius);
 
-            ImGui::Text("Radius");
-            ImGui::SameLine();
-            if (ImGui::InputFloat(std::string("##light_radius_").append(indexStr).c_str(), &Scene::Lights[i].m_Radius))
-            {
-                if (Scene::BoundShader)
-                {
-                    glUniform1f(
-                        glGetUniformLocation(Scene::BoundShader,
-                                             std::string("u_lights[").append(std::to_string(i)).append("].radius").
-                                                                      c_str()),
-                        Scene::Lights[i].m_Radius);
-                }
-                RefreshRequired = true;
-            }
+            ImGui::Text("Light #%zu", i);
+            changed |= ColorParameter("##light_color", "Color", light.m_Color);
+            changed |= FloatParameter("##light_power", "Power", &light.m_Power);
+            changed |= FloatParameter("##light_reach", "Reach", &light.m_Reach);
 
-            ImGui::Text("%s", std::string("Light #").append(indexStr).c_str());
-            ImGui::Text("Color");
-            ImGui::SameLine();
-            if (ImGui::ColorPicker3(std::string("##light_color_").append(indexStr).c_str(), Scene::Lights[i].m_Color))
-            {
-                if (Scene::BoundShader)
-                {
-                    glUniform3f(
-                        glGetUniformLocation(Scene::BoundShader,
-                                             std::string("u_lights[").append(std::to_string(i)).append("].color").
-                                                                      c_str()),
-                        Scene::Lights[i].m_Color[0], Scene::Lights[i].m_Color[1], Scene::Lights[i].m_Color[2]);
-                }
-                RefreshRequired = true;
-            }
-
-            ImGui::Text("Power");
-            ImGui::SameLine();
-            if (ImGui::InputFloat(std::string("##light_power_").append(indexStr).c_str(), &Scene::Lights[i].m_Power))
-            {
-                if (Scene::BoundShader)
-                {
-                    glUniform1f(
-                        glGetUniformLocation(Scene::BoundShader,
-                                             std::string("u_lights[").append(std::to_string(i)).append("].power").
-                                                                      c_str()),
-                        Scene::Lights[i].m_Power);
-                }
-                RefreshRequired = true;
-            }
-
-            ImGui::Text("Reach");
-            ImGui::SameLine();
-            if (ImGui::InputFloat(std::string("##light_reach_").append(indexStr).c_str(), &Scene::Lights[i].m_Reach))
-            {
-                if (Scene::BoundShader)
-                {
-                    glUniform1f(
-                        glGetUniformLocation(Scene::BoundShader,
-                                             std::string("u_lights[").append(std::to_string(i)).append("].reach").
-                                                                      c_str()),
-                        Scene::Lights[i].m_Reach);
-                }
-                RefreshRequired = true;
-            }
+            if (changed) Scene::MarkLightDirty(i);
 
+            ImGui::PopID();
             if (i < 2) ImGui::NewLine();
         }
 
@@ -340,73 +233,87 @@ namespace Gui
                     ImGui::GetIO().Framerate);
 
         ImGui::PushItemWidth(-1);
-        ImGui::Text("Shadow resolution");
+        bool changed = false;
+        changed |= IntParameter("##shadowResolution", "Shadow resolution", &Scene::ShadowResolution);
+        changed |= IntParameter("##lightBounces", "Light bounces", &Scene::LightBounces);
+        changed |= IntParameter("##framePasses", "Passes per frame", &Scene::FramePasses);
+        changed |= FloatParameter("##blur", "Blur", &Scene::Blur);
+        changed |= FloatParameter("##bloomRadius", "Bloom Radius", &Scene::BloomRadius);
+        changed |= FloatParameter("##bloomIntensity", "Bloom Intensity", &Scene::BloomIntensity);
+        if (changed) Scene::MarkSettingsDirty();
+
+        ImGui::Text("Wavefront (compute)");
         ImGui::SameLine();
-        if (ImGui::InputInt("##shadowResolution", &Scene::ShadowResolution))
+        bool wavefront = Renderer::ActiveBackend == Renderer::Backend::Wavefront;
+        if (ImGui::Checkbox("##wavefront", &wavefront))
         {
-            if (Scene::BoundShader)
-            {
-                glUniform1i(glGetUniformLocation(Scene::BoundShader, "u_shadowResolution"),
-                            Scene::ShadowResolution);
-            }
-            RefreshRequired = true;
+            if (Renderer::SetBackend(wavefront ? Renderer::Backend::Wavefront : Renderer::Backend::Fragment))
+                RefreshRequired = true;
+            else
+                std::cout << "Failed to compile the wavefront shaders\n";
         }
 
-        ImGui::Text("Light bounces");
+        // Same image either way, so the accumulation continues
+        ImGui::Text("Specialized shader");
         ImGui::SameLine();
-        if (ImGui::InputInt("##lightBounces", &Scene::LightBounces))
-        {
-            if (Scene::BoundShader)
-            {
-                glUniform1i(glGetUniformLocation(Scene::BoundShader, "u_lightBounces"),
-                            Scene::LightBounces);
-            }
-            RefreshRequired = true;
-        }
+        if (ImGui::Checkbox("##specializedShader", &ShaderVariants::Enabled)) ShaderVariants::Update();
 
-        ImGui::Text("Passes per frame");
+        ImGui::Text("Adaptive sampling");
         ImGui::SameLine();
-        if (ImGui::InputInt("##framePasses", &Scene::FramePasses))
+        bool adaptive = Adaptive::Enabled;
+        if (ImGui::Checkbox("##adaptiveSampling", &adaptive))
         {
-            if (Scene::BoundShader)
-            {
-                glUniform1i(glGetUniformLocation(Scene::BoundShader, "u_framePasses"),
-                            Scene::FramePasses);
-            }
-            RefreshRequired = true;
+            // The convergence mask is only valid for the accumulation it was computed for
+            if (Adaptive::SetEnabled(adaptive))
+                RefreshRequired = true;
+            else
+                std::cout << "Failed to compile the convergence shader\n";
         }
-
-        ImGui::Text("Blur");
-        ImGui::SameLine();
-        if (ImGui::InputFloat("##blur", &Scene::Blur))
+        if (Adaptive::Enabled)
         {
-            if (Scene::BoundShader)
-                glUniform1f(glGetUniformLocation(Scene::BoundShader, "u_blur"), Scene::Blur);
-            RefreshRequired = true;
+            // Tiles are re-evaluated after every pass, so these take effect without restarting the accumulation
+            FloatParameter("##convergenceThreshold", "Convergence threshold", &Adaptive::Threshold);
+            IntParameter("##minAdaptivePasses", "Minimum passes", &Adaptive::MinPasses);
+            ImGui::Text("Show sample count");
+            ImGui::SameLine();
+            ImGui::Checkbox("##showSampleCount", &Adaptive::ShowSampleCount);
         }
 
-        ImGui::Text("Bloom Radius");
+        // The denoiser only affects the display pass, so none of this restarts the accumulation
+        ImGui::Text("Denoise");
         ImGui::SameLine();
-        if (ImGui::InputFloat("##bloomRadius", &Scene::BloomRadius))
+        bool denoise = Denoiser::Enabled;
+        if (ImGui::Checkbox("##denoise", &denoise) && !Denoiser::SetEnabled(denoise))
+            std::cout << "Failed to compile the denoise shader\n";
+        if (Denoiser::Enabled)
         {
-            if (Scene::BoundShader)
-            {
-                glUniform1f(glGetUniformLocation(Scene::BoundShader, "u_bloomRadius"),
-                            Scene::BloomRadius);
-            }
-            RefreshRequired = true;
+            IntParameter("##denoiseIterations", "Iterations", &Denoiser::Iterations);
+            FloatParameter("##denoiseColorSigma", "Color sigma", &Denoiser::ColorSigma);
+            FloatParameter("##denoiseNormalPower", "Normal power", &Denoiser::NormalPower);
+            FloatParameter("##denoiseDepthSigma", "Depth sigma", &Denoiser::DepthSigma);
+            FloatParameter("##denoiseAlbedoSigma", "Albedo sigma", &Denoiser::AlbedoSigma);
         }
 
-        ImGui::Text("Bloom Intensity");
+        // Saves the accumulation to disk every interval and restores it on startup, see Checkpoint
+        ImGui::Text("Checkpoint");
         ImGui::SameLine();
-        if (ImGui::InputFloat("##bloomIntensity", &Scene::BloomIntensity))
+        ImGui::Checkbox("##checkpoint", &Checkpoint::Enabled);
+        if (Checkpoint::Enabled) FloatParameter("##checkpointInterval", "Interval (s)", &Checkpoint::Interval);
+
+        // Binary unless the name ends in .txt, see SceneFile
+        static char sceneFilename[64] = "scene.rtscene";
+        ImGui::Text("Scene file");
+        ImGui::SameLine();
+        ImGui::InputText("##sceneFileName", sceneFilename, 64);
+        if (ImGui::Button("Save scene") && !SceneFile::SaveAny(sceneFilename))
+            std::cout << "Failed to save " << sceneFilename << '\n';
+        ImGui::SameLine();
+        if (ImGui::Button("Load scene"))
         {
-            if (Scene::BoundShader)
-            {
-                glUniform1f(glGetUniformLocation(Scene::BoundShader, "u_bloomIntensity"),
-                            Scene::BloomIntensity);
-            }
-            RefreshRequired = true;
+            if (SceneFile::LoadAny(sceneFilename))
+                RefreshRequired = true;
+            else
+                std::cout << "Failed to load " << sceneFilename << '\n';
         }
 
         if (ImGui::Button("Quit"))
@@ -423,41 +330,16 @@ namespace Gui
         ImGui::Begin("Skybox");
 
         ImGui::PushItemWidth(-1);
-        ImGui::Text("Intensity");
+        bool changed = false;
+        changed |= FloatParameter("##skyboxStrength", "Intensity", &Scene::SkyboxStrength);
+        changed |= FloatParameter("##skyboxGamma", "Gamma", &Scene::SkyboxGamma);
+        changed |= FloatParameter("##skyboxCeiling", "Ceiling", &Scene::SkyboxCeiling);
+        if (changed) Scene::MarkSettingsDirty();
+
+        // Converges to the same image either way, so the accumulation carries on
+        ImGui::Text("Importance sampling");
         ImGui::SameLine();
-        if (ImGui::InputFloat("##skyboxStrength", &Scene::SkyboxStrength))
-        {
-            if (Scene::BoundShader)
-            {
-                glUniform1f(glGetUniformLocation(Scene::BoundShader, "u_skyboxStrength"),
-                            Scene::SkyboxStrength);
-            }
-            RefreshRequired = true;
-        }
-
-        ImGui::Text("Gamma");
-        ImGui::SameLine();
-        if (ImGui::InputFloat("##skyboxGamma", &Scene::SkyboxGamma))
-        {
-            if (Scene::BoundShader)
-            {
-                glUniform1f(glGetUniformLocation(Scene::BoundShader, "u_skyboxGamma"),
-                            Scene::SkyboxGamma);
-            }
-            RefreshRequired = true;
-        }
-
-        ImGui::Text("Ceiling");
-        ImGui::SameLine();
-        if (ImGui::InputFloat("##skyboxCeiling", &Scene::SkyboxCeiling))
-        {
-            if (Scene::BoundShader)
-            {
-                glUniform1f(glGetUniformLocation(Scene::BoundShader, "u_skyboxCeiling"),
-                            Scene::SkyboxCeiling);
-            }
-            RefreshRequired = true;
-        }
+        ImGui::Checkbox("##skyboxSampling", &Environment::Enabled);
 
         static char skyboxFilename[64];
 
@@ -465,29 +347,16 @@ namespace Gui
         ImGui::SameLine();
         ImGui::InputText("##skyboxFileName", skyboxFilename, 64);
 
+        // Loads in the background; the main loop restarts the accumulation once the new skybox is uploaded
         if (ImGui::Button("Load"))
         {
-            int sbWidth, sbHeight, sbChannels;
-            if (float* skyboxData = LoadImageData(std::string("skyboxes\\").append(skyboxFilename).c_str(), &sbWidth,
-                                                  &sbHeight, &sbChannels, 0))
-            {
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, Scene::SkyboxTexture);
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, sbWidth, sbHeight, 0, GL_RGB, GL_FLOAT, skyboxData);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                glActiveTexture(GL_TEXTURE0);
-
-                FreeImageData(skyboxData);
-
-                skyboxFilename[0] = 0;
-
-                RefreshRequired = true;
-            }
-            else
-            {
-                std::cout << "Failed to load skyboxes\\" << skyboxFilename << '\n';
-            }
+            SkyboxLoader::LoadAsync(std::string("skyboxes\\").append(skyboxFilename));
+            skyboxFilename[0] = 0;
+        }
+        if (SkyboxLoader::Pending())
+        {
+            ImGui::SameLine();
+            ImGui::Text("Loading...");
         }
 
         ImGui::PopItemWidth();
@@ -512,6 +381,25 @@ namespace Gui
         ImGui::InputFloat("animationSpeed", &Animation::CameraSpeed);
         ImGui::InputInt("animationFrameRate", &Animation::FrameRate);
 
+        ImGui::Text("HDR output (PFM)");
+        ImGui::SameLine();
+        bool hdrOutput = FrameWriter::OutputFormat == FrameWriter::Format::Pfm;
+        if (ImGui::Checkbox("##hdrOutput", &hdrOutput))
+            FrameWriter::OutputFormat = hdrOutput ? FrameWriter::Format::Pfm : FrameWriter::Format::Png;
+
+        // Lets animationFramePasses be much lower for the same noise, see Reprojection
+        ImGui::Text("Reproject samples");
+        ImGui::SameLine();
+        bool reproject = Reprojection::Enabled;
+        if (ImGui::Checkbox("##reproject", &reproject) && !Reprojection::SetEnabled(reproject))
+            std::cout << "Failed to compile the reprojection shader\n";
+        if (Reprojection::Enabled)
+        {
+            IntParameter("##reprojectMaxHistory", "Max reused passes", &Reprojection::MaxHistory);
+            FloatParameter("##reprojectDepthTolerance", "Depth tolerance", &Reprojection::DepthTolerance);
+            FloatParameter("##reprojectNormalThreshold", "Normal threshold", &Reprojection::NormalThreshold);
+        }
+
         if (ImGui::Button("Render"))
         {
             Animation::CurrentFrame = -1;
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit FNV-1a, for fingerprinting render state (not for hash tables or anything adversarial).
+namespace Hash
+{
+    constexpr uint64_t Offset = 14695981039346656037ull;
+    constexpr uint64_t Prime = 1099511628211ull;
+
+    inline uint64_t Bytes(const void* data, const size_t size, uint64_t hash = Offset)
+    {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * Prime;
+        return hash;
+    }
+
+    // Only for values without padding bytes, whose contents are unspecified
+    template <typename T>
+    uint64_t Value(const T& value, const uint64_t hash = Offset)
+    {
+        return Bytes(&value, sizeof(T), hash);
+    }
+}
@@ -0,0 +1,601 @@
+// Offscreen renderer for machines without a display. Renders a scene through the same fragment.glsl as the
+// interactive application, but without a visible window, GUI or buffer swaps, then writes the result to disk.
+//
+// Usage: opengl-raytracing-headless [options]
+//   --scene basic|mirror|random   Procedural scene to render (default: basic), or a scene file (see SceneFile)
+//   --save-scene <path>           Save the scene before rendering, as text if path ends in .txt, binary otherwise
+//   --skybox <path>               HDR skybox (default: skyboxes\kiara_9_dusk_2k.hdr)
+//   --width <px> --height <px>    Output resolution (default: 1920x1080)
+//   --passes <n>                  Accumulation passes (default: 64)
+//   --frame-passes <n>            Samples per pixel per pass, same as "Passes per frame" in the GUI
+//   --camera <x> <y> <z> <yaw> <pitch>
+//   --output <path>               Output PNG (default: render.png)
+//   --cpu                         Render with the CPU reference path tracer instead of OpenGL (no GPU needed)
+//   --wavefront                   Render with the wavefront compute shaders instead of fragment.glsl
+//   --adaptive <threshold>        Stop sampling tiles whose relative standard error is below threshold (e.g. 0.01)
+//   --denoise                     Run the edge-avoiding denoiser over the result (also with --cpu)
+//   --no-sky-sampling             Only find the skybox through bounces, without explicit samples (see Environment)
+//   --generic-shader              Don't specialize fragment.glsl for the scene (see ShaderVariants)
+//   --no-program-cache            Compile every shader instead of loading linked programs from shader_cache
+//   --threads <n>                 CPU tracer worker threads (default: all hardware threads)
+//   --generate-blue-noise <path>  Write the blue-noise tile the samplers use (see BlueNoise) and exit
+//   --animation <frames> <x> <y> <z> <yaw> <pitch>
+//                                 Render frames moving from the --camera pose to this one instead of a single image
+//   --output-dir <dir>            Animation frames directory (default: anim). Rerunning skips the finished frames.
+//   --checkpoint                  Save the accumulation every minute and resume a matching one, see Checkpoint (GPU)
+//   --workers <n>                 Animation worker processes, each rendering the frames it claims (default: 1)
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "adaptive.h"
+#include "blue_noise.h"
+#include "bvh.h"
+#include "checkpoint.h"
+#include "cpu_tracer.h"
+#include "denoiser.h"
+#include "environment.h"
+#include "program_cache.h"
+#include "render_farm.h"
+#include "renderer.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "shader_variants.h"
+#include "skybox_loader.h"
+#include "wavefront.h"
+
+#include "stb_image.h"
+
+#include "procedural_scenes.h"
+
+struct HeadlessOptions
+{
+    std::string m_Scene = "basic";
+    std::string m_SaveScene;
+    std::string m_Skybox = "skyboxes\\kiara_9_dusk_2k.hdr";
+    std::string m_Output = "render.png";
+    int m_Width = 1920;
+    int m_Height = 1080;
+    int m_Passes = 64;
+    bool m_Cpu = false;
+    bool m_Wavefront = false;
+    float m_AdaptiveThreshold = 0.0f; // 0 = adaptive sampling disabled
+    bool m_Denoise = false;
+    bool m_Checkpoint = false;
+    int m_Threads = 0;
+    std::string m_BlueNoiseOutput; // Set by --generate-blue-noise
+
+    // Animation from the --camera pose to the end pose, see RenderFarm
+    int m_AnimationFrames = 0;
+    glm::vec3 m_EndPosition{0.0f};
+    float m_EndYaw = 0.0f, m_EndPitch = 0.0f;
+    std::string m_OutputDirectory = "anim";
+    int m_Workers = 1;
+    bool m_Worker = false; // Passed to the processes the coordinator starts
+
+    // Set on the command line, so they override the ones stored in a scene file
+    bool m_CameraGiven = false;
+    bool m_FramePassesGiven = false;
+};
+
+// Prints the time elapsed since the previous call, labelled with the phase that just finished.
+class PhaseTimer
+{
+public:
+    explicit PhaseTimer(const bool print = true) : m_Last(std::chrono::steady_clock::now()), m_Print(print)
+    {
+    }
+
+    double Lap(const char* phase)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        const double seconds = std::chrono::duration<double>(now - m_Last).count();
+        m_Last = now;
+        if (m_Print) printf("  %-16s %9.3f ms\n", phase, seconds * 1000.0);
+        return seconds;
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_Last;
+    bool m_Print;
+};
+
+// Unlike std::stoi and std::stof, these don't throw on a typo and reject trailing characters ("64x", "1,5")
+bool ParseInt(const char* text, int& value)
+{
+    char* end;
+    errno = 0;
+    const long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < INT_MIN || parsed > INT_MAX) return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+bool ParseFloat(const char* text, float& value)
+{
+    char* end;
+    errno = 0;
+    const float parsed = std::strtof(text, &end);
+    if (end == text || *end != '\0' || errno == ERANGE) return false;
+    value = parsed;
+    return true;
+}
+
+bool ParseOptions(const int argc, char** argv, HeadlessOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        bool valid = true;
+
+        if (!strcmp(arg, "--scene") && hasValue) options.m_Scene = argv[++i];
+        else if (!strcmp(arg, "--save-scene") && hasValue) options.m_SaveScene = argv[++i];
+        else if (!strcmp(arg, "--skybox") && hasValue) options.m_Skybox = argv[++i];
+        else if (!strcmp(arg, "--output") && hasValue) options.m_Output = argv[++i];
+        else if (!strcmp(arg, "--width") && hasValue) valid = ParseInt(argv[++i], options.m_Width);
+        else if (!strcmp(arg, "--height") && hasValue) valid = ParseInt(argv[++i], options.m_Height);
+        else if (!strcmp(arg, "--passes") && hasValue) valid = ParseInt(argv[++i], options.m_Passes);
+        else if (!strcmp(arg, "--threads") && hasValue) valid = ParseInt(argv[++i], options.m_Threads);
+        else if (!strcmp(arg, "--cpu")) options.m_Cpu = true;
+        else if (!strcmp(arg, "--wavefront")) options.m_Wavefront = true;
+        else if (!strcmp(arg, "--adaptive") && hasValue) valid = ParseFloat(argv[++i], options.m_AdaptiveThreshold);
+        else if (!strcmp(arg, "--denoise")) options.m_Denoise = true;
+        else if (!strcmp(arg, "--no-sky-sampling")) Environment::Enabled = false;
+        else if (!strcmp(arg, "--generic-shader")) ShaderVariants::Enabled = false;
+        else if (!strcmp(arg, "--no-program-cache")) ProgramCache::Enabled = false;
+        else if (!strcmp(arg, "--checkpoint")) options.m_Checkpoint = true;
+        else if (!strcmp(arg, "--generate-blue-noise") && hasValue) options.m_BlueNoiseOutput = argv[++i];
+        else if (!strcmp(arg, "--frame-passes") && hasValue)
+        {
+            valid = ParseInt(argv[++i], Scene::FramePasses);
+            options.m_FramePassesGiven = true;
+        }
+        else if (!strcmp(arg, "--output-dir") && hasValue) options.m_OutputDirectory = argv[++i];
+        else if (!strcmp(arg, "--workers") && hasValue) valid = ParseInt(argv[++i], options.m_Workers);
+        else if (!strcmp(arg, "--worker")) options.m_Worker = true;
+        else if (!strcmp(arg, "--animation") && i + 6 < argc)
+        {
+            valid = ParseInt(argv[i + 1], options.m_AnimationFrames) &&
+                ParseFloat(argv[i + 2], options.m_EndPosition.x) && ParseFloat(argv[i + 3], options.m_EndPosition.y) &&
+                ParseFloat(argv[i + 4], options.m_EndPosition.z) && ParseFloat(argv[i + 5], options.m_EndYaw) &&
+                ParseFloat(argv[i + 6], options.m_EndPitch);
+            i += 6;
+        }
+        else if (!strcmp(arg, "--camera") && i + 5 < argc)
+        {
+            valid = ParseFloat(argv[i + 1], Scene::CameraPosition.x) &&
+                ParseFloat(argv[i + 2], Scene::CameraPosition.y) && ParseFloat(argv[i + 3], Scene::CameraPosition.z) &&
+                ParseFloat(argv[i + 4], Scene::CameraYaw) && ParseFloat(argv[i + 5], Scene::CameraPitch);
+            options.m_CameraGiven = true;
+            i += 5;
+        }
+        else
+        {
+            std::cout << "Unknown or incomplete argument: " << arg << '\n';
+            return false;
+        }
+
+        if (!valid)
+        {
+            std::cout << "Invalid number in argument: " << arg << '\n';
+            return false;
+        }
+    }
+
+    return options.m_Width > 0 && options.m_Height > 0 && options.m_Passes > 0 && options.m_Workers > 0;
+}
+
+bool PlaceScene(const HeadlessOptions& options)
+{
+    const std::string& name = options.m_Scene;
+    if (name == "basic") PlaceBasicScene();
+    else if (name == "mirror") PlaceMirrorSpheres();
+    else if (name == "random") PlaceRandomSpheres();
+    else
+    {
+        const glm::vec3 cameraPosition = Scene::CameraPosition;
+        const float cameraYaw = Scene::CameraYaw, cameraPitch = Scene::CameraPitch;
+        const int framePasses = Scene::FramePasses;
+        if (!SceneFile::LoadAny(name.c_str()))
+        {
+            std::cout << "Unknown scene or invalid scene file: " << name << '\n';
+            return false;
+        }
+
+        if (options.m_CameraGiven)
+        {
+            Scene::CameraPosition = cameraPosition;
+            Scene::CameraYaw = cameraYaw;
+            Scene::CameraPitch = cameraPitch;
+        }
+        if (options.m_FramePassesGiven) Scene::FramePasses = framePasses;
+    }
+
+    // Animation workers all get the same options and would write the same file
+    if (!options.m_SaveScene.empty() && !options.m_Worker && !SceneFile::SaveAny(options.m_SaveScene.c_str()))
+    {
+        std::cout << "Failed to save the scene to " << options.m_SaveScene << '\n';
+        return false;
+    }
+
+    return true;
+}
+
+// Creates a GL 4.3 context that never presents anything. GLFW 3.4's null platform with an EGL context does not need a
+// display server at all; older GLFW versions (or machines without EGL) fall back to a hidden window.
+GLFWwindow* CreateOffscreenContext()
+{
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 4)
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    if (glfwInit())
+    {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        if (GLFWwindow* window = glfwCreateWindow(1, 1, "OpenGL Raytracing (headless)", nullptr, nullptr))
+            return window;
+
+        std::cout << "Surfaceless EGL context unavailable, falling back to a hidden window\n";
+        glfwTerminate();
+    }
+    glfwInitHint(GLFW_PLATFORM, GLFW_ANY_PLATFORM);
+#endif
+
+    if (!glfwInit())
+    {
+        std::cout << "Failed to initialize GLFW!\n";
+        return nullptr;
+    }
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    return glfwCreateWindow(1, 1, "OpenGL Raytracing (headless)", nullptr, nullptr);
+}
+
+glm::mat4 CameraRotationMatrix()
+{
+    return glm::rotate(glm::rotate(glm::mat4(1), Scene::CameraPitch, glm::vec3(1, 0, 0)), Scene::CameraYaw,
+                       glm::vec3(0, 1, 0));
+}
+
+void PrintSummary(const HeadlessOptions& options, const double renderSeconds,
+                  const std::chrono::steady_clock::time_point startTime)
+{
+    const double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    printf("Rendered %d passes (%d samples per pixel) at %dx%d\n", options.m_Passes,
+           options.m_Passes * Scene::FramePasses, options.m_Width, options.m_Height);
+    printf("  %.2f passes/sec, %.3f s wall time\n", options.m_Passes / renderSeconds, totalSeconds);
+    std::cout << "Wrote " << options.m_Output << '\n';
+}
+
+// Worker side of RenderFarm: renders the frames it claims until none are left. The camera moves linearly from the
+// --camera pose to the end pose, like RenderAnimation in the interactive application.
+void RenderClaimedFrames(const HeadlessOptions& options, const std::function<void(const std::string&)>& renderFrame)
+{
+    const glm::vec3 startPosition = Scene::CameraPosition;
+    const float startYaw = Scene::CameraYaw, startPitch = Scene::CameraPitch;
+
+    int frame;
+    while ((frame = RenderFarm::ClaimFrame(options.m_OutputDirectory, options.m_AnimationFrames)) >= 0)
+    {
+        const float t = static_cast<float>(frame) / static_cast<float>(options.m_AnimationFrames);
+        Scene::CameraPosition = startPosition + (options.m_EndPosition - startPosition) * t;
+        Scene::CameraYaw = startYaw + (options.m_EndYaw - startYaw) * t;
+        Scene::CameraPitch = startPitch + (options.m_EndPitch - startPitch) * t;
+
+        const auto frameStart = std::chrono::steady_clock::now();
+        renderFrame(RenderFarm::TempFramePath(options.m_OutputDirectory, frame));
+        if (!RenderFarm::CompleteFrame(options.m_OutputDirectory, frame))
+        {
+            std::cout << "Failed to write frame " << frame << '\n';
+            continue;
+        }
+        printf("Frame %d/%d: %.3f s\n", frame, options.m_AnimationFrames,
+               std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count());
+        // The coordinator's output is usually a pipe or a log file, which would otherwise only see this at exit
+        fflush(stdout);
+    }
+}
+
+// Renders one image with CpuTracer and returns how long the passes took, or a negative value if the image couldn't be
+// written.
+double RenderFrameOnCpu(const HeadlessOptions& options, const std::string& output, PhaseTimer& timer)
+{
+    std::vector<float> buffer(static_cast<size_t>(options.m_Width) * options.m_Height * 3);
+    const glm::mat4 rotationMatrix = CameraRotationMatrix();
+    for (int pass = 0; pass < options.m_Passes; pass++)
+    {
+        // Numbered like Renderer::SampleCount, so both tracers take the same samples
+        CpuTracer::RenderPass(buffer.data(), options.m_Width, options.m_Height, Scene::CameraPosition, rotationMatrix,
+                              pass, static_cast<uint32_t>(pass * Scene::FramePasses), options.m_Threads);
+    }
+    const double renderSeconds = timer.Lap("render");
+
+    float divider = static_cast<float>(options.m_Passes);
+    if (options.m_Denoise)
+    {
+        const size_t pixelCount = static_cast<size_t>(options.m_Width) * options.m_Height;
+        std::vector<float> normalDepth(pixelCount * 4), albedo(pixelCount * 3);
+        CpuTracer::RenderGuides(normalDepth.data(), albedo.data(), options.m_Width, options.m_Height,
+                                Scene::CameraPosition, rotationMatrix);
+        // The filter works on the mean, like the GPU's
+        for (float& value : buffer) value /= divider;
+        divider = 1.0f;
+        Denoiser::FilterCpu(buffer.data(), normalDepth.data(), albedo.data(), options.m_Width, options.m_Height,
+                            options.m_Passes, options.m_Threads);
+        timer.Lap("denoise");
+    }
+
+    if (!Renderer::WritePng(output.c_str(), buffer.data(), options.m_Width, options.m_Height, options.m_Width * 3,
+                            divider))
+    {
+        std::cout << "Failed to write " << output << '\n';
+        return -1.0;
+    }
+    timer.Lap("write");
+    return renderSeconds;
+}
+
+// Renders with CpuTracer only; never touches OpenGL, so it runs on machines without a GPU.
+int RenderOnCpu(const HeadlessOptions& options)
+{
+    PhaseTimer timer(!options.m_Worker);
+    if (!options.m_Worker) printf("Phase timings (CPU):\n");
+    const auto startTime = std::chrono::steady_clock::now();
+
+    if (!PlaceScene(options)) return -1;
+    timer.Lap("scene");
+
+    int sbWidth, sbHeight, sbChannels;
+    float* skyboxData = stbi_loadf(options.m_Skybox.c_str(), &sbWidth, &sbHeight, &sbChannels, 3);
+    if (skyboxData) CpuTracer::SetSkybox(skyboxData, sbWidth, sbHeight);
+    else std::cout << "Failed to load " << options.m_Skybox << ", rendering without a skybox\n";
+    BlueNoise::Load();
+    timer.Lap("skybox");
+
+    double renderSeconds = 0.0;
+    if (options.m_Worker)
+    {
+        RenderClaimedFrames(options, [&](const std::string& output) { RenderFrameOnCpu(options, output, timer); });
+    }
+    else
+    {
+        renderSeconds = RenderFrameOnCpu(options, options.m_Output, timer);
+        if (renderSeconds >= 0.0) PrintSummary(options, renderSeconds, startTime);
+    }
+
+    if (skyboxData) stbi_image_free(skyboxData);
+    return renderSeconds >= 0.0 ? 0 : -1;
+}
+
+// Renders one image with the OpenGL backends and returns how long the passes took, or a negative value if the image
+// couldn't be written.
+double RenderFrameOnGpu(const HeadlessOptions& options, const std::string& output, PhaseTimer& timer,
+                        std::vector<float>& buffer)
+{
+    Renderer::SetCamera(Scene::CameraPosition, CameraRotationMatrix(),
+                        static_cast<float>(options.m_Width) / static_cast<float>(options.m_Height));
+    // Restores Renderer::SampleCount too, so the passes continue with the samples after the saved ones
+    const int firstPass = Checkpoint::Restore();
+    glFinish();
+    timer.Lap("setup");
+
+    for (int pass = firstPass; pass < options.m_Passes; pass++)
+    {
+        Renderer::AccumulatePass(pass);
+        Checkpoint::Update(pass + 1);
+    }
+    Checkpoint::Save();
+    glFinish();
+    const double renderSeconds = timer.Lap("render");
+
+    if (options.m_Denoise)
+    {
+        Denoiser::Apply(options.m_Passes);
+        glFinish();
+        timer.Lap("denoise");
+    }
+
+    if (options.m_Denoise) Denoiser::ReadOutput(buffer.data());
+    else Renderer::ReadAccumulation(buffer.data());
+    timer.Lap("readback");
+
+    // The accumulation target already holds the mean
+    if (!Renderer::WritePng(output.c_str(), buffer.data(), options.m_Width, options.m_Height, options.m_Width * 3,
+                            1.0f))
+    {
+        std::cout << "Failed to write " << output << '\n';
+        return -1.0;
+    }
+    timer.Lap("write");
+    return renderSeconds;
+}
+
+int RenderOnGpu(const HeadlessOptions& options)
+{
+    PhaseTimer timer(!options.m_Worker);
+    if (!options.m_Worker) printf("Phase timings:\n");
+    Checkpoint::Enabled = options.m_Checkpoint && !options.m_Worker;
+    const auto startTime = std::chrono::steady_clock::now();
+
+    GLFWwindow* context = CreateOffscreenContext();
+    if (!context)
+    {
+        std::cout << "Failed to create an offscreen context!\n";
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(context);
+
+    // glewInit also loads GLX/WGL entry points, which fails on a surfaceless EGL context even though every core
+    // function we need has been loaded by then.
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK && glewContextInit() != GLEW_OK)
+    {
+        std::cout << "Failed to initialize GLEW!\n";
+        glfwTerminate();
+        return -1;
+    }
+    timer.Lap("context");
+
+    if (!PlaceScene(options))
+    {
+        glfwTerminate();
+        return -1;
+    }
+    timer.Lap("scene");
+
+    if (!Renderer::RecompileShader())
+    {
+        std::cout << "Failed to compile the shaders!\n";
+        glfwTerminate();
+        return -1;
+    }
+    // Compiled right away: nothing else is running yet, and every pass should use it
+    if (!options.m_Wavefront) ShaderVariants::Update();
+    if (options.m_Wavefront && !Renderer::SetBackend(Renderer::Backend::Wavefront))
+    {
+        std::cout << "Failed to compile the wavefront shaders!\n";
+        glfwTerminate();
+        return -1;
+    }
+    if (options.m_AdaptiveThreshold > 0.0f)
+    {
+        Adaptive::Threshold = options.m_AdaptiveThreshold;
+        if (!Adaptive::SetEnabled(true))
+        {
+            std::cout << "Failed to compile the convergence shader!\n";
+            glfwTerminate();
+            return -1;
+        }
+    }
+    if (options.m_Denoise && !Denoiser::SetEnabled(true))
+    {
+        std::cout << "Failed to compile the denoise shader!\n";
+        glfwTerminate();
+        return -1;
+    }
+    timer.Lap("shader compile");
+
+    Bvh::Update();
+    timer.Lap("bvh build");
+
+    // Nothing to overlap the load with here, so it blocks; the cache still saves the decode
+    SkyboxLoader::Image skybox;
+    if (SkyboxLoader::Load(options.m_Skybox, skybox))
+    {
+        SkyboxLoader::Upload(skybox);
+    }
+    else
+    {
+        std::cout << "Failed to load " << options.m_Skybox << ", rendering without a skybox\n";
+        constexpr float black[3] = {0.0f, 0.0f, 0.0f};
+        Renderer::UploadSkybox(black, 1, 1);
+    }
+    timer.Lap("skybox");
+
+    BlueNoise::Init();
+    Renderer::CreateScreenQuad();
+    if (!Renderer::CreateAccumulationTarget(options.m_Width, options.m_Height))
+    {
+        glfwTerminate();
+        return -1;
+    }
+    glDisable(GL_DEPTH_TEST);
+
+    std::vector<float> buffer(static_cast<size_t>(options.m_Width) * options.m_Height * 3);
+    double renderSeconds = 0.0;
+    if (options.m_Worker)
+    {
+        RenderClaimedFrames(options, [&](const std::string& output)
+        {
+            RenderFrameOnGpu(options, output, timer, buffer);
+        });
+    }
+    else
+    {
+        renderSeconds = RenderFrameOnGpu(options, options.m_Output, timer, buffer);
+        if (renderSeconds >= 0.0) PrintSummary(options, renderSeconds, startTime);
+        if (renderSeconds >= 0.0 && Adaptive::Enabled)
+        {
+            Renderer::ReadSampleCounts(buffer.data());
+            double passSum = 0.0;
+            const size_t pixelCount = static_cast<size_t>(options.m_Width) * options.m_Height;
+            for (size_t i = 0; i < pixelCount; i++) passSum += buffer[i];
+            const double averagePasses = passSum / static_cast<double>(pixelCount);
+            printf("  adaptive sampling: %.1f passes per pixel on average (%.1f%% of %d)\n", averagePasses,
+                   100.0 * averagePasses / options.m_Passes, options.m_Passes);
+        }
+    }
+
+    Renderer::DeleteScreenQuad();
+    ShaderVariants::Delete();
+    glDeleteProgram(Renderer::GenericProgram);
+    glDeleteProgram(Renderer::GBufferProgram);
+    Renderer::DeleteAccumulationTarget();
+    Wavefront::Delete();
+    Adaptive::Delete();
+    Denoiser::Delete();
+    Environment::Delete();
+    BlueNoise::Delete();
+    Bvh::Delete();
+    Scene::DeleteSceneBuffer();
+
+    glfwDestroyWindow(context);
+    glfwTerminate();
+
+    return renderSeconds >= 0.0 ? 0 : -1;
+}
+
+// Starts the workers of an animation render: copies of this process with the same options plus --worker, see
+// RenderFarm. CPU workers split the hardware threads between them unless --threads is given.
+int RenderAnimation(const int argc, char** argv, const HeadlessOptions& options)
+{
+    std::string command;
+    for (int i = 0; i < argc; i++) command.append("\"").append(argv[i]).append("\" ");
+    command.append("--worker");
+    if (options.m_Cpu && options.m_Threads == 0)
+    {
+        const int threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / options.m_Workers);
+        command.append(" --threads ").append(std::to_string(threads));
+    }
+
+    const int missing = RenderFarm::Run(options.m_OutputDirectory, options.m_AnimationFrames, command,
+                                        options.m_Workers);
+    if (missing > 0)
+    {
+        std::cout << missing << " frames are missing, rerun to render them\n";
+        return 1;
+    }
+
+    std::cout << "Rendered all " << options.m_AnimationFrames << " frames to " << options.m_OutputDirectory << '\n';
+    return 0;
+}
+
+int main(const int argc, char** argv)
+{
+    HeadlessOptions options;
+    if (!ParseOptions(argc, argv, options)) return -1;
+    if (!options.m_BlueNoiseOutput.empty()) return BlueNoise::Write(options.m_BlueNoiseOutput.c_str()) ? 0 : -1;
+    if (options.m_AnimationFrames > 0 && !options.m_Worker) return RenderAnimation(argc, argv, options);
+    if (options.m_Cpu) return RenderOnCpu(options);
+    return RenderOnGpu(options);
+}
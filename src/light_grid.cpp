@@ -0,0 +1,160 @@
+#include "light_grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "scene.h"
+
+namespace LightGrid
+{
+    Header GridHeader;
+    std::vector<uint32_t> Cells;
+    GLuint Buffer = 0;
+
+    // Squared distance from point to the box [boxMin, boxMax]
+    float DistanceSquared(const float* point, const float* boxMin, const float* boxMax)
+    {
+        float distance = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float d = std::max({boxMin[axis] - point[axis], 0.0f, point[axis] - boxMax[axis]});
+            distance += d * d;
+        }
+        return distance;
+    }
+
+    void Build()
+    {
+        GridHeader = {};
+        Cells.assign(1, 0);
+
+        // Bounds of all reach spheres. Lights with a negative reach affect nothing.
+        float boundsMin[3] = {INFINITY, INFINITY, INFINITY}, boundsMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+        int lightCount = 0;
+        for (const Scene::PointLight& light : Scene::Lights)
+        {
+            if (!(light.m_Reach >= 0.0f)) continue;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                boundsMin[axis] = std::min(boundsMin[axis], light.m_Position[axis] - light.m_Reach);
+                boundsMax[axis] = std::max(boundsMax[axis], light.m_Position[axis] + light.m_Reach);
+            }
+            lightCount++;
+        }
+        if (lightCount == 0) return;
+
+        // Cubic cells, as many as CellsPerLight asks for. The bounds are padded slightly so points right on the edge
+        // of a reach sphere still land inside the grid.
+        float extent[3];
+        float volume = 1.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float padding = std::max(1e-3f * (boundsMax[axis] - boundsMin[axis]), 1e-4f);
+            boundsMin[axis] -= padding;
+            boundsMax[axis] += padding;
+            extent[axis] = boundsMax[axis] - boundsMin[axis];
+            volume *= extent[axis];
+        }
+        const float cellSize = std::cbrt(volume / static_cast<float>(lightCount * CellsPerLight));
+
+        int cellCount = 1;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const int resolution = std::clamp(static_cast<int>(std::ceil(extent[axis] / cellSize)), 1, MaxResolution);
+            GridHeader.m_BoundsMin[axis] = boundsMin[axis];
+            GridHeader.m_InverseCellSize[axis] = static_cast<float>(resolution) / extent[axis];
+            GridHeader.m_Resolution[axis] = resolution;
+            cellCount *= resolution;
+        }
+        GridHeader.m_CellCount = cellCount;
+
+        const auto cellOf = [](const float position, const int axis)
+        {
+            const float cell = (position - GridHeader.m_BoundsMin[axis]) * GridHeader.m_InverseCellSize[axis];
+            return std::clamp(static_cast<int>(std::floor(cell)), 0, GridHeader.m_Resolution[axis] - 1);
+        };
+
+        // Two passes over the cells each light touches: count, then fill, so the indices end up grouped by cell
+        std::vector<uint32_t> counts(static_cast<size_t>(cellCount) + 1, 0);
+        std::vector<uint32_t> indices;
+        for (int fill = 0; fill < 2; fill++)
+        {
+            if (fill)
+            {
+                // counts becomes the offset each cell's next index is written to
+                uint32_t offset = 0;
+                for (int cell = 0; cell <= cellCount; cell++)
+                {
+                    const uint32_t count = counts[cell];
+                    counts[cell] = offset;
+                    offset += count;
+                }
+                Cells.assign(counts.begin(), counts.end());
+                indices.resize(Cells.back());
+            }
+
+            for (size_t lightIndex = 0; lightIndex < Scene::Lights.size(); lightIndex++)
+            {
+                const Scene::PointLight& light = Scene::Lights[lightIndex];
+                if (!(light.m_Reach >= 0.0f)) continue;
+
+                int first[3], last[3];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    first[axis] = cellOf(light.m_Position[axis] - light.m_Reach, axis);
+                    last[axis] = cellOf(light.m_Position[axis] + light.m_Reach, axis);
+                }
+
+                for (int z = first[2]; z <= last[2]; z++)
+                {
+                    for (int y = first[1]; y <= last[1]; y++)
+                    {
+                        for (int x = first[0]; x <= last[0]; x++)
+                        {
+                            // Skip the cells in the corners of the light's bounding box that its sphere misses
+                            const int cellIndex[3] = {x, y, z};
+                            float cellMin[3], cellMax[3];
+                            for (int axis = 0; axis < 3; axis++)
+                            {
+                                const float size = 1.0f / GridHeader.m_InverseCellSize[axis];
+                                cellMin[axis] = GridHeader.m_BoundsMin[axis] + static_cast<float>(cellIndex[axis]) * size;
+                                cellMax[axis] = cellMin[axis] + size;
+                            }
+                            if (DistanceSquared(light.m_Position, cellMin, cellMax) > light.m_Reach * light.m_Reach)
+                                continue;
+
+                            const size_t cell = (static_cast<size_t>(z) * GridHeader.m_Resolution[1] + y) *
+                                GridHeader.m_Resolution[0] + x;
+                            if (fill) indices[counts[cell]++] = static_cast<uint32_t>(lightIndex);
+                            else counts[cell]++;
+                        }
+                    }
+                }
+            }
+        }
+
+        // The offsets are relative to the start of the indices, which follow the cellCount + 1 offsets
+        for (uint32_t& offset : Cells) offset += static_cast<uint32_t>(cellCount) + 1;
+        Cells.insert(Cells.end(), indices.begin(), indices.end());
+    }
+
+    void Update()
+    {
+        Build();
+
+        if (!Buffer) glGenBuffers(1, &Buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, Buffer);
+        const size_t cellBytes = Cells.size() * sizeof(uint32_t);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(sizeof(Header) + cellBytes), nullptr,
+                     GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Header), &GridHeader);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(Header), static_cast<GLsizeiptr>(cellBytes), Cells.data());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, Binding, Buffer);
+    }
+
+    void Delete()
+    {
+        glDeleteBuffers(1, &Buffer);
+        Buffer = 0;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+
+// Uniform grid over the reach spheres of Scene::Lights, so shading only visits the lights that can affect a hit point
+// instead of all of them. Every cell lists the lights whose reach sphere overlaps it; the shaders look up the cell of
+// the hit point with lightsAt() in common.glsl. Points outside the grid are out of reach of every light.
+namespace LightGrid
+{
+    // Shader storage buffer binding point of the LightGrid block in common.glsl
+    constexpr GLuint Binding = 10;
+    // Cells along each axis at most
+    constexpr int MaxResolution = 64;
+    // Cells per light the grid aims for, within MaxResolution
+    constexpr int CellsPerLight = 8;
+
+    // Matches the header of the LightGrid block in common.glsl (std430)
+    struct Header
+    {
+        float m_BoundsMin[3];
+        int32_t m_CellCount;
+        float m_InverseCellSize[3];
+        int32_t m_Padding0;
+        int32_t m_Resolution[3];
+        int32_t m_Padding1;
+    };
+
+    static_assert(sizeof(Header) == 48, "LightGrid::Header must match the std430 layout of the LightGrid block");
+
+    extern Header GridHeader;
+    // m_CellCount + 1 offsets followed by the light indices. The offsets index Cells itself: cell i lists the lights
+    // Cells[Cells[i]] up to (excluding) Cells[Cells[i + 1]].
+    extern std::vector<uint32_t> Cells;
+
+    void Build();
+    // Rebuilds the grid from Scene::Lights and uploads it. Called whenever lights were added, removed or edited.
+    void Update();
+    void Delete();
+}
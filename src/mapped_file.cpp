@@ -0,0 +1,114 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MappedFile
+{
+    bool Create(const char* filepath, const size_t size, Mapping& mapping)
+    {
+        mapping = {};
+        if (size == 0) return false;
+
+#ifdef _WIN32
+        const HANDLE file = CreateFileA(filepath, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                                        FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        const unsigned long long mappingSize = size;
+        const HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+                                                      static_cast<DWORD>(mappingSize >> 32),
+                                                      static_cast<DWORD>(mappingSize & 0xFFFFFFFF), nullptr);
+        // The view keeps the file open, so the handles aren't needed past this point
+        CloseHandle(file);
+        if (!fileMapping) return false;
+
+        void* data = MapViewOfFile(fileMapping, FILE_MAP_WRITE, 0, 0, size);
+        CloseHandle(fileMapping);
+        if (!data) return false;
+#else
+        const int file = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (file < 0) return false;
+
+        if (ftruncate(file, static_cast<off_t>(size)) != 0)
+        {
+            close(file);
+            return false;
+        }
+
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        close(file);
+        if (data == MAP_FAILED) return false;
+#endif
+
+        mapping.m_Data = data;
+        mapping.m_Size = size;
+        return true;
+    }
+
+    bool Open(const char* filepath, Mapping& mapping)
+    {
+        mapping = {};
+
+#ifdef _WIN32
+        const HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                        FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+        const auto size = static_cast<size_t>(fileSize.QuadPart);
+
+        const HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!fileMapping) return false;
+
+        void* data = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(fileMapping);
+        if (!data) return false;
+#else
+        const int file = open(filepath, O_RDONLY);
+        if (file < 0) return false;
+
+        struct stat status;
+        if (fstat(file, &status) != 0 || status.st_size == 0)
+        {
+            close(file);
+            return false;
+        }
+        const auto size = static_cast<size_t>(status.st_size);
+
+        void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+        close(file);
+        if (data == MAP_FAILED) return false;
+#endif
+
+        mapping.m_Data = data;
+        mapping.m_Size = size;
+        return true;
+    }
+
+    void Close(Mapping& mapping)
+    {
+        if (!mapping.m_Data) return;
+
+#ifdef _WIN32
+        UnmapViewOfFile(mapping.m_Data);
+#else
+        munmap(mapping.m_Data, mapping.m_Size);
+#endif
+        mapping = {};
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+// Files accessed through a memory mapping, so large buffers go between memory and disk without passing through
+// stdio buffers. The operating system writes dirty pages back on its own schedule.
+namespace MappedFile
+{
+    struct Mapping
+    {
+        void* m_Data = nullptr;
+        size_t m_Size = 0;
+    };
+
+    // Creates (or truncates) filepath with size bytes and maps it for writing. Returns false if any step failed.
+    bool Create(const char* filepath, size_t size, Mapping& mapping);
+    // Maps an existing file for reading. Returns false if it doesn't exist or is empty.
+    bool Open(const char* filepath, Mapping& mapping);
+    void Close(Mapping& mapping);
+}
@@ -0,0 +1,119 @@
+#include "program_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include "hash.h"
+#include "mapped_file.h"
+
+namespace ProgramCache
+{
+    bool Enabled = true;
+
+    constexpr const char* Directory = "shader_cache";
+    constexpr char Magic[8] = {'R', 'T', 'P', 'R', 'O', 'G', 'B', '\0'};
+    constexpr uint32_t Version = 1;
+
+    // Followed by m_Length bytes of program binary
+    struct Header
+    {
+        char m_Magic[8];
+        uint32_t m_Version;
+        uint32_t m_Format; // As returned by glGetProgramBinary
+        uint64_t m_Key;
+        uint64_t m_Length;
+    };
+
+    static_assert(sizeof(Header) == 32, "ProgramCache::Header must not contain padding");
+
+    std::string FilePath(const uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+        return std::string(Directory).append("\\").append(name).append(".bin");
+    }
+
+    uint64_t Key(const std::initializer_list<const std::string*> sources)
+    {
+        uint64_t hash = Hash::Offset;
+        for (const GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const char* value = reinterpret_cast<const char*>(glGetString(name));
+            if (value) hash = Hash::Bytes(value, strlen(value) + 1, hash);
+        }
+        for (const std::string* source : sources)
+        {
+            // The length separates the stages, so moving text from one to the other changes the key
+            hash = Hash::Value(source->size(), hash);
+            hash = Hash::Bytes(source->data(), source->size(), hash);
+        }
+        return hash;
+    }
+
+    GLuint Load(const uint64_t key)
+    {
+        if (!Enabled) return 0;
+
+        MappedFile::Mapping file;
+        if (!MappedFile::Open(FilePath(key).c_str(), file)) return 0;
+
+        GLuint program = 0;
+        Header header;
+        if (file.m_Size >= sizeof(Header))
+        {
+            std::memcpy(&header, file.m_Data, sizeof(Header));
+            if (!std::memcmp(header.m_Magic, Magic, sizeof(Magic)) && header.m_Version == Version &&
+                header.m_Key == key && header.m_Length == file.m_Size - sizeof(Header))
+            {
+                program = glCreateProgram();
+                glProgramBinary(program, header.m_Format, static_cast<const unsigned char*>(file.m_Data) + sizeof(Header),
+                                static_cast<GLsizei>(header.m_Length));
+                GLint linked = GL_FALSE;
+                glGetProgramiv(program, GL_LINK_STATUS, &linked);
+                if (!linked)
+                {
+                    glDeleteProgram(program);
+                    program = 0;
+                }
+            }
+        }
+        MappedFile::Close(file);
+        return program;
+    }
+
+    void Save(const uint64_t key, const GLuint program)
+    {
+        if (!Enabled) return;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+
+        std::vector<unsigned char> binary(static_cast<size_t>(length));
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(Directory, error);
+
+        // Written under a temporary name first, so a crash while saving never leaves a truncated binary behind
+        const std::string path = FilePath(key);
+        const std::string tempPath = path + ".part";
+        MappedFile::Mapping file;
+        if (!MappedFile::Create(tempPath.c_str(), sizeof(Header) + static_cast<size_t>(length), file)) return;
+
+        Header header{};
+        std::memcpy(header.m_Magic, Magic, sizeof(Magic));
+        header.m_Version = Version;
+        header.m_Format = format;
+        header.m_Key = key;
+        header.m_Length = static_cast<uint64_t>(length);
+        std::memcpy(file.m_Data, &header, sizeof(Header));
+        std::memcpy(static_cast<unsigned char*>(file.m_Data) + sizeof(Header), binary.data(), binary.size());
+        MappedFile::Close(file);
+
+        std::filesystem::rename(tempPath, path, error);
+    }
+}
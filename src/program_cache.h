@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <GL/glew.h>
+
+// Linked programs saved with glGetProgramBinary, so later launches skip compiling and linking. A binary is keyed by
+// the complete source of every stage (includes expanded, defines inserted) and by the driver, and stored as
+// shader_cache\<key>.bin. Drivers may still reject a binary, e.g. after an update; the program is then compiled as usual
+// and the file replaced.
+namespace ProgramCache
+{
+    extern bool Enabled;
+
+    // Needs a current context, since the driver strings are part of the key
+    uint64_t Key(std::initializer_list<const std::string*> sources);
+    // Returns a linked program created from the binary saved under key, or 0 if there is none or the driver rejects it.
+    GLuint Load(uint64_t key);
+    // program must be linked and have GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+    void Save(uint64_t key, GLuint program);
+}
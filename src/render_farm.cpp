@@ -0,0 +1,108 @@
+#include "render_farm.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace RenderFarm
+{
+    std::string FramePath(const std::string& directory, const int frame)
+    {
+        return (std::filesystem::path(directory) / (std::to_string(frame) + ".png")).string();
+    }
+
+    std::string TempFramePath(const std::string& directory, const int frame)
+    {
+        return (std::filesystem::path(directory) / (std::to_string(frame) + ".png.part")).string();
+    }
+
+    std::string LockPath(const std::string& directory, const int frame)
+    {
+        return (std::filesystem::path(directory) / (std::to_string(frame) + ".lock")).string();
+    }
+
+    bool FrameFinished(const std::string& directory, const int frame)
+    {
+        std::error_code error;
+        return std::filesystem::exists(FramePath(directory, frame), error);
+    }
+
+    int CountMissingFrames(const std::string& directory, const int frameCount)
+    {
+        int missing = 0;
+        for (int frame = 0; frame < frameCount; frame++) missing += !FrameFinished(directory, frame);
+        return missing;
+    }
+
+    int Run(const std::string& directory, const int frameCount, const std::string& workerCommand,
+            const int workerCount)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+
+        // No workers are running yet, so every claim belongs to a worker that was interrupted mid-frame
+        for (int frame = 0; frame < frameCount; frame++)
+        {
+            std::filesystem::remove(LockPath(directory, frame), error);
+            std::filesystem::remove(TempFramePath(directory, frame), error);
+        }
+
+        const int missing = CountMissingFrames(directory, frameCount);
+        std::cout << frameCount - missing << "/" << frameCount << " frames already rendered, starting " <<
+            workerCount << " workers" << std::endl;
+        if (missing == 0) return 0;
+
+        // cmd.exe strips the first and last quote of the command, which would break the quoted arguments
+#ifdef _WIN32
+        const std::string command = "\"" + workerCommand + "\"";
+#else
+        const std::string command = workerCommand;
+#endif
+        std::vector<std::thread> workers;
+        for (int worker = 0; worker < workerCount; worker++)
+        {
+            workers.emplace_back([&command, worker]
+            {
+                if (const int status = std::system(command.c_str()); status != 0)
+                    std::cout << "Worker " << worker << " exited with status " << status << '\n';
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+
+        return CountMissingFrames(directory, frameCount);
+    }
+
+    int ClaimFrame(const std::string& directory, const int frameCount)
+    {
+        for (int frame = 0; frame < frameCount; frame++)
+        {
+            if (FrameFinished(directory, frame)) continue;
+
+            // "x" fails if the file exists, so exactly one worker gets to create it
+            FILE* lock = std::fopen(LockPath(directory, frame).c_str(), "wx");
+            if (!lock) continue;
+            std::fclose(lock);
+
+            // Another worker may have finished the frame between the check above and the claim
+            if (FrameFinished(directory, frame))
+            {
+                std::remove(LockPath(directory, frame).c_str());
+                continue;
+            }
+            return frame;
+        }
+
+        return -1;
+    }
+
+    bool CompleteFrame(const std::string& directory, const int frame)
+    {
+        std::error_code renameError, removeError;
+        std::filesystem::rename(TempFramePath(directory, frame), FramePath(directory, frame), renameError);
+        std::filesystem::remove(LockPath(directory, frame), removeError);
+        return !renameError;
+    }
+}
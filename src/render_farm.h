@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+// Splits an animation over several headless worker processes. The queue is a directory: a frame is finished once its
+// PNG exists and claimed while a <frame>.lock file exists, which workers create exclusively, so any number of them can
+// take frames from it without talking to each other. Frames are written under a temporary name and renamed when
+// complete, so an interrupted run never leaves a partial frame behind and a rerun only renders what is missing.
+namespace RenderFarm
+{
+    std::string FramePath(const std::string& directory, int frame);
+    // Where a worker writes the frame before CompleteFrame moves it into place
+    std::string TempFramePath(const std::string& directory, int frame);
+
+    // Coordinator: removes the claims an interrupted run left behind, runs workerCount copies of workerCommand and
+    // waits for them. Must not run while workers of another coordinator use the same directory. Returns the number of
+    // frames still missing afterwards.
+    int Run(const std::string& directory, int frameCount, const std::string& workerCommand, int workerCount);
+
+    // Worker: claims the lowest frame nobody has finished or claimed, or returns -1 if there is none left.
+    int ClaimFrame(const std::string& directory, int frameCount);
+    // Moves the frame from TempFramePath to FramePath and releases the claim.
+    bool CompleteFrame(const std::string& directory, int frame);
+}
@@ -0,0 +1,624 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "adaptive.h"
+#include "blue_noise.h"
+#include "denoiser.h"
+#include "environment.h"
+#include "hash.h"
+#include "program_cache.h"
+#include "scene.h"
+#include "wavefront.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+
+#include "stb_image_write.h"
+
+constexpr GLfloat vertices[] = {
+    -1.0F, -1.0F, 0.0F,
+    1.0F, -1.0F, 0.0F,
+    1.0F, 1.0F, 0.0F,
+    1.0F, 1.0F, 0.0F,
+    -1.0F, 1.0F, 0.0F,
+    -1.0F, -1.0F, 0.0F
+};
+
+constexpr GLfloat uvs[] = {
+    0.0F, 0.0F,
+    1.0F, 0.0F,
+    1.0F, 1.0F,
+    1.0F, 1.0F,
+    0.0F, 1.0F,
+    0.0F, 0.0F,
+};
+
+namespace Renderer
+{
+    Backend ActiveBackend = Backend::Fragment;
+    GLuint ShaderProgram, GenericProgram;
+    AccumulationTarget Targets[2];
+    int CurrentTarget = 0;
+    int TargetWidth = 0, TargetHeight = 0;
+    GBufferTarget GBuffer;
+    GLuint GBufferProgram;
+    glm::vec3 GBufferCameraPosition;
+    glm::mat4 GBufferRotationMatrix(1);
+    float GBufferAspectRatio = 1.0f;
+    GLuint DisplayedFbo;
+    uint64_t SkyboxHash = 0;
+    uint32_t SampleCount = 0;
+
+    GLint DirectOutPassUniformLocation, AccumulatedPassesUniformLocation, FirstSampleUniformLocation,
+          CamPosUniformLocation, RotationMatrixUniformLocation, AspectRatioUniformLocation, DebugKeyUniformLocation,
+          AdaptiveSamplingUniformLocation, ShowSampleCountUniformLocation;
+
+    GLuint VertexArray, VertexBuffer, UvBuffer;
+
+    // Last values given to SetCamera, for the wavefront programs
+    glm::vec3 CameraPosition;
+    glm::mat4 CameraRotationMatrix(1);
+    float CameraAspectRatio = 1.0f;
+    bool WavefrontInitialized = false;
+    // Passes in the accumulation targets, for the denoiser
+    int PassCount = 0;
+
+    bool ReadShaderSource(const char* filePath, std::string& source)
+    {
+        std::ifstream stream(filePath, std::ios::in);
+        if (!stream.is_open())
+        {
+            printf("Unable to open %s.\n", filePath);
+            return false;
+        }
+
+        // Included files are looked up next to the including file
+        const std::string path(filePath);
+        const std::string directory = path.substr(0, path.find_last_of("\\/") + 1);
+
+        std::string line;
+        while (std::getline(stream, line))
+        {
+            if (line.rfind("#include \"", 0) == 0)
+            {
+                const size_t nameStart = line.find('"') + 1;
+                const std::string includePath = directory + line.substr(nameStart, line.find('"', nameStart) - nameStart);
+                if (!ReadShaderSource(includePath.c_str(), source)) return false;
+                continue;
+            }
+
+            source.append(line).append("\n");
+        }
+
+        return true;
+    }
+
+    // Loads the shader source from disk, replaces the constants and returns a new OpenGL Program, or 0 if it doesn't link
+    GLuint CreateShaderProgram(const char* vertexFilePath, const char* fragmentFilePath, const char* defines)
+    {
+        // Read the Vertex Shader code from the file
+        std::string vertexShaderCode;
+        if (std::ifstream vertexShaderStream(vertexFilePath, std::ios::in); vertexShaderStream.is_open())
+        {
+            std::stringstream sstr;
+            sstr << vertexShaderStream.rdbuf();
+            vertexShaderCode = sstr.str();
+            vertexShaderStream.close();
+        }
+        else
+        {
+            printf("Unable to open %s.\n", vertexFilePath);
+            return 0;
+        }
+
+        // Read the Fragment Shader code from the file, along with the files it includes
+        std::string fragmentShaderCode;
+        if (!ReadShaderSource(fragmentFilePath, fragmentShaderCode)) return 0;
+        // Defines must come after the #version line
+        fragmentShaderCode.insert(fragmentShaderCode.find('\n') + 1, defines);
+
+        const uint64_t cacheKey = ProgramCache::Key({&vertexShaderCode, &fragmentShaderCode});
+        if (const GLuint cachedProgram = ProgramCache::Load(cacheKey)) return cachedProgram;
+
+        // Create the shaders
+        GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+        GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+
+        GLint result = GL_FALSE;
+        int infoLogLength;
+
+        // Compile Vertex Shader
+        printf("Compiling shader : %s\n", vertexFilePath);
+        char const* vertexSourcePointer = vertexShaderCode.c_str();
+        glShaderSource(vertexShaderId, 1, &vertexSourcePointer, nullptr);
+        glCompileShader(vertexShaderId);
+
+        // Check Vertex Shader
+        glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &result);
+        glGetShaderiv(vertexShaderId, GL_INFO_LOG_LENGTH, &infoLogLength);
+        if (infoLogLength > 0)
+        {
+            std::vector<char> vertexShaderErrorMessage(infoLogLength + 1);
+            glGetShaderInfoLog(vertexShaderId, infoLogLength, nullptr, vertexShaderErrorMessage.data());
+            printf("%s\n", vertexShaderErrorMessage.data());
+        }
+
+        // Compile Fragment Shader
+        printf("Compiling shader : %s\n", fragmentFilePath);
+        char const* fragmentSourcePointer = fragmentShaderCode.c_str();
+        glShaderSource(fragmentShaderId, 1, &fragmentSourcePointer, nullptr);
+        glCompileShader(fragmentShaderId);
+
+        // Check Fragment Shader
+        glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &result);
+        glGetShaderiv(fragmentShaderId, GL_INFO_LOG_LENGTH, &infoLogLength);
+        if (infoLogLength > 0)
+        {
+            std::vector<char> fragmentShaderErrorMessage(infoLogLength + 1);
+            glGetShaderInfoLog(fragmentShaderId, infoLogLength, nullptr, fragmentShaderErrorMessage.data());
+            printf("%s\n", fragmentShaderErrorMessage.data());
+        }
+
+        // Link the program
+        printf("Linking program\n");
+        GLuint programId = glCreateProgram();
+        glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(programId, vertexShaderId);
+        glAttachShader(programId, fragmentShaderId);
+        glLinkProgram(programId);
+
+        // Check the program
+        glGetProgramiv(programId, GL_LINK_STATUS, &result);
+        glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &infoLogLength);
+        if (infoLogLength > 0)
+        {
+            std::vector<char> programErrorMessage(infoLogLength + 1);
+            glGetProgramInfoLog(programId, infoLogLength, nullptr, programErrorMessage.data());
+            printf("%s\n", programErrorMessage.data());
+        }
+
+        glDetachShader(programId, vertexShaderId);
+        glDetachShader(programId, fragmentShaderId);
+
+        glDeleteShader(vertexShaderId);
+        glDeleteShader(fragmentShaderId);
+
+        if (result != GL_TRUE)
+        {
+            glDeleteProgram(programId);
+            return 0;
+        }
+        ProgramCache::Save(cacheKey, programId);
+        return programId;
+    }
+
+    GLuint CreateComputeProgram(const char* computeFilePath, const char* defines)
+    {
+        std::string computeShaderCode;
+        if (!ReadShaderSource(computeFilePath, computeShaderCode)) return 0;
+
+        // Defines must come after the #version line
+        computeShaderCode.insert(computeShaderCode.find('\n') + 1, defines);
+
+        const uint64_t cacheKey = ProgramCache::Key({&computeShaderCode});
+        if (const GLuint cachedProgram = ProgramCache::Load(cacheKey)) return cachedProgram;
+
+        GLint result = GL_FALSE;
+        int infoLogLength;
+
+        printf("Compiling shader : %s\n", computeFilePath);
+        GLuint computeShaderId = glCreateShader(GL_COMPUTE_SHADER);
+        char const* computeSourcePointer = computeShaderCode.c_str();
+        glShaderSource(computeShaderId, 1, &computeSourcePointer, nullptr);
+        glCompileShader(computeShaderId);
+
+        glGetShaderiv(computeShaderId, GL_COMPILE_STATUS, &result);
+        glGetShaderiv(computeShaderId, GL_INFO_LOG_LENGTH, &infoLogLength);
+        if (infoLogLength > 0)
+        {
+            std::vector<char> computeShaderErrorMessage(infoLogLength + 1);
+            glGetShaderInfoLog(computeShaderId, infoLogLength, nullptr, computeShaderErrorMessage.data());
+            printf("%s\n", computeShaderErrorMessage.data());
+        }
+
+        GLuint programId = glCreateProgram();
+        glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(programId, computeShaderId);
+        glLinkProgram(programId);
+
+        glGetProgramiv(programId, GL_LINK_STATUS, &result);
+        glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &infoLogLength);
+        if (infoLogLength > 0)
+        {
+            std::vector<char> programErrorMessage(infoLogLength + 1);
+            glGetProgramInfoLog(programId, infoLogLength, nullptr, programErrorMessage.data());
+            printf("%s\n", programErrorMessage.data());
+        }
+
+        glDetachShader(programId, computeShaderId);
+        glDeleteShader(computeShaderId);
+
+        if (result != GL_TRUE)
+        {
+            glDeleteProgram(programId);
+            return 0;
+        }
+        ProgramCache::Save(cacheKey, programId);
+        return programId;
+    }
+
+    // Compiles the generic fragment and G-buffer programs and switches to them. If either doesn't link, both are
+    // discarded and the previous programs stay in use.
+    bool RecompileShader()
+    {
+        const GLuint genericProgram = CreateShaderProgram("shaders\\vertex.glsl", "shaders\\fragment.glsl");
+        const GLuint gBufferProgram = CreateShaderProgram("shaders\\vertex.glsl", "shaders\\gbuffer.glsl");
+        if (!genericProgram || !gBufferProgram)
+        {
+            glDeleteProgram(genericProgram);
+            glDeleteProgram(gBufferProgram);
+            return false;
+        }
+
+        const bool firstCompile = !GenericProgram;
+        ReplaceShaderPrograms(genericProgram, gBufferProgram);
+        if (firstCompile) Scene::Bind(ShaderProgram);
+        return true;
+    }
+
+    void ReplaceShaderPrograms(const GLuint genericProgram, const GLuint gBufferProgram)
+    {
+        if (GenericProgram)
+            glDeleteProgram(GenericProgram);
+        GenericProgram = genericProgram;
+        SetShaderProgram(GenericProgram);
+
+        if (GBufferProgram)
+            glDeleteProgram(GBufferProgram);
+        GBufferProgram = gBufferProgram;
+    }
+
+    void SetShaderProgram(const GLuint program)
+    {
+        ShaderProgram = program;
+        glUseProgram(ShaderProgram);
+
+        DirectOutPassUniformLocation = glGetUniformLocation(ShaderProgram, "u_directOutputPass");
+        AccumulatedPassesUniformLocation = glGetUniformLocation(ShaderProgram, "u_accumulatedPasses");
+        FirstSampleUniformLocation = glGetUniformLocation(ShaderProgram, "u_firstSample");
+        CamPosUniformLocation = glGetUniformLocation(ShaderProgram, "u_cameraPosition");
+        RotationMatrixUniformLocation = glGetUniformLocation(ShaderProgram, "u_rotationMatrix");
+        AspectRatioUniformLocation = glGetUniformLocation(ShaderProgram, "u_aspectRatio");
+        DebugKeyUniformLocation = glGetUniformLocation(ShaderProgram, "u_debugKeyPressed");
+        AdaptiveSamplingUniformLocation = glGetUniformLocation(ShaderProgram, "u_adaptiveSampling");
+        ShowSampleCountUniformLocation = glGetUniformLocation(ShaderProgram, "u_showSampleCount");
+
+        glUniform1i(glGetUniformLocation(ShaderProgram, "u_screenTexture"), 0);
+        glUniform1i(glGetUniformLocation(ShaderProgram, "u_skyboxTexture"), 1);
+        glUniform1i(glGetUniformLocation(ShaderProgram, "u_compensationTexture"), 2);
+        glUniform1i(glGetUniformLocation(ShaderProgram, "u_momentsTexture"), 3);
+        glUniform1i(glGetUniformLocation(ShaderProgram, "u_objectIndexTexture"), 6);
+        glUniform1i(glGetUniformLocation(ShaderProgram, "u_blueNoiseTexture"), BlueNoise::TextureUnit);
+
+        // Uniforms belong to the program, so the camera has to be given to the new one
+        SetCamera(CameraPosition, CameraRotationMatrix, CameraAspectRatio);
+    }
+
+    void CreateScreenQuad()
+    {
+        glGenVertexArrays(1, &VertexArray);
+        glBindVertexArray(VertexArray);
+
+        glGenBuffers(1, &VertexBuffer);
+        glGenBuffers(1, &UvBuffer);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, static_cast<void*>(nullptr));
+        glEnableVertexAttribArray(0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, UvBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(uvs), uvs, GL_STATIC_DRAW);
+
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, static_cast<void*>(nullptr));
+        glEnableVertexAttribArray(1);
+
+        glBindVertexArray(VertexArray);
+    }
+
+    void DeleteScreenQuad()
+    {
+        glDeleteBuffers(1, &VertexBuffer);
+        glDeleteBuffers(1, &UvBuffer);
+        glDeleteVertexArrays(1, &VertexArray);
+    }
+
+    void AllocateTargetTexture(const GLuint texture, const int width, const int height)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    }
+
+    void AllocateObjectIndexTexture(const int width, const int height)
+    {
+        glBindTexture(GL_TEXTURE_2D, GBuffer.m_ObjectIndexTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32I, width, height, 0, GL_RED_INTEGER, GL_INT, nullptr);
+    }
+
+    bool CreateGBuffer(const int width, const int height)
+    {
+        glGenTextures(1, &GBuffer.m_NormalDepthTexture);
+        glGenTextures(1, &GBuffer.m_AlbedoTexture);
+        for (const GLuint texture : {GBuffer.m_NormalDepthTexture, GBuffer.m_AlbedoTexture})
+        {
+            AllocateTargetTexture(texture, width, height);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+
+        glGenTextures(1, &GBuffer.m_ObjectIndexTexture);
+        AllocateObjectIndexTexture(width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenFramebuffers(1, &GBuffer.m_Fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, GBuffer.m_Fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, GBuffer.m_NormalDepthTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, GBuffer.m_AlbedoTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, GBuffer.m_ObjectIndexTexture, 0);
+        constexpr GLenum drawBuffers[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+        glDrawBuffers(3, drawBuffers);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "ERROR: G-buffer is not complete!\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool CreateAccumulationTarget(const int width, const int height)
+    {
+        TargetWidth = width;
+        TargetHeight = height;
+        CurrentTarget = 0;
+
+        for (AccumulationTarget& target : Targets)
+        {
+            GLuint textures[3];
+            glGenTextures(3, textures);
+            target.m_MeanTexture = textures[0];
+            target.m_CompensationTexture = textures[1];
+            target.m_MomentsTexture = textures[2];
+            for (const GLuint texture : textures)
+            {
+                AllocateTargetTexture(texture, width, height);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            }
+
+            glGenFramebuffers(1, &target.m_Fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, target.m_Fbo);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.m_MeanTexture, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, target.m_CompensationTexture,
+                                   0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, target.m_MomentsTexture, 0);
+            constexpr GLenum drawBuffers[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+            glDrawBuffers(3, drawBuffers);
+
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            {
+                std::cout << "ERROR: Framebuffer is not complete!\n";
+                return false;
+            }
+        }
+
+        return CreateGBuffer(width, height);
+    }
+
+    void ResizeAccumulationTarget(const int width, const int height)
+    {
+        TargetWidth = width;
+        TargetHeight = height;
+
+        for (const AccumulationTarget& target : Targets)
+        {
+            AllocateTargetTexture(target.m_MeanTexture, width, height);
+            AllocateTargetTexture(target.m_CompensationTexture, width, height);
+            AllocateTargetTexture(target.m_MomentsTexture, width, height);
+        }
+        AllocateTargetTexture(GBuffer.m_NormalDepthTexture, width, height);
+        AllocateTargetTexture(GBuffer.m_AlbedoTexture, width, height);
+        AllocateObjectIndexTexture(width, height);
+    }
+
+    void DeleteAccumulationTarget()
+    {
+        for (AccumulationTarget& target : Targets)
+        {
+            glDeleteFramebuffers(1, &target.m_Fbo);
+            glDeleteTextures(1, &target.m_MeanTexture);
+            glDeleteTextures(1, &target.m_CompensationTexture);
+            glDeleteTextures(1, &target.m_MomentsTexture);
+            target = {};
+        }
+
+        glDeleteFramebuffers(1, &GBuffer.m_Fbo);
+        glDeleteTextures(1, &GBuffer.m_NormalDepthTexture);
+        glDeleteTextures(1, &GBuffer.m_AlbedoTexture);
+        glDeleteTextures(1, &GBuffer.m_ObjectIndexTexture);
+        GBuffer = {};
+    }
+
+    void UploadSkybox(const float* data, const int width, const int height)
+    {
+        if (!Scene::SkyboxTexture) glGenTextures(1, &Scene::SkyboxTexture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, Scene::SkyboxTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGB, GL_FLOAT, data);
+        // Levels SkyboxLoader::Upload left behind would no longer match
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glActiveTexture(GL_TEXTURE0);
+
+        SkyboxHash = Hash::Value(height, Hash::Value(width));
+        SkyboxHash = Hash::Bytes(data, static_cast<size_t>(width) * height * 3 * sizeof(float), SkyboxHash);
+
+        Environment::SetImage(std::vector<float>(data, data + static_cast<size_t>(width) * height * 3), width, height);
+    }
+
+    bool SetBackend(const Backend backend)
+    {
+        if (backend == Backend::Wavefront && !WavefrontInitialized)
+        {
+            WavefrontInitialized = Wavefront::Init();
+            glUseProgram(ShaderProgram);
+            if (!WavefrontInitialized) return false;
+        }
+
+        ActiveBackend = backend;
+        return true;
+    }
+
+    void SetCamera(const glm::vec3 position, const glm::mat4& rotationMatrix, const float aspectRatio)
+    {
+        CameraPosition = position;
+        CameraRotationMatrix = rotationMatrix;
+        CameraAspectRatio = aspectRatio;
+
+        glUniform3f(CamPosUniformLocation, position.x, position.y, position.z);
+        glUniformMatrix4fv(RotationMatrixUniformLocation, 1, GL_FALSE, glm::value_ptr(rotationMatrix));
+        glUniform1f(AspectRatioUniformLocation, aspectRatio);
+    }
+
+    // The guides only depend on the camera and the scene, so they are rendered once per accumulation
+    void UpdateGBuffer()
+    {
+        glUseProgram(GBufferProgram);
+        glUniform3f(glGetUniformLocation(GBufferProgram, "u_cameraPosition"), CameraPosition.x, CameraPosition.y,
+                    CameraPosition.z);
+        glUniformMatrix4fv(glGetUniformLocation(GBufferProgram, "u_rotationMatrix"), 1, GL_FALSE,
+                           glm::value_ptr(CameraRotationMatrix));
+        glUniform1f(glGetUniformLocation(GBufferProgram, "u_aspectRatio"), CameraAspectRatio);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, GBuffer.m_Fbo);
+        glViewport(0, 0, TargetWidth, TargetHeight);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        GBufferCameraPosition = CameraPosition;
+        GBufferRotationMatrix = CameraRotationMatrix;
+        GBufferAspectRatio = CameraAspectRatio;
+
+        glUseProgram(ShaderProgram);
+    }
+
+    void AccumulatePass(const int accumulatedPasses)
+    {
+        if (accumulatedPasses == 0)
+        {
+            UpdateGBuffer();
+            SampleCount = 0;
+        }
+        PassCount = accumulatedPasses + 1;
+        Environment::Update();
+
+        if (ActiveBackend == Backend::Wavefront)
+        {
+            Wavefront::AccumulatePass(CameraPosition, CameraRotationMatrix, CameraAspectRatio, accumulatedPasses,
+                                      SampleCount);
+        }
+        else
+        {
+            glUniform1ui(FirstSampleUniformLocation, SampleCount);
+            glUniform1i(AdaptiveSamplingUniformLocation, Adaptive::Enabled);
+
+            const AccumulationTarget& source = Targets[CurrentTarget];
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D, source.m_MomentsTexture);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, source.m_CompensationTexture);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, source.m_MeanTexture);
+
+            CurrentTarget = 1 - CurrentTarget;
+            glBindFramebuffer(GL_FRAMEBUFFER, Targets[CurrentTarget].m_Fbo);
+            glViewport(0, 0, TargetWidth, TargetHeight);
+            glUniform1i(DirectOutPassUniformLocation, 0);
+            glUniform1i(AccumulatedPassesUniformLocation, accumulatedPasses);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+
+        SampleCount += static_cast<uint32_t>(Scene::FramePasses);
+        if (Adaptive::Enabled) Adaptive::UpdateMask();
+    }
+
+    void DrawToScreen()
+    {
+        const GLuint image = Denoiser::Enabled ? Denoiser::Apply(PassCount) : Targets[CurrentTarget].m_MeanTexture;
+        DisplayedFbo = Denoiser::Enabled ? Denoiser::OutputFbo : Targets[CurrentTarget].m_Fbo;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, Targets[CurrentTarget].m_MomentsTexture);
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, GBuffer.m_ObjectIndexTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, image);
+        glUniform1i(DirectOutPassUniformLocation, 1);
+        glUniform1i(ShowSampleCountUniformLocation, Adaptive::ShowSampleCount);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+
+    void ReadAccumulation(float* buffer)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, Targets[CurrentTarget].m_Fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(0, 0, TargetWidth, TargetHeight, GL_RGB, GL_FLOAT, buffer);
+    }
+
+    void ReadSampleCounts(float* buffer)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, Targets[CurrentTarget].m_Fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadBuffer(GL_COLOR_ATTACHMENT2);
+        glReadPixels(0, 0, TargetWidth, TargetHeight, GL_GREEN, GL_FLOAT, buffer);
+    }
+
+    int PickObject(const int x, const int y)
+    {
+        if (x < 0 || y < 0 || x >= TargetWidth || y >= TargetHeight) return -1;
+
+        GLint objectIndex = -1;
+        glBindFramebuffer(GL_FRAMEBUFFER, GBuffer.m_Fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadBuffer(GL_COLOR_ATTACHMENT2);
+        glReadPixels(x, TargetHeight - 1 - y, 1, 1, GL_RED_INTEGER, GL_INT, &objectIndex);
+        // The plane (PLANE_HIT) can't be selected
+        return objectIndex >= 0 ? objectIndex : -1;
+    }
+
+    bool WritePng(const char* filepath, const float* rgb, const int width, const int height, const int stride,
+                  const float divider)
+    {
+        const size_t bufferSize = static_cast<size_t>(stride) * height;
+        std::vector<unsigned char> byteBuffer(bufferSize);
+        for (size_t i = 0; i < bufferSize; i++)
+        {
+            byteBuffer[i] = static_cast<unsigned char>(std::min(rgb[i] / divider, 1.0f) * 255);
+        }
+
+        stbi_flip_vertically_on_write(true);
+        return stbi_write_png(filepath, width, height, 3, byteBuffer.data(), stride) != 0;
+    }
+}
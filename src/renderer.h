@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <GL/glew.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Everything needed to drive fragment.glsl without a window: the shader program, the fullscreen quad and the
+// accumulation target. Used by both the interactive application and the headless renderer.
+namespace Renderer
+{
+    // Fragment traces whole paths in fragment.glsl, Wavefront runs the stages of wavefront.glsl as compute dispatches.
+    // Both accumulate into the same target and are displayed by fragment.glsl.
+    enum class Backend
+    {
+        Fragment,
+        Wavefront
+    };
+
+    extern Backend ActiveBackend;
+    // The program the accumulation and display passes use: GenericProgram or a variant specialized for the scene (see
+    // ShaderVariants)
+    extern GLuint ShaderProgram;
+    // fragment.glsl without any scene constants, compiled by RecompileShader
+    extern GLuint GenericProgram;
+
+    // Holds the running mean of all passes so far, plus the rounding error of the compensated (Kahan) summation that
+    // updates it and the moments adaptive sampling estimates each pixel's variance from (see addToMoments in
+    // common.glsl).
+    struct AccumulationTarget
+    {
+        GLuint m_Fbo;
+        GLuint m_MeanTexture;
+        GLuint m_CompensationTexture;
+        GLuint m_MomentsTexture;
+    };
+
+    // fragment.glsl reads the mean from one target and writes the updated mean to the other, then they swap, so no
+    // texture is ever sampled while it is being rendered to. CurrentTarget is the one holding the latest mean.
+    extern AccumulationTarget Targets[2];
+    extern int CurrentTarget;
+    extern int TargetWidth, TargetHeight;
+
+    // Normal and depth (RGBA32F), albedo (RGBA32F) and object index (R32I) of every pixel's primary hit, written by
+    // gbuffer.glsl when an accumulation restarts. Same size as the accumulation targets.
+    struct GBufferTarget
+    {
+        GLuint m_Fbo;
+        GLuint m_NormalDepthTexture;
+        GLuint m_AlbedoTexture;
+        GLuint m_ObjectIndexTexture;
+    };
+
+    extern GBufferTarget GBuffer;
+    extern GLuint GBufferProgram;
+    // Camera the G-buffer was last rendered with, i.e. the one the current accumulation belongs to
+    extern glm::vec3 GBufferCameraPosition;
+    extern glm::mat4 GBufferRotationMatrix;
+    extern float GBufferAspectRatio;
+
+    // Framebuffer whose first color attachment holds the unclamped image DrawToScreen last showed: the mean of the
+    // current target or Denoiser's output.
+    extern GLuint DisplayedFbo;
+
+    extern GLint DirectOutPassUniformLocation, AccumulatedPassesUniformLocation, FirstSampleUniformLocation,
+                 CamPosUniformLocation, RotationMatrixUniformLocation, AspectRatioUniformLocation,
+                 DebugKeyUniformLocation, AdaptiveSamplingUniformLocation, ShowSampleCountUniformLocation;
+
+    // Reads a shader file into source, replacing #include "file" lines with the contents of that file.
+    bool ReadShaderSource(const char* filePath, std::string& source);
+    // defines is inserted after the #version line of the fragment shader. Returns 0 if the program doesn't link. Linked
+    // programs are reused from ProgramCache when the sources haven't changed.
+    GLuint CreateShaderProgram(const char* vertexFilePath, const char* fragmentFilePath, const char* defines = "");
+    // defines is inserted after the #version line, e.g. to select one stage of a shader file. Returns 0 if the program
+    // doesn't link.
+    GLuint CreateComputeProgram(const char* computeFilePath, const char* defines);
+    // Returns false if fragment.glsl or gbuffer.glsl doesn't link; the previous programs are kept then.
+    bool RecompileShader();
+    // Makes genericProgram and gBufferProgram GenericProgram and GBufferProgram, deleting the previous ones, and switches
+    // the accumulation and display passes to genericProgram.
+    void ReplaceShaderPrograms(GLuint genericProgram, GLuint gBufferProgram);
+    // Makes program (GenericProgram or a variant of it) the one used by the accumulation and display passes.
+    void SetShaderProgram(GLuint program);
+
+    void CreateScreenQuad();
+    void DeleteScreenQuad();
+
+    bool CreateAccumulationTarget(int width, int height);
+    void ResizeAccumulationTarget(int width, int height);
+    void DeleteAccumulationTarget();
+
+    void UploadSkybox(const float* data, int width, int height);
+    // Fingerprint of the image last given to UploadSkybox or SkyboxLoader::Upload, part of the state a Checkpoint
+    // belongs to
+    extern uint64_t SkyboxHash;
+    // Samples per pixel taken since the accumulation restarted, and so the sample index the next pass starts at (see
+    // sampler.glsl). Reset when AccumulatePass starts a new accumulation; reprojected ones continue counting.
+    extern uint32_t SampleCount;
+
+    // Compiles the wavefront programs the first time they are needed. Returns false (and keeps the current backend)
+    // if they don't compile.
+    bool SetBackend(Backend backend);
+
+    void SetCamera(glm::vec3 position, const glm::mat4& rotationMatrix, float aspectRatio);
+    // Renders the G-buffer for the camera given to SetCamera. AccumulatePass does this whenever an accumulation restarts.
+    void UpdateGBuffer();
+    // Also updates the convergence mask if adaptive sampling is enabled
+    void AccumulatePass(int accumulatedPasses);
+    // Shows the accumulated image, run through Denoiser if it is enabled
+    void DrawToScreen();
+
+    // Reads the mean RGB color of all accumulated passes into buffer, bottom row first.
+    void ReadAccumulation(float* buffer);
+    // Reads the number of passes accumulated into every pixel into buffer, bottom row first.
+    void ReadSampleCounts(float* buffer);
+    // Index of the object visible at a pixel of the window (top row first, like cursor positions), or -1 for none.
+    // Reads a single texel of the G-buffer instead of casting a ray.
+    int PickObject(int x, int y);
+    // Averages rgb by divider, clamps it to [0,1] and writes it as an 8-bit PNG. Returns false if that failed.
+    bool WritePng(const char* filepath, const float* rgb, int width, int height, int stride, float divider);
+}
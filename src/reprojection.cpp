@@ -0,0 +1,146 @@
+#include "reprojection.h"
+
+#include <GL/glew.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "adaptive.h"
+#include "renderer.h"
+
+namespace Reprojection
+{
+    bool Enabled = false;
+    int MaxHistory = 64;
+    float DepthTolerance = 0.05f;
+    float NormalThreshold = 0.9f;
+
+    // Texture units of the G-buffers; the previous accumulation target uses the same units as in fragment.glsl
+    constexpr GLint NormalDepthUnit = 4;
+    constexpr GLint PreviousNormalDepthUnit = 7;
+
+    enum Uniform
+    {
+        CameraPosition,
+        RotationMatrix,
+        AspectRatio,
+        PreviousCameraPosition,
+        PreviousRotationMatrix,
+        PreviousAspectRatio,
+        DepthToleranceUniform,
+        NormalThresholdUniform,
+        MaxHistoryUniform,
+        UniformCount
+    };
+
+    constexpr const char* UniformNames[UniformCount] = {
+        "u_cameraPosition", "u_rotationMatrix", "u_aspectRatio", "u_previousCameraPosition",
+        "u_previousRotationMatrix", "u_previousAspectRatio", "u_depthTolerance", "u_normalThreshold", "u_maxHistory"
+    };
+
+    GLuint Program;
+    GLint UniformLocations[UniformCount];
+
+    // Copy of the G-buffer's normal and depth from before it is re-rendered for the new camera
+    GLuint PreviousNormalDepthTexture;
+    int HistoryWidth = 0, HistoryHeight = 0;
+
+    bool SetEnabled(const bool enabled)
+    {
+        if (enabled && !Program)
+        {
+            Program = Renderer::CreateShaderProgram("shaders\\vertex.glsl", "shaders\\reproject.glsl");
+
+            GLint linked = GL_FALSE;
+            if (Program) glGetProgramiv(Program, GL_LINK_STATUS, &linked);
+            glUseProgram(Renderer::ShaderProgram);
+            if (!linked)
+            {
+                Delete();
+                return false;
+            }
+
+            for (int uniform = 0; uniform < UniformCount; uniform++)
+                UniformLocations[uniform] = glGetUniformLocation(Program, UniformNames[uniform]);
+            glProgramUniform1i(Program, glGetUniformLocation(Program, "u_screenTexture"), 0);
+            glProgramUniform1i(Program, glGetUniformLocation(Program, "u_compensationTexture"), 2);
+            glProgramUniform1i(Program, glGetUniformLocation(Program, "u_momentsTexture"), 3);
+            glProgramUniform1i(Program, glGetUniformLocation(Program, "u_normalDepthTexture"), NormalDepthUnit);
+            glProgramUniform1i(Program, glGetUniformLocation(Program, "u_previousNormalDepthTexture"),
+                               PreviousNormalDepthUnit);
+        }
+
+        Enabled = enabled;
+        return true;
+    }
+
+    void Delete()
+    {
+        glDeleteProgram(Program);
+        glDeleteTextures(1, &PreviousNormalDepthTexture);
+        Program = PreviousNormalDepthTexture = 0;
+        HistoryWidth = HistoryHeight = 0;
+        Enabled = false;
+    }
+
+    void SaveNormalDepth()
+    {
+        if (HistoryWidth != Renderer::TargetWidth || HistoryHeight != Renderer::TargetHeight)
+        {
+            glDeleteTextures(1, &PreviousNormalDepthTexture);
+            glGenTextures(1, &PreviousNormalDepthTexture);
+            glBindTexture(GL_TEXTURE_2D, PreviousNormalDepthTexture);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, Renderer::TargetWidth, Renderer::TargetHeight);
+            HistoryWidth = Renderer::TargetWidth;
+            HistoryHeight = Renderer::TargetHeight;
+        }
+
+        glCopyImageSubData(Renderer::GBuffer.m_NormalDepthTexture, GL_TEXTURE_2D, 0, 0, 0, 0,
+                           PreviousNormalDepthTexture, GL_TEXTURE_2D, 0, 0, 0, 0, HistoryWidth, HistoryHeight, 1);
+    }
+
+    void SetCameraUniforms(const Uniform position, const Uniform rotationMatrix, const Uniform aspectRatio)
+    {
+        const glm::vec3& cameraPosition = Renderer::GBufferCameraPosition;
+        glUniform3f(UniformLocations[position], cameraPosition.x, cameraPosition.y, cameraPosition.z);
+        glUniformMatrix4fv(UniformLocations[rotationMatrix], 1, GL_FALSE,
+                           glm::value_ptr(Renderer::GBufferRotationMatrix));
+        glUniform1f(UniformLocations[aspectRatio], Renderer::GBufferAspectRatio);
+    }
+
+    int Apply()
+    {
+        glUseProgram(Program);
+        // The G-buffer still belongs to the previous camera
+        SetCameraUniforms(PreviousCameraPosition, PreviousRotationMatrix, PreviousAspectRatio);
+        SaveNormalDepth();
+
+        Renderer::UpdateGBuffer();
+        glUseProgram(Program);
+        SetCameraUniforms(CameraPosition, RotationMatrix, AspectRatio);
+        glUniform1f(UniformLocations[DepthToleranceUniform], DepthTolerance);
+        glUniform1f(UniformLocations[NormalThresholdUniform], NormalThreshold);
+        glUniform1f(UniformLocations[MaxHistoryUniform], static_cast<float>(MaxHistory));
+
+        const Renderer::AccumulationTarget& source = Renderer::Targets[Renderer::CurrentTarget];
+        glActiveTexture(GL_TEXTURE0 + PreviousNormalDepthUnit);
+        glBindTexture(GL_TEXTURE_2D, PreviousNormalDepthTexture);
+        glActiveTexture(GL_TEXTURE0 + NormalDepthUnit);
+        glBindTexture(GL_TEXTURE_2D, Renderer::GBuffer.m_NormalDepthTexture);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, source.m_MomentsTexture);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, source.m_CompensationTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, source.m_MeanTexture);
+
+        // Written like a fragment.glsl pass, so the reprojected samples end up in the current target
+        Renderer::CurrentTarget = 1 - Renderer::CurrentTarget;
+        glBindFramebuffer(GL_FRAMEBUFFER, Renderer::Targets[Renderer::CurrentTarget].m_Fbo);
+        glViewport(0, 0, Renderer::TargetWidth, Renderer::TargetHeight);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        glUseProgram(Renderer::ShaderProgram);
+        // The mask still describes the previous view
+        if (Adaptive::Enabled) Adaptive::UpdateMask();
+        return 1;
+    }
+}
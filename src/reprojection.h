@@ -0,0 +1,25 @@
+#pragma once
+
+// Temporal reprojection for camera moves: instead of discarding the accumulation, reproject.glsl warps the previous
+// camera's mean and moments into the new view using the primary hits in both G-buffers, so only the pixels that were
+// hidden or off screen (or whose surface changed) start over. Used between the frames of an animation.
+namespace Reprojection
+{
+    extern bool Enabled;
+    // Passes carried over per pixel are capped at this, so view-dependent shading (reflections, highlights) smeared
+    // along by the reprojection is replaced by new samples after a few frames
+    extern int MaxHistory;
+    // Disocclusion test: largest depth difference relative to the hit distance, and smallest cosine between normals
+    extern float DepthTolerance;
+    extern float NormalThreshold;
+
+    // Compiles reproject.glsl the first time reprojection is enabled. Returns false (and leaves it disabled) if it
+    // doesn't compile.
+    bool SetEnabled(bool enabled);
+    void Delete();
+
+    // Call after Renderer::SetCamera moved the camera, in place of restarting the accumulation. Renders the G-buffer
+    // for the new camera and fills the next Renderer::Targets entry with the samples that are still valid. Returns the
+    // accumulatedPasses to continue with, which is never 0 so the next pass adds to the reprojected samples.
+    int Apply();
+}
@@ -1,14 +1,19 @@
 #include "scene.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
-#include <string>
 
-extern bool RefreshRequired;
+#include "bvh.h"
+#include "light_grid.h"
 
 namespace Scene
 {
     GLuint BoundShader;
     std::vector<Object> Objects;
+    std::vector<Material> Materials;
     std::vector<PointLight> Lights;
     Material PlaneMaterial;
 
@@ -29,6 +34,7 @@ namespace Scene
     bool PlaneVisible = true;
 
     int SelectedObjectIndex = -1;
+    uint64_t Revision = 0;
 
     Material::Material() = default;
 
@@ -54,15 +60,33 @@ namespace Scene
         this->m_SpecularExponent = specularExponent;
     }
 
+    bool Material::operator==(const Material& other) const
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            if (m_Albedo[i] != other.m_Albedo[i] || m_Specular[i] != other.m_Specular[i] ||
+                m_Emission[i] != other.m_Emission[i])
+                return false;
+        }
+        return m_Roughness == other.m_Roughness && m_SpecularHighlight == other.m_SpecularHighlight &&
+            m_EmissionStrength == other.m_EmissionStrength && m_SpecularExponent == other.m_SpecularExponent;
+    }
+
     Object::Object() = default;
 
     Object::Object(const unsigned int type, const std::initializer_list<float>& position,
-                   const std::initializer_list<float>& scale, const Material& material)
+                   const std::initializer_list<float>& scale, const Material& material) : Object::Object(
+        type, position, scale, AddMaterial(material))
+    {
+    }
+
+    Object::Object(const unsigned int type, const std::initializer_list<float>& position,
+                   const std::initializer_list<float>& scale, const unsigned int materialIndex)
     {
         this->m_Type = type;
         for (int i = 0; i < 3; i++) this->m_Position[i] = *(position.begin() + i);
         for (int i = 0; i < 3; i++) this->m_Scale[i] = *(scale.begin() + i);
-        this->m_Material = material;
+        this->m_MaterialIndex = materialIndex;
     }
 
     PointLight::PointLight() = default;
@@ -81,108 +105,303 @@ namespace Scene
     {
     }
 
-    void SendObjectData(const size_t objectIndex)
+    // Mirrors the std140 SceneSettings block in common.glsl
+    struct SettingsBlock
+    {
+        Material m_PlaneMaterial;
+        int m_ShadowResolution;
+        int m_LightBounces;
+        int m_FramePasses;
+        float m_Blur;
+        float m_BloomRadius;
+        float m_BloomIntensity;
+        float m_SkyboxStrength;
+        float m_SkyboxGamma;
+        float m_SkyboxCeiling;
+        int m_PlaneVisible;
+        int m_SelectedObjectIndex;
+        int m_ObjectCount;
+        int m_LightCount;
+        int m_Padding[3];
+    };
+
+    static_assert(sizeof(SettingsBlock) == 128, "SettingsBlock must match the std140 layout of SceneSettings");
+
+    // Objects, Lights and Materials one after another, each range bound to its own binding point
+    GLuint SceneBuffer, SettingsBuffer;
+    GLsizeiptr SceneBufferCapacity;
+    GLintptr LightDataOffset, MaterialDataOffset;
+    size_t UploadedObjectCount, UploadedLightCount, UploadedMaterialCount;
+    std::vector<unsigned char> SceneBufferStaging;
+
+    // Everything edited since the last FlushChanges. Dirty objects, lights and materials are tracked as one index
+    // range each.
+    struct ChangeJournal
     {
-        const std::string i_str = std::to_string(objectIndex);
-        glUniform1ui(
-            glGetUniformLocation(BoundShader, std::string("u_objects[").append(i_str).append("].type").c_str()),
-            Objects[objectIndex].m_Type);
-        glUniform3f(
-            glGetUniformLocation(BoundShader, std::string("u_objects[").append(i_str).append("].position").c_str()),
-            Objects[objectIndex].m_Position[0], Objects[objectIndex].m_Position[1], Objects[objectIndex].m_Position[2]);
-        glUniform3f(
-            glGetUniformLocation(BoundShader, std::string("u_objects[").append(i_str).append("].scale").c_str()),
-            Objects[objectIndex].m_Scale[0], Objects[objectIndex].m_Scale[1], Objects[objectIndex].m_Scale[2]);
-        glUniform3f(
-            glGetUniformLocation(BoundShader,
-                                 std::string("u_objects[").append(i_str).append("].material.albedo").c_str()),
-            Objects[objectIndex].m_Material.m_Albedo[0], Objects[objectIndex].m_Material.m_Albedo[1],
-            Objects[objectIndex].m_Material.m_Albedo[2]);
-        glUniform3f(
-            glGetUniformLocation(BoundShader,
-                                 std::string("u_objects[").append(i_str).append("].material.specular").c_str()),
-            Objects[objectIndex].m_Material.m_Specular[0], Objects[objectIndex].m_Material.m_Specular[1],
-            Objects[objectIndex].m_Material.m_Specular[2]);
-        glUniform3f(
-            glGetUniformLocation(BoundShader,
-                                 std::string("u_objects[").append(i_str).append("].material.emission").c_str()),
-            Objects[objectIndex].m_Material.m_Emission[0], Objects[objectIndex].m_Material.m_Emission[1],
-            Objects[objectIndex].m_Material.m_Emission[2]);
-        glUniform1f(
-            glGetUniformLocation(BoundShader,
-                                 std::string("u_objects[").append(i_str).append("].material.emissionStrength").c_str()),
-            Objects[objectIndex].m_Material.m_EmissionStrength);
-        glUniform1f(
-            glGetUniformLocation(BoundShader,
-                                 std::string("u_objects[").append(i_str).append("].material.roughness").c_str()),
-            Objects[objectIndex].m_Material.m_Roughness);
-        glUniform1f(
-            glGetUniformLocation(BoundShader,
-                                 std::string("u_objects[").append(i_str).append("].material.specularHighlight").
-                                                           c_str()),
-            Objects[objectIndex].m_Material.m_SpecularHighlight);
-        glUniform1f(
-            glGetUniformLocation(BoundShader,
-                                 std::string("u_objects[").append(i_str).append("].material.specularExponent").c_str()),
-            Objects[objectIndex].m_Material.m_SpecularExponent);
+        size_t m_FirstDirtyObject = SIZE_MAX, m_LastDirtyObject = 0;
+        size_t m_FirstDirtyLight = SIZE_MAX, m_LastDirtyLight = 0;
+        size_t m_FirstDirtyMaterial = SIZE_MAX, m_LastDirtyMaterial = 0;
+        bool m_LayoutChanged = false;
+        bool m_SettingsDirty = false;
+        bool m_ResetAccumulation = false;
+        bool m_MaterialsOrphaned = false; // An object left the last reference to a palette entry
+    };
+
+    ChangeJournal Journal;
+
+    void UploadSceneData()
+    {
+        GLint offsetAlignment = 1;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+        const auto align = [offsetAlignment](const GLsizeiptr offset)
+        {
+            return (offset + offsetAlignment - 1) / offsetAlignment * offsetAlignment;
+        };
+
+        // Empty arrays still get one element since zero-sized ranges can't be bound
+        const GLsizeiptr objectBytes = static_cast<GLsizeiptr>(std::max<size_t>(Objects.size(), 1) * sizeof(Object));
+        const GLsizeiptr lightBytes = static_cast<GLsizeiptr>(std::max<size_t>(Lights.size(), 1) * sizeof(PointLight));
+        const GLsizeiptr materialBytes = static_cast<GLsizeiptr>(std::max<size_t>(Materials.size(), 1) *
+            sizeof(Material));
+        LightDataOffset = align(objectBytes);
+        MaterialDataOffset = align(LightDataOffset + lightBytes);
+        const GLsizeiptr totalBytes = MaterialDataOffset + materialBytes;
+
+        SceneBufferStaging.resize(static_cast<size_t>(totalBytes));
+        if (!Objects.empty()) memcpy(SceneBufferStaging.data(), Objects.data(), Objects.size() * sizeof(Object));
+        if (!Lights.empty())
+            memcpy(SceneBufferStaging.data() + LightDataOffset, Lights.data(), Lights.size() * sizeof(PointLight));
+        if (!Materials.empty())
+        {
+            memcpy(SceneBufferStaging.data() + MaterialDataOffset, Materials.data(),
+                   Materials.size() * sizeof(Material));
+        }
+
+        if (!SceneBuffer) glGenBuffers(1, &SceneBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, SceneBuffer);
+        if (totalBytes > SceneBufferCapacity)
+        {
+            // Grow geometrically so placing objects one by one doesn't reallocate every time
+            SceneBufferCapacity = std::max(totalBytes, SceneBufferCapacity * 2);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, SceneBufferCapacity, nullptr, GL_DYNAMIC_DRAW);
+        }
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, totalBytes, SceneBufferStaging.data());
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, ObjectBinding, SceneBuffer, 0, objectBytes);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, LightBinding, SceneBuffer, LightDataOffset, lightBytes);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, MaterialBinding, SceneBuffer, MaterialDataOffset, materialBytes);
+
+        LightGrid::Update();
+
+        UploadedObjectCount = Objects.size();
+        UploadedLightCount = Lights.size();
+        UploadedMaterialCount = Materials.size();
     }
 
-    void Bind(const GLuint shaderProgram)
+    void UploadSettings()
     {
-        BoundShader = shaderProgram;
+        SettingsBlock settings{};
+        settings.m_PlaneMaterial = PlaneMaterial;
+        settings.m_ShadowResolution = ShadowResolution;
+        settings.m_LightBounces = LightBounces;
+        settings.m_FramePasses = FramePasses;
+        settings.m_Blur = Blur;
+        settings.m_BloomRadius = BloomRadius;
+        settings.m_BloomIntensity = BloomIntensity;
+        settings.m_SkyboxStrength = SkyboxStrength;
+        settings.m_SkyboxGamma = SkyboxGamma;
+        settings.m_SkyboxCeiling = SkyboxCeiling;
+        settings.m_PlaneVisible = PlaneVisible;
+        settings.m_SelectedObjectIndex = SelectedObjectIndex;
+        settings.m_ObjectCount = static_cast<int>(Objects.size());
+        settings.m_LightCount = static_cast<int>(Lights.size());
+
+        if (!SettingsBuffer)
+        {
+            glGenBuffers(1, &SettingsBuffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, SettingsBuffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(SettingsBlock), nullptr, GL_DYNAMIC_DRAW);
+            glBindBufferBase(GL_UNIFORM_BUFFER, SettingsBinding, SettingsBuffer);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, SettingsBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SettingsBlock), &settings);
+    }
+
+    // Uploads elements [first, last] of one of the arrays in SceneBuffer
+    void UploadRange(const GLintptr arrayOffset, const void* array, const size_t elementSize, const size_t first,
+                     const size_t last)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, SceneBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, arrayOffset + static_cast<GLintptr>(first * elementSize),
+                        static_cast<GLsizeiptr>((last - first + 1) * elementSize),
+                        static_cast<const unsigned char*>(array) + first * elementSize);
+    }
+
+    void MarkObjectDirty(const size_t objectIndex, const bool geometryChanged)
+    {
+        Journal.m_FirstDirtyObject = std::min(Journal.m_FirstDirtyObject, objectIndex);
+        Journal.m_LastDirtyObject = std::max(Journal.m_LastDirtyObject, objectIndex);
+        Journal.m_ResetAccumulation = true;
+        if (geometryChanged) Bvh::MarkRefit();
+    }
+
+    void MarkObjectsAdded()
+    {
+        Journal.m_LayoutChanged = true;
+        Journal.m_SettingsDirty = true; // Object count
+        Journal.m_ResetAccumulation = true;
+        Bvh::MarkRebuild();
+    }
+
+    void MarkLightDirty(const size_t lightIndex)
+    {
+        Journal.m_FirstDirtyLight = std::min(Journal.m_FirstDirtyLight, lightIndex);
+        Journal.m_LastDirtyLight = std::max(Journal.m_LastDirtyLight, lightIndex);
+        Journal.m_ResetAccumulation = true;
+    }
+
+    void MarkMaterialDirty(const size_t materialIndex)
+    {
+        Journal.m_FirstDirtyMaterial = std::min(Journal.m_FirstDirtyMaterial, materialIndex);
+        Journal.m_LastDirtyMaterial = std::max(Journal.m_LastDirtyMaterial, materialIndex);
+        Journal.m_ResetAccumulation = true;
+    }
+
+    unsigned int AddMaterial(const Material& material)
+    {
+        // Palettes hold a handful of distinct materials, so a linear search is fine
+        for (size_t i = 0; i < Materials.size(); i++)
+        {
+            if (Materials[i] == material) return static_cast<unsigned int>(i);
+        }
+
+        Materials.push_back(material);
+        return static_cast<unsigned int>(Materials.size() - 1);
+    }
+
+    void SetObjectMaterial(const size_t objectIndex, const Material& material)
+    {
+        Object& object = Objects[objectIndex];
+        const unsigned int current = object.m_MaterialIndex;
+
+        // Back to an entry the palette already has (e.g. an edit that was undone); the one left behind may now be
+        // unused, which FlushChanges cleans up
+        for (size_t i = 0; i < Materials.size(); i++)
+        {
+            if (!(Materials[i] == material)) continue;
+            if (i != current)
+            {
+                object.m_MaterialIndex = static_cast<unsigned int>(i);
+                MarkObjectDirty(objectIndex, false);
+                Journal.m_MaterialsOrphaned = true;
+            }
+            return;
+        }
 
-        for (size_t i = 0; i < Lights.size(); i++)
+        bool shared = false;
+        for (size_t i = 0; i < Objects.size() && !shared; i++)
         {
-            glUniform3f(
-                glGetUniformLocation(shaderProgram,
-                                     std::string("u_lights[").append(std::to_string(i)).append("].position").c_str()),
-                Lights[i].m_Position[0], Lights[i].m_Position[1], Lights[i].m_Position[2]);
-            glUniform1f(glGetUniformLocation(shaderProgram,
-                                             std::string("u_lights[").append(std::to_string(i)).append("].radius").
-                                                                      c_str()), Lights[i].m_Radius);
-            glUniform3f(
-                glGetUniformLocation(shaderProgram,
-                                     std::string("u_lights[").append(std::to_string(i)).append("].color").c_str()),
-                Lights[i].m_Color[0], Lights[i].m_Color[1], Lights[i].m_Color[2]);
-            glUniform1f(glGetUniformLocation(shaderProgram,
-                                             std::string("u_lights[").append(std::to_string(i)).append("].power").
-                                                                      c_str()), Lights[i].m_Power);
-            glUniform1f(glGetUniformLocation(shaderProgram,
-                                             std::string("u_lights[").append(std::to_string(i)).append("].reach").
-                                                                      c_str()), Lights[i].m_Reach);
+            shared = i != objectIndex && Objects[i].m_MaterialIndex == current;
         }
 
-        glUniform3f(glGetUniformLocation(shaderProgram, "u_planeMaterial.albedo"), PlaneMaterial.m_Albedo[0],
-                    PlaneMaterial.m_Albedo[1], PlaneMaterial.m_Albedo[2]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "u_planeMaterial.specular"), PlaneMaterial.m_Specular[0],
-                    PlaneMaterial.m_Specular[1], PlaneMaterial.m_Specular[2]);
-        glUniform3f(glGetUniformLocation(shaderProgram, "u_planeMaterial.emission"), PlaneMaterial.m_Emission[0],
-                    PlaneMaterial.m_Emission[1], PlaneMaterial.m_Emission[2]);
-        glUniform1f(glGetUniformLocation(shaderProgram, "u_planeMaterial.emissionStrength"),
-                    PlaneMaterial.m_EmissionStrength);
-        glUniform1f(glGetUniformLocation(shaderProgram, "u_planeMaterial.roughness"), PlaneMaterial.m_Roughness);
-        glUniform1f(glGetUniformLocation(shaderProgram, "u_planeMaterial.specularHighlight"),
-                    PlaneMaterial.m_SpecularHighlight);
-        glUniform1f(glGetUniformLocation(shaderProgram, "u_planeMaterial.specularExponent"),
-                    PlaneMaterial.m_SpecularExponent);
-
-        glUniform1i(glGetUniformLocation(shaderProgram, "u_shadowResolution"), ShadowResolution);
-        glUniform1i(glGetUniformLocation(shaderProgram, "u_lightBounces"), LightBounces);
-        glUniform1i(glGetUniformLocation(shaderProgram, "u_framePasses"), FramePasses);
-        glUniform1f(glGetUniformLocation(shaderProgram, "u_blur"), Blur);
-        glUniform1f(glGetUniformLocation(shaderProgram, "u_bloomRadius"), BloomRadius);
-        glUniform1f(glGetUniformLocation(shaderProgram, "u_bloomIntensity"), BloomIntensity);
-        glUniform1f(glGetUniformLocation(shaderProgram, "u_skyboxStrength"), SkyboxStrength);
-        glUniform1f(glGetUniformLocation(shaderProgram, "u_skyboxGamma"), SkyboxGamma);
-        glUniform1f(glGetUniformLocation(shaderProgram, "u_skyboxCeiling"), SkyboxCeiling);
-
-        for (size_t i = 0; i < Objects.size(); i++)
+        if (!shared)
         {
-            SendObjectData(i);
+            Materials[current] = material;
+            MarkMaterialDirty(current);
+            return;
         }
 
-        glUniform1i(glGetUniformLocation(BoundShader, "u_selectedSphereIndex"), SelectedObjectIndex);
-        glUniform1i(glGetUniformLocation(BoundShader, "u_planeVisible"), PlaneVisible);
+        // No equal entry exists (see above), so the object gets its own and further edits (e.g. while dragging a
+        // slider) take the in-place path
+        Materials.push_back(material);
+        object.m_MaterialIndex = static_cast<unsigned int>(Materials.size() - 1);
+        MarkObjectDirty(objectIndex, false);
+    }
+
+    void MarkSettingsDirty(const bool resetAccumulation)
+    {
+        Journal.m_SettingsDirty = true;
+        if (resetAccumulation) Journal.m_ResetAccumulation = true;
+    }
+
+    // Drops the palette entries no object references any more, keeping the order of the others
+    void RemoveUnusedMaterials()
+    {
+        constexpr unsigned int unused = UINT32_MAX;
+        std::vector<unsigned int> remap(Materials.size(), unused);
+        for (const Object& object : Objects) remap[object.m_MaterialIndex] = 0;
+
+        unsigned int kept = 0;
+        for (size_t i = 0; i < Materials.size(); i++)
+        {
+            if (remap[i] == unused) continue;
+            remap[i] = kept;
+            Materials[kept++] = Materials[i];
+        }
+        if (kept == Materials.size()) return;
+
+        Materials.resize(kept);
+        for (Object& object : Objects) object.m_MaterialIndex = remap[object.m_MaterialIndex];
+    }
+
+    bool FlushChanges()
+    {
+        // Shrinks the palette, so the count check below uploads the whole scene again
+        if (Journal.m_MaterialsOrphaned) RemoveUnusedMaterials();
+        if (Objects.size() != UploadedObjectCount || Lights.size() != UploadedLightCount ||
+            Materials.size() != UploadedMaterialCount)
+            Journal.m_LayoutChanged = true;
+        if (Journal.m_LayoutChanged || Journal.m_SettingsDirty || Journal.m_FirstDirtyObject != SIZE_MAX ||
+            Journal.m_FirstDirtyLight != SIZE_MAX || Journal.m_FirstDirtyMaterial != SIZE_MAX)
+            Revision++;
+
+        if (Journal.m_LayoutChanged)
+        {
+            UploadSceneData();
+        }
+        else
+        {
+            if (Journal.m_FirstDirtyObject <= Journal.m_LastDirtyObject)
+            {
+                UploadRange(0, Objects.data(), sizeof(Object), Journal.m_FirstDirtyObject,
+                            Journal.m_LastDirtyObject);
+            }
+            if (Journal.m_FirstDirtyLight <= Journal.m_LastDirtyLight)
+            {
+                UploadRange(LightDataOffset, Lights.data(), sizeof(PointLight), Journal.m_FirstDirtyLight,
+                            Journal.m_LastDirtyLight);
+                LightGrid::Update();
+            }
+            if (Journal.m_FirstDirtyMaterial <= Journal.m_LastDirtyMaterial)
+            {
+                UploadRange(MaterialDataOffset, Materials.data(), sizeof(Material), Journal.m_FirstDirtyMaterial,
+                            Journal.m_LastDirtyMaterial);
+            }
+        }
+
+        if (Journal.m_SettingsDirty) UploadSettings();
+
+        const bool bvhChanged = Bvh::Update();
+        const bool resetAccumulation = Journal.m_ResetAccumulation || bvhChanged;
+        Journal = ChangeJournal();
+        return resetAccumulation;
+    }
+
+    void DeleteSceneBuffer()
+    {
+        glDeleteBuffers(1, &SceneBuffer);
+        glDeleteBuffers(1, &SettingsBuffer);
+        SceneBuffer = SettingsBuffer = 0;
+        LightGrid::Delete();
+        SceneBufferCapacity = 0;
+    }
+
+    void Bind(const GLuint shaderProgram)
+    {
+        BoundShader = shaderProgram;
+
+        UploadSceneData();
+        UploadSettings();
+        Journal = ChangeJournal();
     }
 
     void Unbind()
@@ -200,7 +419,7 @@ namespace Scene
         const float y = glm::length(position - p);
         if (y < radius)
         {
-            const float x = sqrt(radius * radius - y * y);
+            const float x = std::sqrt(radius * radius - y * y);
             const float t1 = t - x;
             if (t1 > 0)
             {
@@ -239,7 +458,7 @@ namespace Scene
                            const glm::vec3 rayDirection,
                            float* hitDistance)
     {
-        if (const float denom = glm::dot(planeNormal, rayDirection); abs(denom) > 0.0001)
+        if (const float denom = glm::dot(planeNormal, rayDirection); std::abs(denom) > 0.0001)
         {
             const glm::vec3 d = planePoint - rayOrigin;
             *hitDistance = glm::dot(d, planeNormal) / denom;
@@ -249,53 +468,33 @@ namespace Scene
         return false;
     }
 
-    void SelectHovered(const float mouseX, const float mouseY, const int screenWidth, const int screenHeight,
-                       const glm::vec3 cameraPosition,
-                       const glm::mat4& rotationMatrix)
+    bool Occluded(const glm::vec3 rayOrigin, const glm::vec3 rayDirection, const float maxDistance)
     {
-        const float relativeMouseX = mouseX / static_cast<float>(screenWidth);
-        const float relativeMouseY = 1.0f - mouseY / static_cast<float>(screenHeight);
-        const glm::vec2 centeredUV = (2.0f * glm::vec2(relativeMouseX, relativeMouseY) - glm::vec2(1.0)) * glm::vec2(
-            static_cast<float>(screenWidth) / static_cast<float>(screenHeight), 1.0);
-        const glm::vec3 rayDir = glm::normalize(glm::vec4(centeredUV, -1.0, 0.0)) * rotationMatrix;
-
-        float minDist = -1.f;
-        SelectedObjectIndex = -1;
-        for (size_t sphereIndex = 0; sphereIndex < Objects.size(); sphereIndex++)
-        {
-            if (Objects[sphereIndex].m_Type == 0) continue;
-
-            float dist;
-            if (Objects[sphereIndex].m_Type == 1 && SphereIntersection(
-                glm::vec3(Objects[sphereIndex].m_Position[0], Objects[sphereIndex].m_Position[1],
-                          Objects[sphereIndex].m_Position[2]), Objects[sphereIndex].m_Scale[0], cameraPosition, rayDir,
-                &dist))
-            {
-                if (minDist == -1.f || dist < minDist)
-                {
-                    minDist = dist;
-                    SelectedObjectIndex = static_cast<int>(sphereIndex);
-                }
-            }
-            else if (Objects[sphereIndex].m_Type == 2 && BoxIntersection(
-                glm::vec3(Objects[sphereIndex].m_Position[0], Objects[sphereIndex].m_Position[1],
-                          Objects[sphereIndex].m_Position[2]),
-                glm::vec3(Objects[sphereIndex].m_Scale[0], Objects[sphereIndex].m_Scale[1],
-                          Objects[sphereIndex].m_Scale[2]),
-                cameraPosition, rayDir, &dist))
-            {
-                if (minDist == -1.f || dist < minDist)
-                {
-                    minDist = dist;
-                    SelectedObjectIndex = static_cast<int>(sphereIndex);
-                }
-            }
-        }
+        float hitDistance;
+        if (PlaneVisible && PlaneIntersection(glm::vec3(0, 1, 0), glm::vec3(0, 0, 0), rayOrigin, rayDirection,
+                                              &hitDistance) && hitDistance < maxDistance)
+            return true;
 
-        if (BoundShader)
+        for (const Object& object : Objects)
         {
-            glUniform1i(glGetUniformLocation(BoundShader, "u_selectedSphereIndex"), SelectedObjectIndex);
+            const glm::vec3 position(object.m_Position[0], object.m_Position[1], object.m_Position[2]);
+            if (((object.m_Type == 1 && SphereIntersection(position, object.m_Scale[0], rayOrigin, rayDirection,
+                                                           &hitDistance)) ||
+                    (object.m_Type == 2 && BoxIntersection(position, glm::vec3(object.m_Scale[0], object.m_Scale[1],
+                                                                                 object.m_Scale[2]), rayOrigin,
+                                                           rayDirection, &hitDistance))) &&
+                hitDistance < maxDistance)
+                return true;
         }
+
+        return false;
+    }
+
+    void SelectObject(const int objectIndex)
+    {
+        SelectedObjectIndex = objectIndex;
+
+        MarkSettingsDirty(false);
     }
 
     void MousePlace(float mouseX, float mouseY, int screenWidth, int screenHeight, glm::vec3 cameraPosition,
@@ -309,7 +508,7 @@ namespace Scene
 
         // Find plane intersection
         glm::vec3 planeNormal = glm::vec3(0, 1, 0);
-        if (float denom = glm::dot(planeNormal, rayDir); abs(denom) > 0.0001)
+        if (float denom = glm::dot(planeNormal, rayDir); std::abs(denom) > 0.0001)
         {
             glm::vec3 d = -cameraPosition;
             float hitDistance = glm::dot(d, planeNormal) / denom;
@@ -329,7 +528,7 @@ namespace Scene
                                                     }, {
                                                         selectedObject.m_Scale[0], selectedObject.m_Scale[1],
                                                         selectedObject.m_Scale[2]
-                                                    }, selectedObject.m_Material));
+                                                    }, selectedObject.m_MaterialIndex));
                 }
                 else
                 {
@@ -340,8 +539,7 @@ namespace Scene
                                                              1.0f, 0.0f, 0.0f)));
                 }
 
-                SendObjectData(Objects.size() - 1);
-                RefreshRequired = true;
+                MarkObjectsAdded();
             }
         }
     }
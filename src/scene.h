@@ -1,32 +1,42 @@
 #pragma once
 
+#include <cstdint>
 #include <initializer_list>
 #include <vector>
 #include <GL/glew.h>
 #include <glm/gtc/matrix_transform.hpp>
 
 namespace Scene {
+	// Object, Material and PointLight are laid out like their std430 counterparts in common.glsl, so Objects,
+	// Materials and Lights can be copied into the scene storage buffer as they are.
 	struct Material {
 		float m_Albedo[3];
+		float m_Roughness;
 		float m_Specular[3];
+		float m_SpecularHighlight;
 		float m_Emission[3];
 		float m_EmissionStrength;
-		float m_Roughness;
-		float m_SpecularHighlight;
 		float m_SpecularExponent;
+		float m_Padding[3];
 	
 		Material(const std::initializer_list<float>& albedo);
 		Material(const std::initializer_list<float>& albedo, const std::initializer_list<float>& specular, const std::initializer_list<float>& emission, float emissionStrength, float roughness, float specularHighlight, float specularExponent);
 		Material();
+
+		// Compares the material properties, not the padding
+		bool operator==(const Material& other) const;
 	};
 
+	// Only the fields needed to intersect the object are stored here; its material lives in Materials.
 	struct Object {
-		unsigned int m_Type; // Type 0 = none (invisible), Type 1 = sphere, Type 2 = box
 		float m_Position[3];
+		unsigned int m_Type; // Type 0 = none (invisible), Type 1 = sphere, Type 2 = box
 		float m_Scale[3]; // For spheres, only the x value will be used as the radius
-		Material m_Material;
+		unsigned int m_MaterialIndex;
 
+		// Adds material to the palette (or reuses an identical entry)
 		Object(unsigned int type, const std::initializer_list<float>& position, const std::initializer_list<float>& scale, const Material& material);
+		Object(unsigned int type, const std::initializer_list<float>& position, const std::initializer_list<float>& scale, unsigned int materialIndex);
 		Object();
 	};
 
@@ -36,16 +46,29 @@ namespace Scene {
 		float m_Color[3];
 		float m_Power;
 		float m_Reach; // Only points within this distance of the light will be affected
+		float m_Padding[3];
 
 		PointLight(const std::initializer_list<float>& position, float radius, const std::initializer_list<float>& color, float power, float reach);
 		PointLight();
 	};
 
+	static_assert(sizeof(Material) == 64, "Scene::Material must match the std430 layout of Material");
+	static_assert(sizeof(Object) == 32, "Scene::Object must match the std430 layout of Object");
+	static_assert(sizeof(PointLight) == 48, "Scene::PointLight must match the std430 layout of PointLight");
+
+	// Shader storage buffer binding points of the object, light and material arrays in common.glsl
+	constexpr GLuint ObjectBinding = 2;
+	constexpr GLuint LightBinding = 3;
+	constexpr GLuint MaterialBinding = 4;
+	// Uniform buffer binding point of the SceneSettings block in common.glsl
+	constexpr GLuint SettingsBinding = 0;
+
 	extern glm::vec3 CameraPosition;
 	extern float CameraYaw, CameraPitch;
 
 	extern GLuint BoundShader;
 	extern std::vector<Object> Objects;
+	extern std::vector<Material> Materials;
 	extern std::vector<PointLight> Lights;
 	extern Material PlaneMaterial;
 	extern int ShadowResolution;
@@ -61,8 +84,37 @@ namespace Scene {
 	extern GLuint SkyboxTexture;
 	extern bool PlaneVisible;
 
+	// CPU versions of the intersection tests in common.glsl
+	bool SphereIntersection(glm::vec3 position, float radius, glm::vec3 rayOrigin, glm::vec3 rayDirection, float* hitDistance);
+	bool BoxIntersection(glm::vec3 position, glm::vec3 size, glm::vec3 rayOrigin, glm::vec3 rayDirection, float* hitDistance);
+	bool PlaneIntersection(glm::vec3 planeNormal, glm::vec3 planePoint, glm::vec3 rayOrigin, glm::vec3 rayDirection, float* hitDistance);
+	// CPU version of occluded() in common.glsl: true as soon as any object or the plane is hit closer than maxDistance
+	bool Occluded(glm::vec3 rayOrigin, glm::vec3 rayDirection, float maxDistance);
+
 	void Bind(GLuint shaderProgram);
 	void Unbind();
-	void SelectHovered(float mouseX, float mouseY, int screenWidth, int screenHeight, glm::vec3 cameraPosition, const glm::mat4& rotationMatrix);
+	void DeleteSceneBuffer();
+
+	// Returns the index of an entry of Materials equal to material, adding one if there is none.
+	unsigned int AddMaterial(const Material& material);
+	// Changes the material of one object. An equal palette entry is shared if there is one; otherwise the object's
+	// entry is edited in place if no other object uses it, or the object gets a new entry of its own. Entries left
+	// unused are removed by FlushChanges.
+	void SetObjectMaterial(size_t objectIndex, const Material& material);
+
+	// Change journal: edits to Objects, Lights and the settings above are recorded here and uploaded by FlushChanges
+	// once per frame, so a widget being dragged costs nothing but a flag.
+	void MarkObjectDirty(size_t objectIndex, bool geometryChanged);
+	void MarkObjectsAdded();
+	void MarkLightDirty(size_t lightIndex);
+	void MarkMaterialDirty(size_t materialIndex);
+	// Selection changes only affect the display pass and don't need to restart accumulation.
+	void MarkSettingsDirty(bool resetAccumulation = true);
+	// Uploads the dirty object, light and material ranges and the settings block. Returns true if accumulation has to restart.
+	bool FlushChanges();
+	// Incremented by every FlushChanges that applied recorded changes, so data derived from the scene can tell it is stale
+	extern uint64_t Revision;
+	// objectIndex is usually what Renderer::PickObject found under the cursor; -1 clears the selection.
+	void SelectObject(int objectIndex);
 	void MousePlace(float mouseX, float mouseY, int screenWidth, int screenHeight, glm::vec3 cameraPosition, glm::mat4 rotationMatrix);
 }
@@ -0,0 +1,397 @@
+#include "scene_file.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.h"
+#include "scene.h"
+
+namespace SceneFile
+{
+    constexpr char Magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+    constexpr uint32_t Version = 1;
+    // Arrays start on this boundary so they stay aligned for the element types and for copies out of the mapping
+    constexpr uint64_t ArrayAlignment = 64;
+
+    // The scene globals that aren't arrays, in the order both forms store them
+    struct Settings
+    {
+        Scene::Material m_PlaneMaterial;
+        float m_CameraPosition[3];
+        float m_CameraYaw, m_CameraPitch;
+        int32_t m_ShadowResolution, m_LightBounces, m_FramePasses;
+        float m_Blur, m_BloomRadius, m_BloomIntensity;
+        float m_SkyboxStrength, m_SkyboxGamma, m_SkyboxCeiling;
+        int32_t m_PlaneVisible;
+    };
+
+    // Followed by the object, material and light arrays at their offsets (from the start of the file)
+    struct Header
+    {
+        char m_Magic[8];
+        uint32_t m_Version;
+        uint32_t m_HeaderSize;
+        uint64_t m_ObjectCount, m_MaterialCount, m_LightCount;
+        uint64_t m_ObjectOffset, m_MaterialOffset, m_LightOffset;
+        Settings m_Settings;
+        uint32_t m_Reserved;
+    };
+
+    static_assert(sizeof(Settings) == 124, "SceneFile::Settings must not contain padding");
+    static_assert(sizeof(Header) == 192, "SceneFile::Header must not contain padding");
+
+    Settings CurrentSettings()
+    {
+        Settings settings{};
+        settings.m_PlaneMaterial = Scene::PlaneMaterial;
+        std::memset(settings.m_PlaneMaterial.m_Padding, 0, sizeof(settings.m_PlaneMaterial.m_Padding));
+        std::memcpy(settings.m_CameraPosition, &Scene::CameraPosition, sizeof(settings.m_CameraPosition));
+        settings.m_CameraYaw = Scene::CameraYaw;
+        settings.m_CameraPitch = Scene::CameraPitch;
+        settings.m_ShadowResolution = Scene::ShadowResolution;
+        settings.m_LightBounces = Scene::LightBounces;
+        settings.m_FramePasses = Scene::FramePasses;
+        settings.m_Blur = Scene::Blur;
+        settings.m_BloomRadius = Scene::BloomRadius;
+        settings.m_BloomIntensity = Scene::BloomIntensity;
+        settings.m_SkyboxStrength = Scene::SkyboxStrength;
+        settings.m_SkyboxGamma = Scene::SkyboxGamma;
+        settings.m_SkyboxCeiling = Scene::SkyboxCeiling;
+        settings.m_PlaneVisible = Scene::PlaneVisible ? 1 : 0;
+        return settings;
+    }
+
+    void ApplySettings(const Settings& settings)
+    {
+        Scene::PlaneMaterial = settings.m_PlaneMaterial;
+        Scene::CameraPosition = glm::vec3(settings.m_CameraPosition[0], settings.m_CameraPosition[1],
+                                          settings.m_CameraPosition[2]);
+        Scene::CameraYaw = settings.m_CameraYaw;
+        Scene::CameraPitch = settings.m_CameraPitch;
+        Scene::ShadowResolution = settings.m_ShadowResolution;
+        Scene::LightBounces = settings.m_LightBounces;
+        Scene::FramePasses = settings.m_FramePasses;
+        Scene::Blur = settings.m_Blur;
+        Scene::BloomRadius = settings.m_BloomRadius;
+        Scene::BloomIntensity = settings.m_BloomIntensity;
+        Scene::SkyboxStrength = settings.m_SkyboxStrength;
+        Scene::SkyboxGamma = settings.m_SkyboxGamma;
+        Scene::SkyboxCeiling = settings.m_SkyboxCeiling;
+        Scene::PlaneVisible = settings.m_PlaneVisible != 0;
+    }
+
+    bool ValidSettings(const Settings& settings)
+    {
+        return settings.m_ShadowResolution > 0 && settings.m_LightBounces >= 0 && settings.m_FramePasses > 0;
+    }
+
+    // Objects the shaders can't index out of bounds with
+    bool ValidObjects(const Scene::Object* objects, const size_t count, const size_t materialCount)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            if (objects[i].m_Type > 2 || objects[i].m_MaterialIndex >= materialCount) return false;
+        }
+        return true;
+    }
+
+    // Hands the loaded scene to the renderer: everything is re-uploaded and the BVH rebuilt on the next FlushChanges
+    void MarkLoaded()
+    {
+        Scene::SelectObject(-1);
+        Scene::MarkObjectsAdded();
+        Scene::MarkSettingsDirty();
+    }
+
+    uint64_t AlignArray(const uint64_t offset)
+    {
+        return (offset + ArrayAlignment - 1) / ArrayAlignment * ArrayAlignment;
+    }
+
+    bool Save(const char* filepath)
+    {
+        Header header{};
+        std::memcpy(header.m_Magic, Magic, sizeof(Magic));
+        header.m_Version = Version;
+        header.m_HeaderSize = sizeof(Header);
+        header.m_ObjectCount = Scene::Objects.size();
+        header.m_MaterialCount = Scene::Materials.size();
+        header.m_LightCount = Scene::Lights.size();
+        header.m_ObjectOffset = AlignArray(sizeof(Header));
+        header.m_MaterialOffset = AlignArray(header.m_ObjectOffset + header.m_ObjectCount * sizeof(Scene::Object));
+        header.m_LightOffset = AlignArray(header.m_MaterialOffset +
+            header.m_MaterialCount * sizeof(Scene::Material));
+        header.m_Settings = CurrentSettings();
+        const uint64_t size = header.m_LightOffset + header.m_LightCount * sizeof(Scene::PointLight);
+
+        MappedFile::Mapping file;
+        if (!MappedFile::Create(filepath, static_cast<size_t>(size), file)) return false;
+
+        auto* data = static_cast<unsigned char*>(file.m_Data);
+        std::memset(data, 0, static_cast<size_t>(header.m_ObjectOffset));
+        std::memcpy(data, &header, sizeof(Header));
+        std::memcpy(data + header.m_ObjectOffset, Scene::Objects.data(), Scene::Objects.size() * sizeof(Scene::Object));
+
+        // The padding of materials and lights is never initialized, so it is zeroed to keep files reproducible
+        auto* materials = reinterpret_cast<Scene::Material*>(data + header.m_MaterialOffset);
+        for (size_t i = 0; i < Scene::Materials.size(); i++)
+        {
+            materials[i] = Scene::Materials[i];
+            std::memset(materials[i].m_Padding, 0, sizeof(materials[i].m_Padding));
+        }
+        auto* lights = reinterpret_cast<Scene::PointLight*>(data + header.m_LightOffset);
+        for (size_t i = 0; i < Scene::Lights.size(); i++)
+        {
+            lights[i] = Scene::Lights[i];
+            std::memset(lights[i].m_Padding, 0, sizeof(lights[i].m_Padding));
+        }
+
+        MappedFile::Close(file);
+        return true;
+    }
+
+    bool Load(const char* filepath)
+    {
+        MappedFile::Mapping file;
+        if (!MappedFile::Open(filepath, file)) return false;
+
+        Header header{};
+        const auto* data = static_cast<const unsigned char*>(file.m_Data);
+        if (file.m_Size >= sizeof(Header)) std::memcpy(&header, data, sizeof(Header));
+
+        // Every array has to lie within the file; counts are checked against the size before multiplying
+        const auto arrayFits = [&file](const uint64_t offset, const uint64_t count, const size_t elementSize)
+        {
+            return offset % ArrayAlignment == 0 && offset <= file.m_Size &&
+                count <= (file.m_Size - offset) / elementSize;
+        };
+        bool valid = !std::memcmp(header.m_Magic, Magic, sizeof(Magic)) && header.m_Version == Version &&
+            header.m_HeaderSize == sizeof(Header) &&
+            arrayFits(header.m_ObjectOffset, header.m_ObjectCount, sizeof(Scene::Object)) &&
+            arrayFits(header.m_MaterialOffset, header.m_MaterialCount, sizeof(Scene::Material)) &&
+            arrayFits(header.m_LightOffset, header.m_LightCount, sizeof(Scene::PointLight)) &&
+            ValidSettings(header.m_Settings);
+
+        const auto* objects = reinterpret_cast<const Scene::Object*>(data + header.m_ObjectOffset);
+        const auto* materials = reinterpret_cast<const Scene::Material*>(data + header.m_MaterialOffset);
+        const auto* lights = reinterpret_cast<const Scene::PointLight*>(data + header.m_LightOffset);
+        valid = valid && ValidObjects(objects, header.m_ObjectCount, header.m_MaterialCount);
+
+        if (valid)
+        {
+            // The arrays are copied as they are, no per-element parsing
+            Scene::Objects.assign(objects, objects + header.m_ObjectCount);
+            Scene::Materials.assign(materials, materials + header.m_MaterialCount);
+            Scene::Lights.assign(lights, lights + header.m_LightCount);
+            ApplySettings(header.m_Settings);
+            MarkLoaded();
+        }
+
+        MappedFile::Close(file);
+        return valid;
+    }
+
+    // Text form. Floats are written with enough digits to read back exactly.
+
+    void WriteFloats(std::ostream& stream, const float* values, const int count)
+    {
+        for (int i = 0; i < count; i++) stream << ' ' << values[i];
+    }
+
+    void WriteMaterial(std::ostream& stream, const char* record, const Scene::Material& material)
+    {
+        stream << record;
+        WriteFloats(stream, material.m_Albedo, 3);
+        WriteFloats(stream, &material.m_Roughness, 1);
+        WriteFloats(stream, material.m_Specular, 3);
+        WriteFloats(stream, &material.m_SpecularHighlight, 1);
+        WriteFloats(stream, material.m_Emission, 3);
+        WriteFloats(stream, &material.m_EmissionStrength, 1);
+        WriteFloats(stream, &material.m_SpecularExponent, 1);
+        stream << '\n';
+    }
+
+    bool SaveText(const char* filepath)
+    {
+        std::ofstream stream(filepath);
+        if (!stream) return false;
+        stream << std::setprecision(9);
+
+        const Settings settings = CurrentSettings();
+        stream << "# Scene, version " << Version << ". Records: camera x y z yaw pitch | setting name value |\n"
+            "# material r g b roughness sr sg sb specularHighlight er eg eb emissionStrength specularExponent |\n"
+            "# plane_material (as material) | object type x y z sx sy sz materialIndex |\n"
+            "# light x y z radius r g b power reach\n";
+        stream << "version " << Version << '\n';
+        stream << "camera";
+        WriteFloats(stream, settings.m_CameraPosition, 3);
+        stream << ' ' << settings.m_CameraYaw << ' ' << settings.m_CameraPitch << '\n';
+        stream << "setting shadow_resolution " << settings.m_ShadowResolution << '\n'
+            << "setting light_bounces " << settings.m_LightBounces << '\n'
+            << "setting frame_passes " << settings.m_FramePasses << '\n'
+            << "setting blur " << settings.m_Blur << '\n'
+            << "setting bloom_radius " << settings.m_BloomRadius << '\n'
+            << "setting bloom_intensity " << settings.m_BloomIntensity << '\n'
+            << "setting skybox_strength " << settings.m_SkyboxStrength << '\n'
+            << "setting skybox_gamma " << settings.m_SkyboxGamma << '\n'
+            << "setting skybox_ceiling " << settings.m_SkyboxCeiling << '\n'
+            << "setting plane_visible " << settings.m_PlaneVisible << '\n';
+        WriteMaterial(stream, "plane_material", settings.m_PlaneMaterial);
+
+        for (const Scene::Material& material : Scene::Materials) WriteMaterial(stream, "material", material);
+        for (const Scene::Object& object : Scene::Objects)
+        {
+            stream << "object " << object.m_Type;
+            WriteFloats(stream, object.m_Position, 3);
+            WriteFloats(stream, object.m_Scale, 3);
+            stream << ' ' << object.m_MaterialIndex << '\n';
+        }
+        for (const Scene::PointLight& light : Scene::Lights)
+        {
+            stream << "light";
+            WriteFloats(stream, light.m_Position, 3);
+            WriteFloats(stream, &light.m_Radius, 1);
+            WriteFloats(stream, light.m_Color, 3);
+            WriteFloats(stream, &light.m_Power, 1);
+            WriteFloats(stream, &light.m_Reach, 1);
+            stream << '\n';
+        }
+
+        return static_cast<bool>(stream);
+    }
+
+    bool ReadFloats(std::istream& stream, float* values, const int count)
+    {
+        for (int i = 0; i < count; i++) stream >> values[i];
+        return static_cast<bool>(stream);
+    }
+
+    bool ReadMaterial(std::istream& stream, Scene::Material& material)
+    {
+        material = Scene::Material();
+        std::memset(material.m_Padding, 0, sizeof(material.m_Padding));
+        return ReadFloats(stream, material.m_Albedo, 3) && ReadFloats(stream, &material.m_Roughness, 1) &&
+            ReadFloats(stream, material.m_Specular, 3) && ReadFloats(stream, &material.m_SpecularHighlight, 1) &&
+            ReadFloats(stream, material.m_Emission, 3) && ReadFloats(stream, &material.m_EmissionStrength, 1) &&
+            ReadFloats(stream, &material.m_SpecularExponent, 1);
+    }
+
+    bool ReadSetting(std::istream& stream, Settings& settings)
+    {
+        std::string name;
+        stream >> name;
+        if (name == "shadow_resolution") stream >> settings.m_ShadowResolution;
+        else if (name == "light_bounces") stream >> settings.m_LightBounces;
+        else if (name == "frame_passes") stream >> settings.m_FramePasses;
+        else if (name == "blur") stream >> settings.m_Blur;
+        else if (name == "bloom_radius") stream >> settings.m_BloomRadius;
+        else if (name == "bloom_intensity") stream >> settings.m_BloomIntensity;
+        else if (name == "skybox_strength") stream >> settings.m_SkyboxStrength;
+        else if (name == "skybox_gamma") stream >> settings.m_SkyboxGamma;
+        else if (name == "skybox_ceiling") stream >> settings.m_SkyboxCeiling;
+        else if (name == "plane_visible") stream >> settings.m_PlaneVisible;
+        else return false;
+        return static_cast<bool>(stream);
+    }
+
+    bool LoadText(const char* filepath)
+    {
+        std::ifstream file(filepath);
+        if (!file) return false;
+
+        // Records missing from the file keep the current values
+        Settings settings = CurrentSettings();
+        std::vector<Scene::Object> objects;
+        std::vector<Scene::Material> materials;
+        std::vector<Scene::PointLight> lights;
+
+        std::string line;
+        bool versionRead = false;
+        while (std::getline(file, line))
+        {
+            std::istringstream stream(line);
+            std::string record;
+            if (!(stream >> record) || record[0] == '#') continue;
+
+            bool valid;
+            if (record == "version")
+            {
+                uint32_t version = 0;
+                valid = static_cast<bool>(stream >> version) && version == Version;
+                versionRead = true;
+            }
+            else if (record == "camera")
+            {
+                valid = ReadFloats(stream, settings.m_CameraPosition, 3) &&
+                    ReadFloats(stream, &settings.m_CameraYaw, 1) && ReadFloats(stream, &settings.m_CameraPitch, 1);
+            }
+            else if (record == "setting")
+            {
+                valid = ReadSetting(stream, settings);
+            }
+            else if (record == "plane_material")
+            {
+                valid = ReadMaterial(stream, settings.m_PlaneMaterial);
+            }
+            else if (record == "material")
+            {
+                materials.emplace_back();
+                valid = ReadMaterial(stream, materials.back());
+            }
+            else if (record == "object")
+            {
+                Scene::Object& object = objects.emplace_back();
+                valid = static_cast<bool>(stream >> object.m_Type) && ReadFloats(stream, object.m_Position, 3) &&
+                    ReadFloats(stream, object.m_Scale, 3) && static_cast<bool>(stream >> object.m_MaterialIndex);
+            }
+            else if (record == "light")
+            {
+                Scene::PointLight& light = lights.emplace_back();
+                std::memset(light.m_Padding, 0, sizeof(light.m_Padding));
+                valid = ReadFloats(stream, light.m_Position, 3) && ReadFloats(stream, &light.m_Radius, 1) &&
+                    ReadFloats(stream, light.m_Color, 3) && ReadFloats(stream, &light.m_Power, 1) &&
+                    ReadFloats(stream, &light.m_Reach, 1);
+            }
+            else
+            {
+                valid = false;
+            }
+
+            if (!valid) return false;
+        }
+
+        if (!versionRead || !ValidSettings(settings) ||
+            !ValidObjects(objects.data(), objects.size(), materials.size()))
+            return false;
+
+        Scene::Objects = std::move(objects);
+        Scene::Materials = std::move(materials);
+        Scene::Lights = std::move(lights);
+        ApplySettings(settings);
+        MarkLoaded();
+        return true;
+    }
+
+    bool IsTextPath(const char* filepath)
+    {
+        const size_t length = std::strlen(filepath);
+        return length >= 4 && !std::strcmp(filepath + length - 4, ".txt");
+    }
+
+    bool SaveAny(const char* filepath)
+    {
+        return IsTextPath(filepath) ? SaveText(filepath) : Save(filepath);
+    }
+
+    bool LoadAny(const char* filepath)
+    {
+        return IsTextPath(filepath) ? LoadText(filepath) : Load(filepath);
+    }
+}
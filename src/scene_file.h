@@ -0,0 +1,20 @@
+#pragma once
+
+// Scenes on disk: objects, materials, lights, the plane material, the render settings and the camera.
+// The binary form stores Objects, Materials and Lights as the flat std430 arrays they are in memory and in the scene
+// storage buffer, so loading is one copy per array out of a memory mapping and startup time is bounded by paging the
+// file in. The text form holds the same contents one record per line, for diffs and editing by hand.
+namespace SceneFile
+{
+    // Both return false (and leave the scene untouched when loading) if the file can't be written or read, or if it
+    // isn't a valid scene.
+    bool Save(const char* filepath);
+    bool Load(const char* filepath);
+
+    bool SaveText(const char* filepath);
+    bool LoadText(const char* filepath);
+
+    // Picks the text form for paths ending in .txt and the binary form otherwise
+    bool SaveAny(const char* filepath);
+    bool LoadAny(const char* filepath);
+}
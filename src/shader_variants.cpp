@@ -0,0 +1,303 @@
+#include "shader_variants.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "renderer.h"
+#include "scene.h"
+
+namespace ShaderVariants
+{
+    bool Enabled = true;
+
+    struct Variant
+    {
+        std::string m_Defines;
+        GLuint m_Program;
+        uint64_t m_LastUsed;
+    };
+
+    // Either a variant or, with m_Reload, the generic fragment and G-buffer programs rebuilt from changed sources
+    struct Job
+    {
+        std::string m_Defines;
+        bool m_Reload;
+        // Generation the job was queued in. Variants of an older one were compiled from or for replaced sources.
+        uint64_t m_Generation;
+    };
+
+    // Compiled on the background context. The fence tells when the programs can be used on the main one.
+    struct FinishedCompile
+    {
+        Job m_Job;
+        GLuint m_Program; // 0 if it didn't compile
+        GLuint m_GBufferProgram; // Only for reloads
+        GLsync m_Fence;
+    };
+
+    std::vector<Variant> Cache;
+    uint64_t UseCounter = 0;
+    // Defines of the variants queued and of those that failed to compile, so neither is queued again. Compiled variants
+    // leave it once they are in Cache, so an evicted one is compiled again when the scene goes back to it.
+    std::set<std::string> Requested;
+    std::string Wanted;
+    // Bumped whenever reloaded sources replace the generic program
+    uint64_t Generation = 0;
+
+    GLFWwindow* CompilerWindow = nullptr;
+    std::thread CompilerThread;
+    std::mutex QueueMutex;
+    std::condition_variable QueueChanged;
+    std::deque<Job> Queue; // Guarded by QueueMutex
+    std::vector<FinishedCompile> Finished; // Guarded by QueueMutex
+    std::vector<FinishedCompile> Fenced; // Finished, waiting for their fence on the main thread
+    bool Stopping = false; // Guarded by QueueMutex
+
+    std::string SceneDefines()
+    {
+        bool spheres = false, boxes = false;
+        for (const Scene::Object& object : Scene::Objects)
+        {
+            spheres |= object.m_Type == 1;
+            boxes |= object.m_Type == 2;
+            if (spheres && boxes) break;
+        }
+
+        std::string defines = "#define SPECIALIZED\n";
+        defines.append("#define OBJECT_COUNT ").append(std::to_string(Scene::Objects.size())).append("\n");
+        defines.append("#define LIGHT_COUNT ").append(std::to_string(Scene::Lights.size())).append("\n");
+        defines.append("#define LIGHT_BOUNCES ").append(std::to_string(Scene::LightBounces)).append("\n");
+        defines.append("#define PLANE_VISIBLE ").append(Scene::PlaneVisible ? "true" : "false").append("\n");
+        defines.append("#define SKYBOX_VISIBLE ").append(Scene::SkyboxStrength != 0.0f ? "true" : "false").append("\n");
+        defines.append("#define HAS_SPHERES ").append(spheres ? "true" : "false").append("\n");
+        defines.append("#define HAS_BOXES ").append(boxes ? "true" : "false").append("\n");
+        return defines;
+    }
+
+    // Returns 0 if the variant doesn't compile or link
+    GLuint Compile(const std::string& defines)
+    {
+        return Renderer::CreateShaderProgram("shaders\\vertex.glsl", "shaders\\fragment.glsl", defines.c_str());
+    }
+
+    void CompilerLoop()
+    {
+        glfwMakeContextCurrent(CompilerWindow);
+        while (true)
+        {
+            std::unique_lock lock(QueueMutex);
+            QueueChanged.wait(lock, [] { return Stopping || !Queue.empty(); });
+            if (Stopping) break;
+            const Job job = std::move(Queue.front());
+            Queue.pop_front();
+            lock.unlock();
+
+            GLuint program = 0, gBufferProgram = 0;
+            if (job.m_Reload)
+            {
+                program = Renderer::CreateShaderProgram("shaders\\vertex.glsl", "shaders\\fragment.glsl");
+                gBufferProgram = Renderer::CreateShaderProgram("shaders\\vertex.glsl", "shaders\\gbuffer.glsl");
+            }
+            else
+            {
+                program = Compile(job.m_Defines);
+            }
+            // Commands of this context only become visible to the main one once they have completed
+            const GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+
+            lock.lock();
+            Finished.push_back({job, program, gBufferProgram, fence});
+        }
+        glfwMakeContextCurrent(nullptr);
+    }
+
+    bool StartCompiler(GLFWwindow* window)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        CompilerWindow = glfwCreateWindow(1, 1, "Shader compiler", nullptr, window);
+        glfwDefaultWindowHints();
+        if (!CompilerWindow) return false;
+
+        Stopping = false;
+        CompilerThread = std::thread(CompilerLoop);
+        return true;
+    }
+
+    Variant* Find(const std::string& defines)
+    {
+        for (Variant& variant : Cache)
+        {
+            if (variant.m_Defines == defines) return &variant;
+        }
+        return nullptr;
+    }
+
+    void Add(const std::string& defines, const GLuint program)
+    {
+        if (Cache.size() >= MaxCachedVariants)
+        {
+            // The program in use can't be the oldest: using a variant makes it the most recent
+            size_t oldest = 0;
+            for (size_t i = 1; i < Cache.size(); i++)
+            {
+                if (Cache[i].m_LastUsed < Cache[oldest].m_LastUsed) oldest = i;
+            }
+            glDeleteProgram(Cache[oldest].m_Program);
+            Cache.erase(Cache.begin() + static_cast<std::ptrdiff_t>(oldest));
+        }
+        Cache.push_back({defines, program, 0});
+        Requested.erase(defines);
+    }
+
+    // Switches to the variant in Wanted if it is compiled, otherwise to the generic program
+    void UseWanted()
+    {
+        Variant* variant = Enabled ? Find(Wanted) : nullptr;
+        const GLuint program = variant ? variant->m_Program : Renderer::GenericProgram;
+        if (variant) variant->m_LastUsed = ++UseCounter;
+        if (Renderer::ShaderProgram != program) Renderer::SetShaderProgram(program);
+    }
+
+    void Update()
+    {
+        Wanted = Enabled ? SceneDefines() : std::string();
+        if (Enabled && !Find(Wanted) && Requested.insert(Wanted).second)
+        {
+            if (CompilerWindow)
+            {
+                std::lock_guard lock(QueueMutex);
+                Queue.push_back({Wanted, false, Generation});
+                QueueChanged.notify_one();
+            }
+            else if (const GLuint program = Compile(Wanted))
+            {
+                Add(Wanted, program);
+            }
+        }
+        UseWanted();
+    }
+
+    // Deletes every variant and forgets the failed ones, e.g. because they belong to sources that were replaced
+    void ClearVariants()
+    {
+        for (const Variant& variant : Cache) glDeleteProgram(variant.m_Program);
+        Cache.clear();
+        Requested.clear();
+    }
+
+    void Reload()
+    {
+        if (CompilerWindow)
+        {
+            std::lock_guard lock(QueueMutex);
+            Queue.push_back({std::string(), true, Generation});
+            QueueChanged.notify_one();
+        }
+        else if (Renderer::RecompileShader())
+        {
+            Generation++;
+            ClearVariants();
+            Update();
+        }
+        else
+        {
+            std::cout << "The changed shaders failed to compile, keeping the previous ones\n";
+        }
+    }
+
+    bool Poll()
+    {
+        if (!CompilerWindow) return false;
+        {
+            std::lock_guard lock(QueueMutex);
+            Fenced.insert(Fenced.end(), Finished.begin(), Finished.end());
+            Finished.clear();
+        }
+
+        bool adopted = false, reloaded = false;
+        for (size_t i = 0; i < Fenced.size();)
+        {
+            const FinishedCompile& compile = Fenced[i];
+            if (glClientWaitSync(compile.m_Fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                i++;
+                continue;
+            }
+
+            glDeleteSync(compile.m_Fence);
+            if (compile.m_Job.m_Reload)
+            {
+                if (compile.m_Program && compile.m_GBufferProgram)
+                {
+                    Renderer::ReplaceShaderPrograms(compile.m_Program, compile.m_GBufferProgram);
+                    Generation++;
+                    ClearVariants();
+                    reloaded = true;
+                }
+                else
+                {
+                    glDeleteProgram(compile.m_Program);
+                    glDeleteProgram(compile.m_GBufferProgram);
+                    std::cout << "The changed shaders failed to compile, keeping the previous ones\n";
+                }
+            }
+            else if (compile.m_Job.m_Generation != Generation)
+            {
+                glDeleteProgram(compile.m_Program);
+            }
+            else if (compile.m_Program)
+            {
+                Add(compile.m_Job.m_Defines, compile.m_Program);
+                adopted = true;
+            }
+            else
+            {
+                std::cout << "A scene-specialized shader failed to compile, staying on the generic one\n";
+            }
+            Fenced.erase(Fenced.begin() + static_cast<std::ptrdiff_t>(i));
+        }
+
+        // Queues the variant for the new sources and stays on the generic program until it is ready
+        if (reloaded) Update();
+        // The same image either way, so the accumulation continues with the new program
+        else if (adopted) UseWanted();
+        return reloaded;
+    }
+
+    void Delete()
+    {
+        if (CompilerWindow)
+        {
+            {
+                std::lock_guard lock(QueueMutex);
+                Stopping = true;
+                QueueChanged.notify_one();
+            }
+            CompilerThread.join();
+            glfwDestroyWindow(CompilerWindow);
+            CompilerWindow = nullptr;
+
+            Fenced.insert(Fenced.end(), Finished.begin(), Finished.end());
+            Finished.clear();
+            Queue.clear();
+        }
+
+        for (const FinishedCompile& compile : Fenced)
+        {
+            glDeleteSync(compile.m_Fence);
+            glDeleteProgram(compile.m_Program);
+            glDeleteProgram(compile.m_GBufferProgram);
+        }
+        Fenced.clear();
+
+        if (Renderer::ShaderProgram != Renderer::GenericProgram) Renderer::SetShaderProgram(Renderer::GenericProgram);
+        ClearVariants();
+    }
+}
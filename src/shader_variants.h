@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// Builds of fragment.glsl specialized for the scene being rendered. SceneDefines turns what the scene uses (primitive
+// types, the plane, the skybox, object and light counts, the bounce count) into #defines that replace the uniforms
+// fragment.glsl otherwise branches and loops on, so the compiler can drop dead branches and unroll the bounce loop.
+// Variants are compiled on a background context and kept in a small cache; Renderer::GenericProgram is used until the
+// variant for the current scene is ready. The same context rebuilds the generic program when the shaders are edited.
+namespace ShaderVariants
+{
+    // Compiled variants kept at most; the least recently used one is deleted first
+    constexpr size_t MaxCachedVariants = 8;
+
+    extern bool Enabled;
+
+    std::string SceneDefines();
+
+    // Creates a hidden window sharing objects with window and starts compiling variants on it in the background.
+    // Without it, Update compiles a missing variant right away.
+    bool StartCompiler(GLFWwindow* window);
+
+    // Switches to the variant for the current scene (or the generic program, if it isn't compiled yet) and queues its
+    // compile. Called whenever the scene or its settings changed.
+    void Update();
+    // Rebuilds Renderer::GenericProgram and Renderer::GBufferProgram from the shader files (in the background, once the
+    // compiler runs) and switches to them only if both link. Called when the sources changed, see ShaderWatcher.
+    void Reload();
+    // Adopts the variants and reloaded programs finished in the background. Called once per frame. Returns true if the
+    // generic program was replaced, which may change the image.
+    bool Poll();
+    // Stops the compiler and deletes all variants. Renderer::GenericProgram is left to the caller.
+    void Delete();
+}
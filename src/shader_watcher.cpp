@@ -0,0 +1,45 @@
+#include "shader_watcher.h"
+
+#include <filesystem>
+#include <string>
+
+#include "hash.h"
+
+namespace ShaderWatcher
+{
+    constexpr const char* Directory = "shaders";
+
+    uint64_t Fingerprint = 0;
+    double LastCheck = 0.0;
+
+    // Sum of the hashes of every file's name and modification time, so the order the directory lists them in doesn't
+    // matter. Editors often save by replacing the file, which this sees as well.
+    uint64_t DirectoryFingerprint()
+    {
+        uint64_t fingerprint = 0;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(Directory, error))
+        {
+            const std::string name = entry.path().filename().string();
+            const auto writeTime = entry.last_write_time(error).time_since_epoch().count();
+            fingerprint += Hash::Value(writeTime, Hash::Bytes(name.data(), name.size()));
+        }
+        return fingerprint;
+    }
+
+    void Start()
+    {
+        Fingerprint = DirectoryFingerprint();
+    }
+
+    bool Changed(const double time)
+    {
+        if (time - LastCheck < Interval) return false;
+        LastCheck = time;
+
+        const uint64_t fingerprint = DirectoryFingerprint();
+        if (fingerprint == Fingerprint) return false;
+        Fingerprint = fingerprint;
+        return true;
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+// Notices edits to the files in the shaders directory by polling their modification times, so they can be recompiled
+// while the program runs (see ShaderVariants::Reload).
+namespace ShaderWatcher
+{
+    // Seconds between two looks at the directory
+    constexpr double Interval = 0.5;
+
+    // Remembers the current state of the directory. Called once the shaders have been compiled.
+    void Start();
+    // Returns true if a shader file was changed, added or removed since Start or the last call that returned true. time
+    // is glfwGetTime(); the directory is only read every Interval seconds.
+    bool Changed(double time);
+}
@@ -0,0 +1,332 @@
+#include "skybox_loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <utility>
+#include <GL/glew.h>
+#include <glm/gtc/packing.hpp>
+
+#include "environment.h"
+#include "hash.h"
+#include "mapped_file.h"
+#include "renderer.h"
+#include "scene.h"
+#include "stb_image.h"
+
+namespace SkyboxLoader
+{
+    constexpr char Magic[8] = {'R', 'T', 'S', 'K', 'Y', 'B', 'X', '\0'};
+    constexpr uint32_t Version = 2;
+    // Levels start on page boundaries, so copies out of the file into a pixel buffer stay aligned
+    constexpr uint64_t LevelAlignment = 4096;
+    // Largest finite half float. Images with brighter texels (e.g. the sun) are stored as full floats, since clamping
+    // them would take energy out of the sky and out of the Environment distribution built from it.
+    constexpr float HalfMax = 65504.0f;
+
+    // Followed by the levels at m_LevelOffsets, RGBA16F or RGBA32F rows bottom to top like the decoded image
+    struct CacheHeader
+    {
+        char m_Magic[8];
+        uint32_t m_Version;
+        int32_t m_Levels;
+        int32_t m_Width, m_Height;
+        int32_t m_ChannelSize;
+        int32_t m_Reserved;
+        // The cache is rebuilt when the image it was made from changes
+        uint64_t m_SourceSize;
+        int64_t m_SourceTime;
+        uint64_t m_Hash;
+        uint64_t m_LevelOffsets[MaxLevels];
+    };
+
+    static_assert(sizeof(CacheHeader) == 184, "SkyboxLoader::CacheHeader must not contain padding");
+
+    std::future<bool> PendingLoad;
+    Image PendingImage;
+    std::string PendingPath;
+    std::string QueuedPath; // Requested while PendingLoad was running
+
+    std::string CachePath(const std::string& filepath)
+    {
+        return filepath + ".cache";
+    }
+
+    bool SourceStamp(const std::string& filepath, uint64_t& size, int64_t& time)
+    {
+        std::error_code error;
+        size = std::filesystem::file_size(filepath, error);
+        if (error) return false;
+        time = std::filesystem::last_write_time(filepath, error).time_since_epoch().count();
+        return !error;
+    }
+
+    size_t LevelSize(const Image& image, const int width, const int height)
+    {
+        return static_cast<size_t>(width) * height * 4 * image.m_ChannelSize;
+    }
+
+    int LevelWidth(const Image& image, const int level)
+    {
+        return std::max(1, image.m_Width >> level);
+    }
+
+    int LevelHeight(const Image& image, const int level)
+    {
+        return std::max(1, image.m_Height >> level);
+    }
+
+    bool ReadCache(const std::string& filepath, const uint64_t sourceSize, const int64_t sourceTime, Image& image)
+    {
+        MappedFile::Mapping file;
+        if (!MappedFile::Open(CachePath(filepath).c_str(), file)) return false;
+
+        CacheHeader header{};
+        if (file.m_Size >= sizeof(CacheHeader)) std::memcpy(&header, file.m_Data, sizeof(CacheHeader));
+        bool valid = !std::memcmp(header.m_Magic, Magic, sizeof(Magic)) && header.m_Version == Version &&
+            header.m_SourceSize == sourceSize && header.m_SourceTime == sourceTime && header.m_Width > 0 &&
+            header.m_Height > 0 && header.m_Levels > 0 && header.m_Levels <= MaxLevels &&
+            (header.m_ChannelSize == sizeof(uint16_t) || header.m_ChannelSize == sizeof(float));
+
+        image.m_Width = header.m_Width;
+        image.m_Height = header.m_Height;
+        image.m_Levels = header.m_Levels;
+        image.m_ChannelSize = header.m_ChannelSize;
+        image.m_Hash = header.m_Hash;
+        for (int level = 0; valid && level < image.m_Levels; level++)
+        {
+            const uint64_t offset = header.m_LevelOffsets[level];
+            image.m_LevelOffsets[level] = offset;
+            valid = offset <= file.m_Size &&
+                LevelSize(image, LevelWidth(image, level), LevelHeight(image, level)) <= file.m_Size - offset;
+        }
+
+        // Reading the file here means it is paged in on the loading thread, not while the render thread uploads it
+        if (valid)
+        {
+            const auto* data = static_cast<const unsigned char*>(file.m_Data);
+            image.m_Data.assign(data, data + file.m_Size);
+        }
+        MappedFile::Close(file);
+        return valid;
+    }
+
+    // Not fatal if it fails, the image is just decoded again next time
+    void WriteCache(const std::string& filepath, const Image& image)
+    {
+        const std::string cachePath = CachePath(filepath);
+        const std::string tempPath = cachePath + ".part";
+        MappedFile::Mapping file;
+        if (!MappedFile::Create(tempPath.c_str(), image.m_Data.size(), file)) return;
+        std::memcpy(file.m_Data, image.m_Data.data(), image.m_Data.size());
+        MappedFile::Close(file);
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, cachePath, error);
+    }
+
+    // Halves an RGB image with a 2x2 box filter. An odd last row or column is dropped; a side of 1 stays 1.
+    std::vector<float> Downsample(const std::vector<float>& rgb, const int width, const int height)
+    {
+        const int newWidth = std::max(1, width / 2), newHeight = std::max(1, height / 2);
+        std::vector<float> result(static_cast<size_t>(newWidth) * newHeight * 3);
+        for (int y = 0; y < newHeight; y++)
+        {
+            const int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+            for (int x = 0; x < newWidth; x++)
+            {
+                const int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                for (int c = 0; c < 3; c++)
+                {
+                    const float sum = rgb[(static_cast<size_t>(y0) * width + x0) * 3 + c] +
+                        rgb[(static_cast<size_t>(y0) * width + x1) * 3 + c] +
+                        rgb[(static_cast<size_t>(y1) * width + x0) * 3 + c] +
+                        rgb[(static_cast<size_t>(y1) * width + x1) * 3 + c];
+                    result[(static_cast<size_t>(y) * newWidth + x) * 3 + c] = sum * 0.25f;
+                }
+            }
+        }
+        return result;
+    }
+
+    void PackLevel(const Image& image, const std::vector<float>& rgb, const size_t pixels, unsigned char* destination)
+    {
+        if (image.m_ChannelSize == sizeof(float))
+        {
+            auto* rgba = reinterpret_cast<float*>(destination);
+            for (size_t i = 0; i < pixels; i++)
+            {
+                for (int c = 0; c < 3; c++) rgba[i * 4 + c] = rgb[i * 3 + c];
+                rgba[i * 4 + 3] = 1.0f;
+            }
+            return;
+        }
+
+        auto* rgba = reinterpret_cast<uint16_t*>(destination);
+        const uint16_t one = glm::packHalf1x16(1.0f);
+        for (size_t i = 0; i < pixels; i++)
+        {
+            for (int c = 0; c < 3; c++) rgba[i * 4 + c] = glm::packHalf1x16(rgb[i * 3 + c]);
+            rgba[i * 4 + 3] = one;
+        }
+    }
+
+    bool Decode(const std::string& filepath, const uint64_t sourceSize, const int64_t sourceTime, Image& image)
+    {
+        int width, height, channels;
+        float* data = stbi_loadf(filepath.c_str(), &width, &height, &channels, 3);
+        if (!data) return false;
+
+        image.m_Width = width;
+        image.m_Height = height;
+        // Same fingerprint Renderer::UploadSkybox computes, so checkpoints match either way of loading an image
+        image.m_Hash = Hash::Value(height, Hash::Value(width));
+        image.m_Hash = Hash::Bytes(data, static_cast<size_t>(width) * height * 3 * sizeof(float), image.m_Hash);
+        // Downsampling only averages, so no level is brighter than the image itself
+        float* end = data + static_cast<size_t>(width) * height * 3;
+        image.m_ChannelSize = *std::max_element(data, end) > HalfMax ? sizeof(float) : sizeof(uint16_t);
+
+        // Down to 1x1
+        image.m_Levels = 1;
+        while (image.m_Levels < MaxLevels && (LevelWidth(image, image.m_Levels - 1) > 1 ||
+            LevelHeight(image, image.m_Levels - 1) > 1))
+            image.m_Levels++;
+
+        uint64_t size = sizeof(CacheHeader);
+        for (int level = 0; level < image.m_Levels; level++)
+        {
+            size = (size + LevelAlignment - 1) / LevelAlignment * LevelAlignment;
+            image.m_LevelOffsets[level] = size;
+            size += LevelSize(image, LevelWidth(image, level), LevelHeight(image, level));
+        }
+        image.m_Data.assign(size, 0);
+
+        std::vector<float> rgb(data, end);
+        stbi_image_free(data);
+        for (int level = 0; level < image.m_Levels; level++)
+        {
+            const int levelWidth = LevelWidth(image, level), levelHeight = LevelHeight(image, level);
+            if (level > 0) rgb = Downsample(rgb, LevelWidth(image, level - 1), LevelHeight(image, level - 1));
+            PackLevel(image, rgb, static_cast<size_t>(levelWidth) * levelHeight,
+                      image.m_Data.data() + image.m_LevelOffsets[level]);
+        }
+
+        CacheHeader header{};
+        std::memcpy(header.m_Magic, Magic, sizeof(Magic));
+        header.m_Version = Version;
+        header.m_Levels = image.m_Levels;
+        header.m_Width = image.m_Width;
+        header.m_Height = image.m_Height;
+        header.m_ChannelSize = image.m_ChannelSize;
+        header.m_SourceSize = sourceSize;
+        header.m_SourceTime = sourceTime;
+        header.m_Hash = image.m_Hash;
+        std::memcpy(header.m_LevelOffsets, image.m_LevelOffsets, sizeof(header.m_LevelOffsets));
+        std::memcpy(image.m_Data.data(), &header, sizeof(CacheHeader));
+        return true;
+    }
+
+    bool Load(const std::string& filepath, Image& image)
+    {
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        if (!SourceStamp(filepath, sourceSize, sourceTime)) return false;
+        if (ReadCache(filepath, sourceSize, sourceTime, image)) return true;
+
+        image = Image();
+        if (!Decode(filepath, sourceSize, sourceTime, image)) return false;
+        WriteCache(filepath, image);
+        return true;
+    }
+
+    void Upload(const Image& image)
+    {
+        // The whole cache file goes into one unpack buffer; every level is then specified from its offset in there
+        GLuint unpackBuffer;
+        glGenBuffers(1, &unpackBuffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(image.m_Data.size()), image.m_Data.data(),
+                     GL_STREAM_DRAW);
+
+        if (!Scene::SkyboxTexture) glGenTextures(1, &Scene::SkyboxTexture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, Scene::SkyboxTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        const bool full = image.m_ChannelSize == sizeof(float);
+        for (int level = 0; level < image.m_Levels; level++)
+        {
+            glTexImage2D(GL_TEXTURE_2D, level, full ? GL_RGBA32F : GL_RGBA16F, LevelWidth(image, level),
+                         LevelHeight(image, level), 0, GL_RGBA, full ? GL_FLOAT : GL_HALF_FLOAT,
+                         reinterpret_cast<const void*>(image.m_LevelOffsets[level]));
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.m_Levels - 1);
+        // Sky lookups after a bounce have no meaningful derivatives, so the shaders keep sampling level 0
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glActiveTexture(GL_TEXTURE0);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &unpackBuffer);
+
+        Renderer::SkyboxHash = image.m_Hash;
+
+        // The sampling distribution is built from the first level that is small enough
+        int level = 0;
+        while (level < image.m_Levels - 1 && LevelWidth(image, level) > Environment::MaxWidth) level++;
+        const int width = LevelWidth(image, level), height = LevelHeight(image, level);
+        const unsigned char* levelData = image.m_Data.data() + image.m_LevelOffsets[level];
+        std::vector<float> rgb(static_cast<size_t>(width) * height * 3);
+        for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                rgb[i * 3 + c] = full ? reinterpret_cast<const float*>(levelData)[i * 4 + c]
+                                      : glm::unpackHalf1x16(reinterpret_cast<const uint16_t*>(levelData)[i * 4 + c]);
+            }
+        }
+        Environment::SetImage(std::move(rgb), width, height);
+    }
+
+    void Start(const std::string& filepath)
+    {
+        PendingImage = Image();
+        PendingPath = filepath;
+        PendingLoad = std::async(std::launch::async, [filepath] { return Load(filepath, PendingImage); });
+    }
+
+    void LoadAsync(const std::string& filepath)
+    {
+        // One load at a time. Waiting for the running one here would stall the frame, so the request is queued and
+        // started by Poll; a later request replaces it.
+        if (PendingLoad.valid()) QueuedPath = filepath;
+        else Start(filepath);
+    }
+
+    bool Poll()
+    {
+        if (!PendingLoad.valid() || PendingLoad.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return false;
+
+        const bool loaded = PendingLoad.get();
+        // The queued request supersedes the finished one
+        if (!QueuedPath.empty())
+        {
+            Start(QueuedPath);
+            QueuedPath.clear();
+            return false;
+        }
+
+        if (loaded) Upload(PendingImage);
+        else std::cout << "Failed to load " << PendingPath << '\n';
+        PendingImage = Image();
+        return loaded;
+    }
+
+    bool Pending()
+    {
+        return PendingLoad.valid();
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Loads HDR skyboxes off the render thread. The first load of an image decodes it with stb_image and writes a cache
+// next to it (<image>.cache) holding the ready-to-upload texture: an RGBA16F mip chain whose levels start on page
+// boundaries, so the whole file goes into one pixel unpack buffer as it is. Later loads only read that file back.
+// Images brighter than a half float can hold (e.g. an unclipped sun) are kept in RGBA32F instead.
+namespace SkyboxLoader
+{
+    constexpr int MaxLevels = 16;
+
+    struct Image
+    {
+        int m_Width = 0, m_Height = 0;
+        int m_Levels = 0;
+        int m_ChannelSize = 2; // Bytes per channel: 2 for RGBA16F, 4 for RGBA32F
+        uint64_t m_Hash = 0; // Of the decoded source, see Renderer::SkyboxHash
+        uint64_t m_LevelOffsets[MaxLevels] = {};
+        std::vector<unsigned char> m_Data; // The cache file, levels at m_LevelOffsets
+    };
+
+    // Reads the cache of filepath, or decodes filepath and writes the cache if that is missing or older than the
+    // image. Blocks; returns false if the image can't be decoded.
+    bool Load(const std::string& filepath, Image& image);
+    // Makes image the skybox texture (texture unit 1) and sets Renderer::SkyboxHash.
+    void Upload(const Image& image);
+
+    // Runs Load on a background thread. The current skybox stays bound until Poll uploads the new one. Never blocks:
+    // while a load is running, the latest request waits and replaces its result.
+    void LoadAsync(const std::string& filepath);
+    // Uploads the result of LoadAsync once it is ready. Called once per frame; returns true on the frame the skybox
+    // changed, i.e. when the accumulation has to restart.
+    bool Poll();
+    // True between LoadAsync and the Poll that finishes it, including any request queued meanwhile
+    bool Pending();
+}
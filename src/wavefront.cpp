@@ -0,0 +1,234 @@
+#include "wavefront.h"
+
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "adaptive.h"
+#include "blue_noise.h"
+#include "renderer.h"
+#include "scene.h"
+
+namespace Wavefront
+{
+    enum Stage
+    {
+        Generate,
+        Prepare,
+        Extend,
+        Shade,
+        Shadow,
+        Accumulate,
+        StageCount
+    };
+
+    constexpr const char* StageDefines[StageCount] = {
+        "#define STAGE_GENERATE\n", "#define STAGE_PREPARE\n", "#define STAGE_EXTEND\n", "#define STAGE_SHADE\n",
+        "#define STAGE_SHADOW\n", "#define STAGE_ACCUMULATE\n"
+    };
+
+    enum Uniform
+    {
+        PathCount,
+        Resolution,
+        AccumulatedPasses,
+        FirstSample,
+        Sample,
+        Bounce,
+        PrepareStage,
+        CameraPosition,
+        RotationMatrix,
+        AspectRatio,
+        SkyboxTexture,
+        BlueNoiseTexture,
+        AdaptiveSampling,
+        UniformCount
+    };
+
+    constexpr const char* UniformNames[UniformCount] = {
+        "u_pathCount", "u_resolution", "u_accumulatedPasses", "u_firstSample", "u_sample", "u_bounce",
+        "u_prepareStage", "u_cameraPosition", "u_rotationMatrix", "u_aspectRatio", "u_skyboxTexture",
+        "u_blueNoiseTexture", "u_adaptiveSampling"
+    };
+
+    // Matches the PREPARE_* defines in wavefront.glsl
+    enum PrepareTarget
+    {
+        PrepareExtend,
+        PrepareShade,
+        PrepareShadow,
+        PrepareGenerate
+    };
+
+    // Sizes of the std430 structs in wavefront.glsl
+    constexpr GLsizeiptr PathSize = 80;
+    constexpr GLsizeiptr ShadowRaySize = 48;
+    // RayQueues: four counters, then the extend, shade and shadow dispatch arguments (one uvec4 each)
+    constexpr GLsizeiptr QueueHeaderSize = 64;
+    constexpr GLintptr ExtendDispatchOffset = 16;
+    constexpr GLintptr ShadeDispatchOffset = 32;
+    constexpr GLintptr ShadowDispatchOffset = 48;
+
+    GLuint Programs[StageCount];
+    GLint UniformLocations[StageCount][UniformCount];
+
+    GLuint PathBuffer, QueueBuffer, ShadowRayBuffer;
+    int AllocatedPathCount = 0;
+
+    bool Init()
+    {
+        Delete();
+
+        for (int stage = 0; stage < StageCount; stage++)
+        {
+            Programs[stage] = Renderer::CreateComputeProgram("shaders\\wavefront.glsl", StageDefines[stage]);
+
+            GLint linked = GL_FALSE;
+            if (Programs[stage]) glGetProgramiv(Programs[stage], GL_LINK_STATUS, &linked);
+            if (!linked)
+            {
+                Delete();
+                return false;
+            }
+
+            for (int uniform = 0; uniform < UniformCount; uniform++)
+            {
+                UniformLocations[stage][uniform] = glGetUniformLocation(Programs[stage], UniformNames[uniform]);
+            }
+            glProgramUniform1i(Programs[stage], UniformLocations[stage][SkyboxTexture], 1);
+            glProgramUniform1i(Programs[stage], UniformLocations[stage][BlueNoiseTexture], BlueNoise::TextureUnit);
+        }
+
+        return true;
+    }
+
+    void Delete()
+    {
+        for (GLuint& program : Programs)
+        {
+            glDeleteProgram(program);
+            program = 0;
+        }
+
+        glDeleteBuffers(1, &PathBuffer);
+        glDeleteBuffers(1, &QueueBuffer);
+        glDeleteBuffers(1, &ShadowRayBuffer);
+        PathBuffer = QueueBuffer = ShadowRayBuffer = 0;
+        AllocatedPathCount = 0;
+    }
+
+    void AllocateBuffer(GLuint& buffer, const GLuint binding, const GLsizeiptr size)
+    {
+        if (!buffer) glGenBuffers(1, &buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+    }
+
+    // One path per pixel; every queue can hold all of them
+    void AllocateBuffers(const int pathCount)
+    {
+        AllocateBuffer(PathBuffer, PathBinding, pathCount * PathSize);
+        AllocateBuffer(QueueBuffer, QueueBinding, QueueHeaderSize + 3 * pathCount * sizeof(GLuint));
+        AllocateBuffer(ShadowRayBuffer, ShadowRayBinding, pathCount * ShadowRaySize);
+        AllocatedPathCount = pathCount;
+    }
+
+    void SetUniform(const Uniform uniform, const int value)
+    {
+        for (int stage = 0; stage < StageCount; stage++)
+            glProgramUniform1i(Programs[stage], UniformLocations[stage][uniform], value);
+    }
+
+    void SetUniform(const Uniform uniform, const GLuint value)
+    {
+        for (int stage = 0; stage < StageCount; stage++)
+            glProgramUniform1ui(Programs[stage], UniformLocations[stage][uniform], value);
+    }
+
+    // Covers invocations with a grid of work groups, like dispatchSize() in wavefront.glsl
+    void DispatchInvocations(const GLuint invocations)
+    {
+        const GLuint groups = (invocations + WorkgroupSize - 1) / WorkgroupSize;
+        const GLuint width = std::min(groups, MaxDispatchWidth);
+        if (width > 0) glDispatchCompute(width, (groups + width - 1) / width, 1);
+    }
+
+    // Runs the prepare stage and makes its dispatch arguments visible to the following indirect dispatch
+    void PrepareQueue(const PrepareTarget target)
+    {
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glUseProgram(Programs[Prepare]);
+        glUniform1i(UniformLocations[Prepare][PrepareStage], target);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    }
+
+    void DispatchQueue(const Stage stage, const GLintptr dispatchOffset)
+    {
+        glUseProgram(Programs[stage]);
+        glDispatchComputeIndirect(dispatchOffset);
+    }
+
+    void AccumulatePass(const glm::vec3 cameraPosition, const glm::mat4& rotationMatrix, const float aspectRatio,
+                        const int accumulatedPasses, const uint32_t firstSample)
+    {
+        const int pathCount = Renderer::TargetWidth * Renderer::TargetHeight;
+        if (pathCount != AllocatedPathCount) AllocateBuffers(pathCount);
+
+        for (int stage = 0; stage < StageCount; stage++)
+        {
+            const GLuint program = Programs[stage];
+            const GLint* locations = UniformLocations[stage];
+            glProgramUniform1ui(program, locations[PathCount], static_cast<GLuint>(pathCount));
+            glProgramUniform2i(program, locations[Resolution], Renderer::TargetWidth, Renderer::TargetHeight);
+            glProgramUniform3f(program, locations[CameraPosition], cameraPosition.x, cameraPosition.y,
+                               cameraPosition.z);
+            glProgramUniformMatrix4fv(program, locations[RotationMatrix], 1, GL_FALSE,
+                                      glm::value_ptr(rotationMatrix));
+            glProgramUniform1f(program, locations[AspectRatio], aspectRatio);
+        }
+        SetUniform(AccumulatedPasses, accumulatedPasses);
+        SetUniform(FirstSample, static_cast<GLuint>(firstSample));
+        SetUniform(AdaptiveSampling, Adaptive::Enabled ? 1 : 0);
+        // Converged pixels don't get a path, so the first extend queue has to be compacted
+        const bool compactPaths = Adaptive::Enabled && accumulatedPasses > 0;
+
+        const Renderer::AccumulationTarget& target = Renderer::Targets[Renderer::CurrentTarget];
+        glBindImageTexture(0, target.m_MeanTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindImageTexture(1, target.m_CompensationTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindImageTexture(2, target.m_MomentsTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, QueueBuffer);
+
+        for (int sample = 0; sample < Scene::FramePasses; sample++)
+        {
+            if (compactPaths) PrepareQueue(PrepareGenerate);
+            glUseProgram(Programs[Generate]);
+            glUniform1i(UniformLocations[Generate][Sample], sample);
+            DispatchInvocations(static_cast<GLuint>(pathCount));
+
+            // Paths that stop bouncing leave the queues, so later bounces dispatch fewer invocations. Every bounce
+            // is still submitted since the CPU doesn't know when the queues run dry.
+            for (int bounce = 0; bounce < Scene::LightBounces; bounce++)
+            {
+                SetUniform(Bounce, bounce);
+
+                PrepareQueue(PrepareExtend);
+                DispatchQueue(Extend, ExtendDispatchOffset);
+
+                PrepareQueue(PrepareShade);
+                DispatchQueue(Shade, ShadeDispatchOffset);
+
+                PrepareQueue(PrepareShadow);
+                DispatchQueue(Shadow, ShadowDispatchOffset);
+            }
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+
+        glUseProgram(Programs[Accumulate]);
+        DispatchInvocations(static_cast<GLuint>(pathCount));
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+            GL_FRAMEBUFFER_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+
+        glUseProgram(Renderer::ShaderProgram);
+    }
+}
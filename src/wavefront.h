@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <GL/glew.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Compute shader backend rendering the same image as fragment.glsl. Instead of tracing whole paths per pixel, every
+// bounce runs as generate/extend/shade/shadow dispatches that pass rays through queues in storage buffers, which keeps
+// the invocations of a dispatch doing the same work. See wavefront.glsl.
+namespace Wavefront
+{
+    // Must match WORKGROUP_SIZE in wavefront.glsl
+    constexpr GLuint WorkgroupSize = 64;
+    // Work groups a dispatch has along x at most, the GL_MAX_COMPUTE_WORK_GROUP_COUNT every driver supports. Larger
+    // dispatches continue in rows along y. Must match MAX_DISPATCH_WIDTH in wavefront.glsl.
+    constexpr GLuint MaxDispatchWidth = 65535;
+
+    // Shader storage buffer binding points used by wavefront.glsl, after the ones used by the scene
+    constexpr GLuint PathBinding = 5;
+    constexpr GLuint QueueBinding = 6;
+    constexpr GLuint ShadowRayBinding = 7;
+
+    // Compiles the stage programs. Returns false if any of them failed.
+    bool Init();
+    void Delete();
+
+    // Traces Scene::FramePasses samples per pixel and folds their average into the running mean of the current
+    // Renderer::Targets entry, like one pass of fragment.glsl does. The samples are numbered from firstSample on.
+    void AccumulatePass(glm::vec3 cameraPosition, const glm::mat4& rotationMatrix, float aspectRatio,
+                        int accumulatedPasses, uint32_t firstSample);
+}